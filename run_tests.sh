@@ -55,3 +55,48 @@ mkdir $output_dir
 ./build/test_reader benchmark/des_perf.spef && \
 ./build/test_reader benchmark/vga_lcd.spef
 
+
+# check that a command succeeds, and stop with its name otherwise
+check() {
+  if ! "$@" >/dev/null 2>&1; then
+    echo "Failed: $*" >&2
+    exit 1
+  fi
+}
+
+# the round trips through the other modes must give the nets of the file back
+for spef in benchmark/*.spef; do
+  name=$(basename $spef .spef)
+  mkdir -p gen/shards/$name
+  rm -f gen/shards/$name/*.spef
+  check ./build/spef_check --shard 4 $spef gen/shards/$name/shard
+  ./build/spef_check --merge gen/shards/$name/shard_*.spef \
+    >gen/$name.merged.spef 2>/dev/null
+  check ./build/spef_check --diff $spef gen/$name.merged.spef
+  ./build/spef_check --name-map $spef >gen/$name.mapped.spef 2>/dev/null
+  ./build/spef_check --expand gen/$name.mapped.spef \
+    >gen/$name.expanded.spef 2>/dev/null
+  check ./build/spef_check --diff $spef gen/$name.expanded.spef
+  ./build/spef_check --normalize $spef >gen/$name.normalized.spef 2>/dev/null
+  check ./build/spef_check --diff $spef gen/$name.normalized.spef
+  check ./build/spef_check --corner max $spef
+done
+
+# a net without *END must be reported, not crash
+head -n 30 benchmark/c17.spef >gen/truncated.spef
+./build/spef_check --corner max gen/truncated.spef >/dev/null 2>&1
+if [[ $? -ne 2 ]]; then
+  echo "Failed: --corner on a malformed file" >&2
+  exit 1
+fi
+./build/spef_check --recover gen/truncated.spef >/dev/null
+if [[ $? -ne 1 ]]; then
+  echo "Failed: --recover on a malformed file" >&2
+  exit 1
+fi
+./build/spef_check --recover gen/missing.spef >/dev/null 2>&1
+if [[ $? -ne 2 ]]; then
+  echo "Failed: --recover on a missing file" >&2
+  exit 1
+fi
+echo "All the checks passed"
@@ -0,0 +1,158 @@
+#include "spef_number.hpp"
+#include <chrono>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compares parse_number with std::from_chars on the numbers of a SPEF file, or
+// on random decimals shaped like the ones of SPEF files, and checks that both
+// give bitwise identical values.
+
+namespace {
+/// The whitespace and ':' separated tokens of text that std::from_chars
+/// parses completely as a double
+std::vector<std::string_view> number_tokens(std::string_view text) {
+  std::vector<std::string_view> tokens;
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    auto const end = text.find_first_of(" \t\r\n:", pos);
+    auto const token = text.substr(pos, end - pos);
+    double value{};
+    auto const [ptr, ec] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    if (!token.empty() && ec == std::errc{} &&
+        ptr == token.data() + token.size()) {
+      tokens.push_back(token);
+    }
+    if (end == std::string_view::npos) {
+      break;
+    }
+    pos = end + 1;
+  }
+  return tokens;
+}
+
+/// Random decimals: mostly short ones like 0.0141, some with long mantissas
+/// and some with an exponent, which take the slow path
+std::vector<std::string> random_numbers(std::size_t count) {
+  std::mt19937_64 gen(1);
+  std::uniform_int_distribution<int> shape(0, 99);
+  std::uniform_int_distribution<std::uint64_t> digits(0, 99999);
+  std::uniform_int_distribution<std::uint64_t> long_digits(
+      0,
+      999999999999999999);
+  std::vector<std::string> numbers;
+  numbers.reserve(count);
+  for (std::size_t idx = 0; idx < count; ++idx) {
+    auto const kind = shape(gen);
+    if (kind < 80) {
+      numbers.push_back(fmt::format("{}.{:04}", digits(gen) % 10, digits(gen)));
+    } else if (kind < 90) {
+      numbers.push_back(fmt::format("{}", digits(gen)));
+    } else if (kind < 95) {
+      numbers.push_back(fmt::format("0.{:018}", long_digits(gen)));
+    } else {
+      numbers.push_back(fmt::format("{}.{}e-3", digits(gen) % 10, digits(gen)));
+    }
+  }
+  return numbers;
+}
+
+template<typename T, typename Parse>
+double time_parse(
+    std::vector<std::string_view> const &tokens,
+    std::vector<T> &values,
+    Parse parse) {
+  static constexpr int REPEATS = 20;
+  values.resize(tokens.size());
+  auto const start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < REPEATS; ++rep) {
+    for (std::size_t idx = 0; idx < tokens.size(); ++idx) {
+      auto const &token = tokens[idx];
+      parse(token.data(), token.data() + token.size(), values[idx]);
+    }
+  }
+  std::chrono::duration<double, std::nano> const time =
+      std::chrono::steady_clock::now() - start;
+  return time.count() / REPEATS / static_cast<double>(tokens.size());
+}
+
+template<typename T>
+bool bench(std::vector<std::string_view> const &tokens, char const *type) {
+  std::vector<T> expected;
+  std::vector<T> values;
+  auto const from_chars_ns = time_parse(
+      tokens,
+      expected,
+      [](char const *first, char const *last, T &value) {
+        return std::from_chars(first, last, value);
+      });
+  auto const parse_number_ns = time_parse(
+      tokens,
+      values,
+      [](char const *first, char const *last, T &value) {
+        return parse_number(first, last, value);
+      });
+
+  std::size_t mismatches = 0;
+  for (std::size_t idx = 0; idx < tokens.size(); ++idx) {
+    if (std::memcmp(&values[idx], &expected[idx], sizeof(T)) != 0) {
+      if (mismatches++ < 10) {
+        fmt::print(
+            "mismatch for {}: {} != {}\n",
+            tokens[idx],
+            values[idx],
+            expected[idx]);
+      }
+    }
+  }
+  fmt::print(
+      "{:<6} from_chars {:6.2f} ns  parse_number {:6.2f} ns  speedup {:.2f}x"
+      "  mismatches {}\n",
+      type,
+      from_chars_ns,
+      parse_number_ns,
+      from_chars_ns / parse_number_ns,
+      mismatches);
+  return mismatches == 0;
+}
+}  // namespace
+
+int main(int argc, char const *const *argv) {
+  std::string text;
+  std::vector<std::string> numbers;
+  std::vector<std::string_view> tokens;
+  if (argc == 2) {
+    std::ifstream in(argv[1]);
+    if (!in) {
+      fmt::print(stderr, "Could not open {}\n", argv[1]);
+      return 1;
+    }
+    text.assign(
+        std::istreambuf_iterator<char>(in),
+        std::istreambuf_iterator<char>());
+    tokens = number_tokens(text);
+  } else if (argc == 1) {
+    numbers = random_numbers(1'000'000);
+    tokens.assign(numbers.begin(), numbers.end());
+  } else {
+    fmt::print(stderr, "Usage: {} [<filename>.spef]\n", argv[0]);
+    return 1;
+  }
+  if (tokens.empty()) {
+    fmt::print(stderr, "No numbers to parse\n");
+    return 1;
+  }
+
+  fmt::print("{} numbers\n", tokens.size());
+  bool const double_ok = bench<double>(tokens, "double");
+  bool const float_ok = bench<float>(tokens, "float");
+  return double_ok && float_ok ? 0 : 2;
+}
@@ -77,11 +77,42 @@ DirType convert_direction(std::string_view direction_sv) {
   throw std::runtime_error("Unknown direction type");
 };
 
+UnitType convert_unit(std::string_view unit_sv) {
+  if (unit_sv == "NS") {
+    return UnitType::Nanosecond;
+  }
+  if (unit_sv == "PS") {
+    return UnitType::Picosecond;
+  }
+  if (unit_sv == "PF") {
+    return UnitType::Picofarad;
+  }
+  if (unit_sv == "FF") {
+    return UnitType::Femtofarad;
+  }
+  if (unit_sv == "OHM") {
+    return UnitType::Ohm;
+  }
+  if (unit_sv == "KOHM") {
+    return UnitType::Kiloohm;
+  }
+  if (unit_sv == "HENRY") {
+    return UnitType::Henry;
+  }
+  if (unit_sv == "MH") {
+    return UnitType::Millihenry;
+  }
+  if (unit_sv == "UH") {
+    return UnitType::Microhenry;
+  }
+  throw std::runtime_error(fmt::format("Unknown unit: {}", unit_sv));
+}
+
 Capacitances get_caps(std::vector<std::string_view> const &tokens) {
   Capacitances caps;
   for (auto const &token : tokens) {
     cap_t &cap = caps.m_caps.emplace_back();
-    auto const [_, ec] = std::from_chars(token.begin(), token.end(), cap);
+    auto const [_, ec] = parse_number(token.begin(), token.end(), cap);
     handle_from_chars(ec, token);
   }
   return caps;
@@ -91,8 +122,80 @@ Thresholds get_thresholds(std::vector<std::string_view> const &tokens) {
   Thresholds threshs;
   for (auto const &token : tokens) {
     thresh_t &thresh = threshs.m_thresh.emplace_back();
-    auto const [_, ec] = std::from_chars(token.begin(), token.end(), thresh);
+    auto const [_, ec] = parse_number(token.begin(), token.end(), thresh);
     handle_from_chars(ec, token);
   }
   return threshs;
 }
+
+void get_sensitivities(
+    std::vector<std::string_view> const &tokens,
+    std::size_t first,
+    std::uint32_t element,
+    Sensitivities &sens) {
+  if (first >= tokens.size() || tokens[first] != "*SC") {
+    return;
+  }
+  for (std::size_t idx = first + 1; idx < tokens.size(); ++idx) {
+    auto const token = tokens[idx];
+    auto const colon = token.find(':');
+    if (colon == std::string_view::npos) {
+      throw std::runtime_error(
+          fmt::format("Couldn't parse the sensitivity: {}", token));
+    }
+
+    std::uint32_t param{};
+    {
+      auto const [_, ec] =
+          parse_number(token.begin(), token.begin() + colon, param);
+      handle_from_chars(ec, token);
+    }
+    double coeff{};
+    {
+      auto const [_, ec] =
+          parse_number(token.begin() + colon + 1, token.end(), coeff);
+      handle_from_chars(ec, token);
+    }
+
+    sens.m_elements.push_back(element);
+    sens.m_params.push_back(param);
+    sens.m_coeffs.push_back(coeff);
+  }
+}
+
+namespace {
+/// Parses a real number, or a complex one like (re im)
+std::complex<double> parse_complex_value(std::string_view token) {
+  // the real and the imaginary part, separated by whitespace in parentheses
+  std::array<double, 2> components{};
+  char const *ptr = token.begin();
+  for (auto &component : components) {
+    while (ptr != token.end() &&
+           (std::isspace(static_cast<unsigned char>(*ptr)) != 0 ||
+            *ptr == '(' || *ptr == ')')) {
+      ++ptr;
+    }
+    if (ptr == token.end()) {
+      break;
+    }
+    auto const [next, ec] = parse_number(ptr, token.end(), component);
+    handle_from_chars(ec, token);
+    ptr = next;
+  }
+  return {components[0], components[1]};
+}
+}  // namespace
+
+std::size_t parse_complex_par_value(
+    std::string_view token,
+    std::array<std::complex<double>, NUM_CORNERS> &values) {
+  std::size_t num_values = 0;
+  for (;;) {
+    auto const colon = token.find(':');
+    values[num_values++] = parse_complex_value(token.substr(0, colon));
+    if (colon == std::string_view::npos || num_values == NUM_CORNERS) {
+      return num_values;
+    }
+    token.remove_prefix(colon + 1);
+  }
+}
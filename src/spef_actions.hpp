@@ -1,10 +1,13 @@
 #ifndef SPEF_ACTIONS_HPP
 #define SPEF_ACTIONS_HPP
 
+#include "spef_number.hpp"
 #include "spef_structs.hpp"
+#include <algorithm>
 #include <array>
 #include <cctype>
 #include <charconv>
+#include <complex>
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 #include <iostream>
@@ -21,10 +24,115 @@ void handle_from_chars(std::errc ec, std::string_view match);
 
 DirType convert_direction(std::string_view direction_sv);
 
+UnitType convert_unit(std::string_view unit_sv);
+
 Capacitances get_caps(std::vector<std::string_view> const &tokens);
 
 Thresholds get_thresholds(std::vector<std::string_view> const &tokens);
 
+/// Appends the *SC sensitivities of an element, which start at tokens[first],
+/// if there are any
+void get_sensitivities(
+    std::vector<std::string_view> const &tokens,
+    std::size_t first,
+    std::uint32_t element,
+    Sensitivities &sens);
+
+/// Parses a par_value, a single value or a min:typ:max triplet, into values,
+/// and returns the number of values
+template<typename T>
+std::size_t
+parse_par_value(std::string_view token, std::array<T, NUM_CORNERS> &values) {
+  std::size_t num_values = 0;
+  for (;;) {
+    auto const colon = token.find(':');
+    auto const part = token.substr(0, colon);
+    auto const [_, ec] =
+        parse_number(part.begin(), part.end(), values[num_values++]);
+    handle_from_chars(ec, part);
+    if (colon == std::string_view::npos || num_values == NUM_CORNERS) {
+      return num_values;
+    }
+    token.remove_prefix(colon + 1);
+  }
+}
+
+/// Returns the typ value of a par_value
+template<typename T>
+T get_typ_value(std::string_view token) {
+  std::array<T, NUM_CORNERS> values{};
+  return parse_par_value(token, values) == 1 ? values[0] : values[1];
+}
+
+/// Parses a complex_par_value, a real number or a complex one like (re im), or
+/// a min:typ:max triplet of them, into values, and returns the number of
+/// values
+std::size_t parse_complex_par_value(
+    std::string_view token,
+    std::array<std::complex<double>, NUM_CORNERS> &values);
+
+/// Adds the values of the next element, a single value or a min:typ:max
+/// triplet, to the corners of the net, and returns its typ value. The corners
+/// are kept once the net has a triplet, and are filled in with the typ values
+/// typ_of(idx) of the num_elems elements before it.
+template<typename T, typename TypOf>
+T add_par_value(
+    std::array<T, NUM_CORNERS> const &values,
+    std::size_t num_values,
+    std::size_t num_elems,
+    TypOf const &typ_of,
+    CornerValues<T> &corners) {
+  if (num_values == 1) {
+    if (!corners.empty()) {
+      corners.push_back(values[0], values[0], values[0]);
+    }
+    return values[0];
+  }
+  if (corners.empty()) {
+    for (std::size_t idx = 0; idx < num_elems; ++idx) {
+      T const typ = typ_of(idx);
+      corners.push_back(typ, typ, typ);
+    }
+  }
+  corners.push_back(values[0], values[1], values[2]);
+  return values[1];
+}
+
+/// Parses the par_value of the next element of elems, a single value or a
+/// min:typ:max triplet, and returns its typ value. The corners of the net are
+/// kept once it has a triplet, and are filled in for the elements before it.
+template<typename T, typename Elem>
+T get_par_value(
+    std::string_view token,
+    std::vector<Elem> const &elems,
+    T Elem::*value,
+    CornerValues<T> &corners) {
+  std::array<T, NUM_CORNERS> values{};
+  std::size_t const num_values = parse_par_value(token, values);
+  return add_par_value(
+      values,
+      num_values,
+      elems.size(),
+      [&](std::size_t idx) { return elems[idx].*value; },
+      corners);
+}
+
+/// Parses the complex_par_value of the next pole or residue of the net, like
+/// get_par_value
+inline std::complex<double> get_complex_value(
+    std::string_view token,
+    std::vector<std::complex<double>> const &values_before,
+    CornerValues<std::complex<double>> &corners) {
+  std::array<std::complex<double>, NUM_CORNERS> values{};
+  std::size_t const num_values = parse_complex_par_value(token, values);
+  return add_par_value(
+      values,
+      num_values,
+      values_before.size(),
+      [&](std::size_t idx) { return values_before[idx]; },
+      corners);
+}
+
 template<typename Rule>
 struct spef_action : tao::pegtl::nothing<Rule> {};
 
@@ -132,10 +240,10 @@ struct spef_action<spef_time_scale> {
     auto unit = spef_h.m_tokens[2];
 
     double num{};
-    auto const [_, ec] = std::from_chars(number.begin(), number.end(), num);
+    auto const [_, ec] = parse_number(number.begin(), number.end(), num);
     handle_from_chars(ec, number);
 
-    spef.m_time_scale = scaled_value{num, std::string(unit)};
+    spef.m_time_scale = scaled_value{num, convert_unit(unit)};
   }
 };
 
@@ -148,10 +256,10 @@ struct spef_action<spef_cap_scale> {
     auto unit = spef_h.m_tokens[2];
 
     double num{};
-    auto const [_, ec] = std::from_chars(number.begin(), number.end(), num);
+    auto const [_, ec] = parse_number(number.begin(), number.end(), num);
     handle_from_chars(ec, number);
 
-    spef.m_cap_scale = scaled_value{num, std::string(unit)};
+    spef.m_cap_scale = scaled_value{num, convert_unit(unit)};
   }
 };
 
@@ -164,10 +272,10 @@ struct spef_action<spef_res_scale> {
     auto unit = spef_h.m_tokens[2];
 
     double num{};
-    auto const [_, ec] = std::from_chars(number.begin(), number.end(), num);
+    auto const [_, ec] = parse_number(number.begin(), number.end(), num);
     handle_from_chars(ec, number);
 
-    spef.m_res_scale = scaled_value{num, std::string(unit)};
+    spef.m_res_scale = scaled_value{num, convert_unit(unit)};
   }
 };
 
@@ -180,10 +288,10 @@ struct spef_action<spef_induct_scale> {
     auto unit = spef_h.m_tokens[2];
 
     double num{};
-    auto const [_, ec] = std::from_chars(number.begin(), number.end(), num);
+    auto const [_, ec] = parse_number(number.begin(), number.end(), num);
     handle_from_chars(ec, number);
 
-    spef.m_induct_scale = scaled_value{num, std::string(unit)};
+    spef.m_induct_scale = scaled_value{num, convert_unit(unit)};
   }
 };
 
@@ -225,11 +333,11 @@ struct spef_action<spef_coordinates> {
 
     Coordinates coord{};
     {
-      auto const [_, ec] = std::from_chars(x_sv.begin(), x_sv.end(), coord.x);
+      auto const [_, ec] = parse_number(x_sv.begin(), x_sv.end(), coord.x);
       handle_from_chars(ec, x_sv);
     }
     {
-      auto const [_, ec] = std::from_chars(y_sv.begin(), y_sv.end(), coord.y);
+      auto const [_, ec] = parse_number(y_sv.begin(), y_sv.end(), coord.y);
       handle_from_chars(ec, y_sv);
     }
     spef_h.attributes.emplace_back(std::make_unique<CoordinatesAttr>(coord));
@@ -320,6 +428,71 @@ struct spef_action<spef_pport_entry> {
   }
 };
 
+template<>
+struct spef_action<spef_process_param_def> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &spef, SPEFHelper &spef_h) {
+    // the name is quoted, and can contain whitespace
+    auto const line = input.string_view();
+    auto const name_begin = line.find('"');
+    auto const name_end = line.find('"', name_begin + 1) + 1;
+    split(line.substr(0, name_begin), spef_h.m_tokens);
+    split(line.substr(name_end), spef_h.m_tokens2);
+
+    VariationParameter param{};
+    param.m_name = line.substr(name_begin, name_end - name_begin);
+    auto const id = spef_h.m_tokens[0];
+    {
+      auto const [_, ec] = parse_number(id.begin(), id.end(), param.m_id);
+      handle_from_chars(ec, id);
+    }
+    param.m_cap_type = spef_h.m_tokens2[0][0];
+    param.m_res_type = spef_h.m_tokens2[1][0];
+    param.m_induct_type = spef_h.m_tokens2[2][0];
+    auto const var_coeff = spef_h.m_tokens2[3];
+    {
+      auto const [_, ec] = parse_number(
+          var_coeff.begin(),
+          var_coeff.end(),
+          param.m_var_coeff);
+      handle_from_chars(ec, var_coeff);
+    }
+    auto const normalization = spef_h.m_tokens2[4];
+    {
+      auto const [_, ec] = parse_number(
+          normalization.begin(),
+          normalization.end(),
+          param.m_normalization);
+      handle_from_chars(ec, normalization);
+    }
+
+    spef.m_variation_params.push_back(std::move(param));
+  }
+};
+
+template<>
+struct spef_action<spef_temperature_coeff_def> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &spef, SPEFHelper &spef_h) {
+    // <id> CRT1 <id> CRT2 <nominal temperature>
+    split(input.string_view(), spef_h.m_tokens);
+
+    TemperatureCoeffs coeffs{};
+    for (auto const &[token, value] :
+         {std::pair{spef_h.m_tokens[0], &coeffs.m_crt1},
+          std::pair{spef_h.m_tokens[2], &coeffs.m_crt2}}) {
+      auto const [_, ec] = parse_number(token.begin(), token.end(), *value);
+      handle_from_chars(ec, token);
+    }
+    auto const temp = spef_h.m_tokens[4];
+    auto const [_, ec] =
+        parse_number(temp.begin(), temp.end(), coeffs.m_nominal_temp);
+    handle_from_chars(ec, temp);
+
+    spef.m_temperature_coeffs = coeffs;
+  }
+};
+
 template<>
 struct spef_action<spef_name_map_entry> {
   template<typename Action>
@@ -363,15 +536,28 @@ template<>
 struct spef_action<spef_total_cap> {
   template<typename Action>
   static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
-    cap_t cap{};
-    auto number = input.string_view();
-    auto const [_, ec] = std::from_chars(number.begin(), number.end(), cap);
-    handle_from_chars(ec, number);
+    split(input.string_view(), spef_h.m_tokens);
+    std::array<cap_t, NUM_CORNERS> values{};
+    bool const is_triplet =
+        parse_par_value(spef_h.m_tokens[0], values) == NUM_CORNERS;
+    cap_t const cap = is_triplet ? values[1] : values[0];
 
     if (spef_h.reading_d_net) {
       spef_h.m_current_d_net.m_total_cap = cap;
+      if (is_triplet) {
+        spef_h.m_current_variations.m_total_cap_corners.push_back(
+            values[0],
+            values[1],
+            values[2]);
+      }
     } else if (spef_h.reading_r_net) {
-      spef_h.m_current_r_net.m_total_cap = cap;
+      auto &r_net = spef_h.m_current_r_net;
+      r_net.m_total_cap = cap;
+      if (is_triplet) {
+        r_net.m_total_cap_corners = values;
+      } else {
+        r_net.m_total_cap_corners.reset();
+      }
     }
   }
 };
@@ -380,6 +566,13 @@ template<>
 struct spef_action<spef_d_net_end> {
   template<typename Action>
   static void apply(Action const &, SPEF &spef, SPEFHelper &spef_h) {
+    if (spef_h.m_d_net_end) {
+      spef_h.m_d_net_end(spef, spef_h.m_current_d_net);
+    }
+    spef.m_d_net_variations.append(
+        spef.m_d_nets.size(),
+        spef_h.m_current_variations.view());
+    spef_h.m_current_variations.clear();
     spef.m_d_nets.emplace_back(std::move(spef_h.m_current_d_net));
     spef_h.reading_d_net = false;
   }
@@ -394,6 +587,115 @@ struct spef_action<spef_r_net_end> {
   }
 };
 
+template<>
+struct spef_action<spef_driver_pin> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
+    split(input.string_view(), spef_h.m_tokens);
+    spef_h.m_current_r_net.m_driver = spef_h.m_tokens[1];
+  }
+};
+
+template<>
+struct spef_action<spef_driver_cell> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
+    split(input.string_view(), spef_h.m_tokens);
+    spef_h.m_current_r_net.m_driver_cell = spef_h.m_tokens[1];
+  }
+};
+
+template<>
+struct spef_action<spef_pi_model> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
+    split(input.string_view(), spef_h.m_tokens);
+    auto &r_net = spef_h.m_current_r_net;
+    std::array<cap_t, NUM_CORNERS> c2{};
+    std::array<res_t, NUM_CORNERS> r1{};
+    std::array<cap_t, NUM_CORNERS> c1{};
+    std::size_t const num_c2 = parse_par_value(spef_h.m_tokens[1], c2);
+    std::size_t const num_r1 = parse_par_value(spef_h.m_tokens[2], r1);
+    std::size_t const num_c1 = parse_par_value(spef_h.m_tokens[3], c1);
+    auto const typ = [](auto const &values, std::size_t num_values) {
+      return num_values == 1 ? values[0] : values[1];
+    };
+    r_net.m_pi_model = {typ(c2, num_c2), typ(r1, num_r1), typ(c1, num_c1)};
+    if (num_c2 == 1 && num_r1 == 1 && num_c1 == 1) {
+      r_net.m_pi_model_corners.reset();
+      return;
+    }
+    auto &corners = r_net.m_pi_model_corners.emplace();
+    for (std::size_t corner = 0; corner < NUM_CORNERS; ++corner) {
+      corners[corner] = {
+          c2[num_c2 == 1 ? 0 : corner],
+          r1[num_r1 == 1 ? 0 : corner],
+          c1[num_c1 == 1 ? 0 : corner]};
+    }
+  }
+};
+
+template<>
+struct spef_action<spef_pole> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
+    auto &r_net = spef_h.m_current_r_net;
+    auto const pole = get_complex_value(
+        input.string_view(),
+        r_net.m_poles,
+        r_net.m_pole_corners);
+    r_net.m_poles.push_back(pole);
+  }
+};
+
+template<>
+struct spef_action<spef_residue> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
+    auto &r_net = spef_h.m_current_r_net;
+    auto const residue = get_complex_value(
+        input.string_view(),
+        r_net.m_residues,
+        r_net.m_residue_corners);
+    r_net.m_residues.push_back(residue);
+  }
+};
+
+template<>
+struct spef_action<spef_rc_desc> {
+  template<typename Action>
+  static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
+    // *RC <pin> <rc> [*Q <n> <pole>... *K <n> <residue>...], whose poles and
+    // residues have already been added to the net
+    split(input.string_view(), spef_h.m_tokens, 3);
+    auto &r_net = spef_h.m_current_r_net;
+
+    RNet::Load load;
+    load.m_pin = spef_h.m_tokens[1];
+    load.m_rc = get_par_value(
+        spef_h.m_tokens[2],
+        r_net.m_loads,
+        &RNet::Load::m_rc,
+        r_net.m_rc_corners);
+    if (!r_net.m_loads.empty()) {
+      auto const &prev = r_net.m_loads.back();
+      load.m_first_pole = prev.m_first_pole + prev.m_num_poles;
+    }
+    load.m_num_poles =
+        static_cast<std::uint32_t>(r_net.m_poles.size() - load.m_first_pole);
+    if (r_net.m_residues.size() != r_net.m_poles.size()) {
+      throw std::runtime_error(fmt::format(
+          "The load {} of the net {} has {} poles and {} residues",
+          load.m_pin,
+          r_net.m_name,
+          load.m_num_poles,
+          r_net.m_residues.size() - load.m_first_pole));
+    }
+
+    r_net.m_loads.push_back(std::move(load));
+  }
+};
+
 template<>
 struct spef_action<spef_routing_conf> {
   template<typename Action>
@@ -402,7 +704,7 @@ struct spef_action<spef_routing_conf> {
     auto const &number = spef_h.m_tokens[2];
     unsigned int routing_conf{};
     auto const [_, ec] =
-        std::from_chars(number.begin(), number.end(), routing_conf);
+        parse_number(number.begin(), number.end(), routing_conf);
     handle_from_chars(ec, number);
 
     if (spef_h.reading_d_net) {
@@ -465,45 +767,68 @@ struct spef_action<spef_internal_node_coord> {
 };
 
 template<>
-struct spef_action<spef_cap_elem_ground> {
+struct spef_action<spef_cap_elem> {
   template<typename Action>
   static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
     split(input.string_view(), spef_h.m_tokens);
 
-    auto const node = spef_h.m_tokens[1];
-    cap_t cap{};
-    auto const cap_value = spef_h.m_tokens[2];
-    {
-      auto const [_, ec] =
-          std::from_chars(cap_value.begin(), cap_value.end(), cap);
-      handle_from_chars(ec, cap_value);
+    // <id> <node> [<node2>] <value> [*SC ...], so a coupling cap has four
+    // fields before its sensitivities
+    auto const &tokens = spef_h.m_tokens;
+    auto const num_fields = static_cast<std::size_t>(
+        std::find(tokens.begin(), tokens.end(), "*SC") - tokens.begin());
+    if (num_fields == 3) {
+      add_ground_cap(
+          tokens,
+          spef_h.m_current_d_net,
+          spef_h.m_current_variations);
+    } else {
+      add_coupling_cap(
+          tokens,
+          spef_h.m_current_d_net,
+          spef_h.m_current_variations);
     }
-
-    // TODO: add sensitivity
-
-    spef_h.m_current_d_net.m_ground_caps.push_back({std::string{node}, cap});
   }
-};
 
-template<>
-struct spef_action<spef_cap_elem_coupling> {
-  template<typename Action>
-  static void apply(Action const &input, SPEF &, SPEFHelper &spef_h) {
-    split(input.string_view(), spef_h.m_tokens);
-
-    auto const node1 = spef_h.m_tokens[1];
-    auto const node2 = spef_h.m_tokens[2];
-    cap_t cap{};
-    auto const cap_value = spef_h.m_tokens[3];
-    {
-      auto const [_, ec] =
-          std::from_chars(cap_value.begin(), cap_value.end(), cap);
-      handle_from_chars(ec, cap_value);
-    }
-
-    // TODO: add sensitivity
-
-    spef_h.m_current_d_net.m_coupling_caps.push_back(
+  static void add_ground_cap(
+      std::vector<std::string_view> const &tokens,
+      DNet &d_net,
+      DNetVariations &variations) {
+    auto const node = tokens[1];
+    cap_t const cap = get_par_value(
+        tokens[2],
+        d_net.m_ground_caps,
+        &DNet::GroundCapacitance::m_cap,
+        variations.m_ground_cap_corners);
+
+    get_sensitivities(
+        tokens,
+        3,
+        static_cast<std::uint32_t>(d_net.m_ground_caps.size()),
+        variations.m_ground_cap_sens);
+
+    d_net.m_ground_caps.push_back({std::string{node}, cap});
+  }
+
+  static void add_coupling_cap(
+      std::vector<std::string_view> const &tokens,
+      DNet &d_net,
+      DNetVariations &variations) {
+    auto const node1 = tokens[1];
+    auto const node2 = tokens[2];
+    cap_t const cap = get_par_value(
+        tokens[3],
+        d_net.m_coupling_caps,
+        &DNet::CouplingCapacitance::m_cap,
+        variations.m_coupling_cap_corners);
+
+    get_sensitivities(
+        tokens,
+        4,
+        static_cast<std::uint32_t>(d_net.m_coupling_caps.size()),
+        variations.m_coupling_cap_sens);
+
+    d_net.m_coupling_caps.push_back(
         {std::string{node1}, std::string{node2}, cap});
   }
 };
@@ -517,15 +842,21 @@ struct spef_action<spef_res_elem> {
     auto const id = spef_h.m_tokens[0];
     auto const node1 = spef_h.m_tokens[1];
     auto const node2 = spef_h.m_tokens[2];
-    res_t res{};
-    auto const res_value = spef_h.m_tokens[3];
-    auto const [_, ec] =
-        std::from_chars(res_value.begin(), res_value.end(), res);
-    handle_from_chars(ec, res_value);
-
-    // TODO: add sensitivity
-
-    spef_h.m_current_d_net.m_resistances.push_back(
+    auto &d_net = spef_h.m_current_d_net;
+    auto &variations = spef_h.m_current_variations;
+    res_t const res = get_par_value(
+        spef_h.m_tokens[3],
+        d_net.m_resistances,
+        &DNet::Resistance::m_res,
+        variations.m_res_corners);
+
+    get_sensitivities(
+        spef_h.m_tokens,
+        4,
+        static_cast<std::uint32_t>(d_net.m_resistances.size()),
+        variations.m_res_sens);
+
+    d_net.m_resistances.push_back(
         {std::string{id}, std::string{node1}, std::string{node2}, res});
   }
 };
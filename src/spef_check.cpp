@@ -1,16 +1,81 @@
 #include "spef_actions.hpp"
+#include "spef_corners.hpp"
+#include "spef_delay.hpp"
+#include "spef_coupling.hpp"
+#include "spef_diff.hpp"
+#include "spef_extract.hpp"
+#include "spef_index.hpp"
+#include "spef_lazy.hpp"
+#include "spef_merge.hpp"
+#include "spef_moments.hpp"
+#include "spef_name_map.hpp"
+#include "spef_node_id.hpp"
+#include "spef_noise.hpp"
+#include "spef_pins.hpp"
+#include "spef_profile.hpp"
 #include "spef_random.hpp"
+#include "spef_recover.hpp"
+#include "spef_reduce.hpp"
+#include "spef_scan.hpp"
+#include "spef_shard.hpp"
+#include "spef_stats.hpp"
 #include "spef_structs.hpp"
+#include "spef_units.hpp"
+#include "spef_variation.hpp"
 #include "spef_write.hpp"
+#include <array>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <optional>
+#include <thread>
 #include <tao/pegtl/contrib/analyze.hpp>
 //#include <tao/pegtl/contrib/trace.hpp>
 
 namespace pegtl = tao::pegtl;
 namespace fs = std::filesystem;
 
+/// Parses the given SPEF file into spef. Any errors are reported to stderr.
+/// d_net_end, if given, is called with every D_NET at its *END.
+bool parse_spef_file(
+    fs::path const &spef_file,
+    SPEF &spef,
+    std::function<void(SPEF const &, DNet &)> d_net_end = {}) {
+  bool success = false;
+
+  // outer try/catch for normal exceptions that might occur for example if the
+  // file is not found
+  try {
+    pegtl::read_input input{spef_file};
+
+    // inner try/catch for the parser exceptions
+    try {
+      //pegtl::tracer<pegtl::tracer_traits<>> tracer(input);
+      //tracer.parse<spef_grammar>(input);
+      SPEFHelper spef_h;
+      spef_h.m_d_net_end = std::move(d_net_end);
+      success = pegtl::parse<pegtl::must<spef_grammar>, spef_action>(
+          input,
+          spef,
+          spef_h);
+    } catch (pegtl::parse_error &err) {
+      std::cerr << "ERROR: An exception occurred during parsing:\n";
+      // this catch block needs access to the input
+      auto const &pos = err.positions().front();
+      std::cerr << err.what() << '\n'
+                << input.line_at(pos) << '\n'
+                << std::setw((int)pos.column) << '^' << std::endl;
+      std::cerr << err.what() << '\n';
+    }
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+  }
+
+  return success;
+}
+
 int main(int argc, char const *const *argv) {
   if (pegtl::analyze<spef_grammar>() != 0) {
     std::cerr << "cycles without progress detected!\n";
@@ -20,10 +85,788 @@ int main(int argc, char const *const *argv) {
   if (argc == 1 || std::strcmp(argv[1], "-h") == 0 ||
       std::strcmp(argv[1], "--help") == 0) {
     std::cerr << "Usage: " << argv[0] << " "
-              << " <filename>.spef\n";
+              << " <filename>.spef\n"
+              << "       " << argv[0] << " --reduce <filename>.spef\n"
+              << "       " << argv[0] << " --moments <k> <filename>.spef\n"
+              << "       " << argv[0] << " --index <filename>.spef\n"
+              << "       " << argv[0] << " --query <filename>.spef <net>...\n"
+              << "       " << argv[0] << " --summary <filename>.spef\n"
+              << "       " << argv[0]
+              << " --diff [--cap-tol <rel>] [--res-tol <rel>] <a>.spef "
+                 "<b>.spef\n"
+              << "       " << argv[0] << " --merge <shard>.spef...\n"
+              << "       " << argv[0] << " --name-map <filename>.spef\n"
+              << "       " << argv[0] << " --expand <filename>.spef\n"
+              << "       " << argv[0] << " --normalize <filename>.spef\n"
+              << "       " << argv[0]
+              << " --coupling <filename>.spef <net>...\n"
+              << "       " << argv[0]
+              << " --noise [--top <n>] [--slew <t>] <filename>.spef\n"
+              << "       " << argv[0]
+              << " --extract <filename>.spef [-e <regex>] <net>...\n"
+              << "       " << argv[0]
+              << " --shard <n> [--by bytes|elements] <filename>.spef "
+                 "<prefix>\n"
+              << "       " << argv[0] << " --stats [--json] <filename>.spef\n"
+              << "       " << argv[0]
+              << " --variation <samples> <filename>.spef\n"
+              << "       " << argv[0]
+              << " --corner min|typ|max <filename>.spef\n"
+              << "       " << argv[0] << " --delays <filename>.spef\n"
+              << "       " << argv[0] << " --count-rules <filename>.spef...\n"
+              << "       " << argv[0]
+              << " --profile-grammar [--top <n>] <filename>.spef\n"
+              << "       " << argv[0] << " --recover <filename>.spef\n"
+              << "       " << argv[0]
+              << " --scan [--stream] [--newlines] <filename>.spef\n"
+              << "       " << argv[0]
+              << " --compact [--write] <filename>.spef\n"
+              << "       " << argv[0]
+              << " --pins <filename>.spef [<instance>|<pin>]...\n";
     return 1;
   }
 
+  if (argc == 3 && std::strcmp(argv[1], "--index") == 0) {
+    fs::path const spef_file{argv[2]};
+    NetIndex index;
+    try {
+      index = build_net_index(spef_file);
+      write_net_index(index, net_index_path(spef_file));
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Indexing failed\n";
+      return 2;
+    }
+    std::cerr << "Indexed " << index.m_nets.size() << " nets in "
+              << net_index_path(spef_file).string() << '\n';
+    return 0;
+  }
+
+  if (argc >= 4 && std::strcmp(argv[1], "--query") == 0) {
+    int ret = 0;
+    try {
+      SPEFNetReader reader(argv[2]);
+      for (int arg = 3; arg < argc; ++arg) {
+        auto const *entry = reader.find(argv[arg]);
+        if (entry == nullptr) {
+          std::cerr << "Net " << argv[arg] << " not found\n";
+          ret = 1;
+        } else if (entry->m_type == NetType::Detailed) {
+          std::cout << *reader.get_d_net(argv[arg]);
+        } else {
+          std::cout << *reader.get_r_net(argv[arg]);
+        }
+      }
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Parsing failed\n";
+      return 2;
+    }
+    return ret;
+  }
+
+  if (argc == 3 && std::strcmp(argv[1], "--summary") == 0) {
+    // only the first line of every D_NET is parsed
+    BS::thread_pool pool;
+    std::optional<LazySPEF> loaded;
+    try {
+      loaded.emplace(argv[2], pool);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Parsing failed\n";
+      return 2;
+    }
+    LazySPEF const &spef = *loaded;
+    cap_t total_cap{};
+    for (auto const &d_net : spef.d_nets()) {
+      fmt::print("{} {}\n", d_net.name(), d_net.total_cap());
+      total_cap += d_net.total_cap();
+    }
+    for (auto const &r_net : spef.header().m_r_nets) {
+      fmt::print("{} {}\n", r_net.m_name, r_net.m_total_cap);
+      total_cap += r_net.m_total_cap;
+    }
+    std::cerr << spef.d_nets().size() << " D_NETs, "
+              << spef.header().m_r_nets.size() << " R_NETs, total cap "
+              << total_cap << '\n';
+    return 0;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--stats") == 0) {
+    bool const json = argc == 4 && std::strcmp(argv[2], "--json") == 0;
+    if (argc != (json ? 4 : 3)) {
+      std::cerr << "Expected one SPEF file\n";
+      return 1;
+    }
+    BS::thread_pool pool;
+    SPEFStats stats;
+    try {
+      stats = compute_stats(argv[argc - 1], pool);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Parsing failed\n";
+      return 2;
+    }
+    if (json) {
+      write_stats_json(std::cout, stats);
+    } else {
+      write_stats_text(std::cout, stats);
+    }
+    return 0;
+  }
+
+  if (argc >= 4 && std::strcmp(argv[1], "--diff") == 0) {
+    DiffOptions options;
+    int arg = 2;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+      std::string_view const value_sv{argv[arg + 1]};
+      double value{};
+      auto const [_, ec] =
+          std::from_chars(value_sv.begin(), value_sv.end(), value);
+      handle_from_chars(ec, value_sv);
+      if (std::strcmp(argv[arg], "--cap-tol") == 0) {
+        options.m_cap_tol = value;
+      } else if (std::strcmp(argv[arg], "--res-tol") == 0) {
+        options.m_res_tol = value;
+      } else {
+        std::cerr << "Unknown option " << argv[arg] << '\n';
+        return 1;
+      }
+    }
+    if (argc - arg != 2) {
+      std::cerr << "Expected two SPEF files\n";
+      return 1;
+    }
+
+    // parse both files at the same time
+    SPEF lhs;
+    SPEF rhs;
+    BS::thread_pool pool;
+    auto lhs_parsed = pool.submit(
+        [&lhs, file = argv[arg]] { return parse_spef_file(file, lhs); });
+    bool const rhs_parsed = parse_spef_file(argv[arg + 1], rhs);
+    if (!lhs_parsed.get() || !rhs_parsed) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+
+    auto const diffs = diff_spef(lhs, rhs, options, pool);
+    std::size_t num_added = 0;
+    std::size_t num_removed = 0;
+    for (auto const &diff : diffs) {
+      switch (diff.m_type) {
+      case NetDiffType::Added:
+        fmt::print("+ {}\n", diff.m_name);
+        ++num_added;
+        break;
+      case NetDiffType::Removed:
+        fmt::print("- {}\n", diff.m_name);
+        ++num_removed;
+        break;
+      case NetDiffType::Changed:
+        fmt::print("~ {}", diff.m_name);
+        for (auto const section : diff.m_sections) {
+          fmt::print(" {}", section);
+        }
+        fmt::print("\n");
+        break;
+      }
+    }
+    std::cerr << num_added << " added, " << num_removed << " removed, "
+              << diffs.size() - num_added - num_removed << " changed\n";
+    return diffs.empty() ? 0 : 1;
+  }
+
+  if (argc >= 4 && std::strcmp(argv[1], "--extract") == 0) {
+    NetSelector selector;
+    for (int arg = 3; arg < argc; ++arg) {
+      if (std::strcmp(argv[arg], "-e") == 0 && arg + 1 < argc) {
+        selector.add_pattern(argv[++arg]);
+      } else {
+        selector.add_name(argv[arg]);
+      }
+    }
+    BS::thread_pool pool;
+    std::size_t num_nets{};
+    try {
+      num_nets = extract_nets(argv[2], selector, std::cout, pool);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Extraction failed\n";
+      return 2;
+    }
+    std::cerr << num_nets << " nets extracted\n";
+    return num_nets == 0 ? 1 : 0;
+  }
+
+  if (argc >= 5 && std::strcmp(argv[1], "--shard") == 0) {
+    std::size_t num_shards{};
+    std::string_view num_shards_sv{argv[2]};
+    auto const [_, ec] =
+        std::from_chars(num_shards_sv.begin(), num_shards_sv.end(), num_shards);
+    handle_from_chars(ec, num_shards_sv);
+
+    ShardBalance balance = ShardBalance::Bytes;
+    int arg = 3;
+    if (std::strcmp(argv[arg], "--by") == 0 && arg + 1 < argc) {
+      if (std::strcmp(argv[arg + 1], "elements") == 0) {
+        balance = ShardBalance::Elements;
+      } else if (std::strcmp(argv[arg + 1], "bytes") != 0) {
+        std::cerr << "Unknown balance " << argv[arg + 1] << '\n';
+        return 1;
+      }
+      arg += 2;
+    }
+    if (argc - arg != 2) {
+      std::cerr << "Expected a SPEF file and a prefix\n";
+      return 1;
+    }
+
+    BS::thread_pool pool;
+    std::vector<ShardInfo> shards;
+    try {
+      shards = shard_spef_file(
+          argv[arg],
+          argv[arg + 1],
+          num_shards,
+          balance,
+          pool);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Sharding failed\n";
+      return 2;
+    }
+    for (auto const &shard : shards) {
+      fmt::print(
+          "{} {} {}\n",
+          shard.m_file.string(),
+          shard.m_num_nets,
+          shard.m_weight);
+    }
+    return 0;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--merge") == 0) {
+    std::vector<fs::path> const shard_files(argv + 2, argv + argc);
+    BS::thread_pool pool;
+    MergeStats stats;
+    try {
+      stats = merge_spef_files(shard_files, std::cout, pool);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Merging failed\n";
+      return 2;
+    }
+    std::cerr << "Merged " << stats.m_num_d_nets << " D_NETs and "
+              << stats.m_num_r_nets << " R_NETs with " << stats.m_num_names
+              << " names\n";
+    return 0;
+  }
+
+  if (argc == 3 && std::strcmp(argv[1], "--name-map") == 0) {
+    SPEF spef;
+    if (!parse_spef_file(argv[2], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    build_name_map(spef, pool);
+    std::cout << spef;
+    return 0;
+  }
+
+  if (argc == 3 && std::strcmp(argv[1], "--expand") == 0) {
+    SPEF spef;
+    if (!parse_spef_file(argv[2], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    expand_name_map(spef, pool);
+    std::cout << spef;
+    return 0;
+  }
+
+  if (argc == 3 && std::strcmp(argv[1], "--normalize") == 0) {
+    SPEF spef;
+    if (!parse_spef_file(argv[2], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    normalize_units(spef, pool);
+    std::cout << spef;
+    return 0;
+  }
+
+  if (argc >= 4 && std::strcmp(argv[1], "--coupling") == 0) {
+    SPEF spef;
+    if (!parse_spef_file(argv[2], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    NodeNetMap const node_nets(spef);
+    auto const graph = build_coupling_graph(spef, pool);
+    if (graph.m_num_unresolved != 0) {
+      std::cerr << graph.m_num_unresolved
+                << " coupling caps to unknown nets were ignored\n";
+    }
+    int ret = 0;
+    for (int arg = 3; arg < argc; ++arg) {
+      auto const net = node_nets.find_net(argv[arg]);
+      if (net == NodeNetMap::NO_NET) {
+        std::cerr << "Net " << argv[arg] << " not found\n";
+        ret = 1;
+        continue;
+      }
+      // the strongest aggressors first
+      std::vector<std::pair<cap_t, std::uint32_t>> neighbors;
+      graph.for_each_neighbor(net, [&](std::uint32_t other, cap_t cap) {
+        neighbors.emplace_back(cap, other);
+      });
+      std::sort(neighbors.rbegin(), neighbors.rend());
+      for (auto const &[cap, other] : neighbors) {
+        fmt::print("{} {} {}\n", graph.m_names[net], graph.m_names[other], cap);
+      }
+    }
+    return ret;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--noise") == 0) {
+    NoiseOptions options;
+    int arg = 2;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+      std::string_view const value_sv{argv[arg + 1]};
+      if (std::strcmp(argv[arg], "--top") == 0) {
+        auto const [_, ec] =
+            std::from_chars(value_sv.begin(), value_sv.end(), options.m_top);
+        handle_from_chars(ec, value_sv);
+      } else if (std::strcmp(argv[arg], "--slew") == 0) {
+        auto const [_, ec] =
+            std::from_chars(value_sv.begin(), value_sv.end(), options.m_slew);
+        handle_from_chars(ec, value_sv);
+      } else {
+        std::cerr << "Unknown option " << argv[arg] << '\n';
+        return 1;
+      }
+    }
+    if (argc - arg != 1) {
+      std::cerr << "Expected one SPEF file\n";
+      return 1;
+    }
+
+    SPEF spef;
+    if (!parse_spef_file(argv[arg], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    for (auto const &victim : estimate_noise(spef, options, pool)) {
+      fmt::print(
+          "{} {} {} {}\n",
+          spef.m_d_nets[victim.m_net].m_name,
+          victim.m_glitch,
+          victim.m_coupling_cap,
+          victim.m_total_cap);
+    }
+    return 0;
+  }
+
+  if (argc == 4 && std::strcmp(argv[1], "--variation") == 0) {
+    std::size_t num_samples{};
+    std::string_view num_samples_sv{argv[2]};
+    try {
+      auto const [_, ec] = std::from_chars(
+          num_samples_sv.begin(),
+          num_samples_sv.end(),
+          num_samples);
+      handle_from_chars(ec, num_samples_sv);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n'
+                << "Expected the number of samples\n";
+      return 1;
+    }
+
+    SPEF spef;
+    if (!parse_spef_file(argv[3], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    auto const samples = draw_parameter_samples(spef, num_samples);
+    std::vector<NetVariation> variations;
+    try {
+      check_sensitivity_params(spef);
+      variations = sweep_variation(spef, samples, pool);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n';
+      return 2;
+    }
+    for (std::size_t idx = 0; idx < variations.size(); ++idx) {
+      auto const &var = variations[idx];
+      fmt::print(
+          "{} {} {} {} {} {} {}\n",
+          spef.m_d_nets[idx].m_name,
+          var.m_nominal_cap,
+          var.m_mean_cap,
+          var.m_sigma_cap,
+          var.m_nominal_res,
+          var.m_mean_res,
+          var.m_sigma_res);
+    }
+    std::cerr << samples.num_params() << " process parameters, "
+              << num_samples << " samples\n";
+    return 0;
+  }
+
+  if (argc == 4 && std::strcmp(argv[1], "--corner") == 0) {
+    Corner corner{};
+    try {
+      corner = convert_corner(argv[2]);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n'
+                << "Usage: " << argv[0]
+                << " --corner min|typ|max <filename>.spef\n";
+      return 1;
+    }
+    SPEF spef;
+    if (!parse_spef_file(argv[3], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    select_corner(spef, corner, pool);
+    std::cout << spef;
+    return 0;
+  }
+
+  if (argc == 3 && std::strcmp(argv[1], "--delays") == 0) {
+    SPEF spef;
+    if (!parse_spef_file(argv[2], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    auto const delays = compute_load_delays(spef, pool);
+    for (std::size_t net = 0; net < spef.m_r_nets.size(); ++net) {
+      auto const &r_net = spef.m_r_nets[net];
+      for (std::size_t load = 0; load < r_net.m_loads.size(); ++load) {
+        fmt::print(
+            "{} {} {}\n",
+            r_net.m_name,
+            r_net.m_loads[load].m_pin,
+            delays.delay(net, load));
+      }
+    }
+    return 0;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--count-rules") == 0) {
+    // the rules tried by the parser, to measure the cost of backtracking
+    RuleCounts total;
+    for (int arg = 2; arg < argc; ++arg) {
+      RuleCounts counts;
+      try {
+        counts = count_rules(argv[arg]);
+      } catch (std::exception const &err) {
+        std::cerr << err.what() << '\n' << "Parsing failed\n";
+        return 2;
+      }
+      fmt::print("{} {} {}\n", argv[arg], counts.m_starts, counts.m_failures);
+      total.m_starts += counts.m_starts;
+      total.m_failures += counts.m_failures;
+    }
+    fmt::print("total {} {}\n", total.m_starts, total.m_failures);
+    return 0;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--profile-grammar") == 0) {
+    std::size_t top = 20;
+    int arg = 2;
+    if (arg + 1 < argc && std::strcmp(argv[arg], "--top") == 0) {
+      std::string_view const top_sv{argv[arg + 1]};
+      auto const [_, ec] = std::from_chars(top_sv.begin(), top_sv.end(), top);
+      handle_from_chars(ec, top_sv);
+      arg += 2;
+    }
+    if (argc - arg != 1) {
+      std::cerr << "Expected one SPEF file\n";
+      return 1;
+    }
+    GrammarProfile profile;
+    try {
+      profile = profile_grammar(argv[arg]);
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Parsing failed\n";
+      return 2;
+    }
+    write_rule_profiles(std::cout, profile.m_rules, top);
+    if (!profile.m_error.empty()) {
+      std::cerr << profile.m_error << '\n' << "Parsing failed\n";
+      return 2;
+    }
+    return 0;
+  }
+
+  if (argc == 3 && std::strcmp(argv[1], "--recover") == 0) {
+    // all the errors of the file, skipping the nets that have errors
+    SPEF spef;
+    BS::thread_pool pool;
+    std::vector<SPEFParseError> errors;
+    try {
+      errors = parse_spef_recovering(argv[2], spef, pool);
+    } catch (std::exception const &err) {
+      // the file couldn't be read at all
+      std::cerr << err.what() << '\n' << "Parsing failed\n";
+      return 2;
+    }
+    for (auto const &error : errors) {
+      fmt::print(
+          "{}:{}:{}: {}{}{}\n",
+          argv[2],
+          error.m_line,
+          error.m_column,
+          error.m_net,
+          error.m_net.empty() ? "" : ": ",
+          error.m_message);
+    }
+    fmt::print(
+        "{} D_NETs, {} R_NETs, {} errors\n",
+        spef.m_d_nets.size(),
+        spef.m_r_nets.size(),
+        errors.size());
+    return errors.empty() ? 0 : 1;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--scan") == 0) {
+    // the keywords and the nets of the file, found without the grammar
+    bool stream = false;
+    bool newlines = false;
+    int arg = 2;
+    for (; arg + 1 < argc; ++arg) {
+      if (std::strcmp(argv[arg], "--stream") == 0) {
+        stream = true;
+      } else if (std::strcmp(argv[arg], "--newlines") == 0) {
+        newlines = true;
+      } else {
+        std::cerr << "Unknown option " << argv[arg] << '\n';
+        return 1;
+      }
+    }
+    auto const start = std::chrono::steady_clock::now();
+    StructuralIndex index;
+    try {
+      if (stream) {
+        index = scan_file_structure(
+            argv[arg],
+            2,
+            std::thread::hardware_concurrency(),
+            16 * 1024 * 1024,
+            newlines);
+      } else {
+        pegtl::mmap_input<> const input{argv[arg]};
+        BS::thread_pool pool;
+        index = scan_structure(input.begin(), input.size(), pool, newlines);
+      }
+    } catch (std::exception const &err) {
+      std::cerr << err.what() << '\n' << "Scanning failed\n";
+      return 2;
+    }
+    std::chrono::duration<double> const time =
+        std::chrono::steady_clock::now() - start;
+
+    std::size_t num_terminated = 0;
+    for (auto const &net : index.m_nets) {
+      num_terminated += net.m_terminated ? 1 : 0;
+    }
+    fmt::print("{} bytes, {} keywords", index.m_size, index.m_keywords.size());
+    if (newlines) {
+      fmt::print(", {} newlines", index.m_newlines.size());
+    }
+    fmt::print(
+        ", {} nets, {} without *END\n",
+        index.m_nets.size(),
+        index.m_nets.size() - num_terminated);
+    fmt::print(
+        "{:.3f} s, {:.2f} GB/s\n",
+        time.count(),
+        static_cast<double>(index.m_size) / time.count() / 1e9);
+    return 0;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--compact") == 0) {
+    // the *CAP and *RES nodes as numeric ids
+    bool const write = argc == 4 && std::strcmp(argv[2], "--write") == 0;
+    if (argc != (write ? 4 : 3)) {
+      std::cerr << "Expected one SPEF file\n";
+      return 1;
+    }
+    // every net is compacted at its *END, so the node strings of the whole
+    // file are never alive at once
+    SPEF spef;
+    ParasiticsCompactor compactor;
+    if (!parse_spef_file(
+            argv[argc - 1],
+            spef,
+            [&compactor](SPEF const &parsed, DNet &d_net) {
+              compactor.add(parsed, d_net);
+            })) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    auto const &compact = compactor.compact();
+    if (write) {
+      // the names of every net are re-created only while it is written
+      auto d_nets = std::move(spef.m_d_nets);
+      auto r_nets = std::move(spef.m_r_nets);
+      spef.m_d_nets.clear();
+      spef.m_r_nets.clear();
+      std::cout << spef;
+      with_node_name_splitter(spef, [&](auto splitter) {
+        for (std::size_t idx = 0; idx < d_nets.size(); ++idx) {
+          restore_parasitics(compact, idx, d_nets[idx]);
+          write_d_net<decltype(splitter)>(
+              std::cout,
+              d_nets[idx],
+              spef.m_d_net_variations.net(idx));
+          d_nets[idx] = {};
+        }
+      });
+      for (auto const &r_net : r_nets) {
+        std::cout << r_net;
+      }
+      std::cout << '\n';
+      return 0;
+    }
+
+    auto const num_elements =
+        static_cast<double>(std::max<std::size_t>(1, compact.num_elements()));
+    auto const &tables = compact.m_tables;
+    fmt::print(
+        "{} D_NETs, {} elements, {} instances, {} pins, {} other nodes\n",
+        compact.num_nets(),
+        compact.num_elements(),
+        tables.m_instances.size(),
+        tables.m_pins.size(),
+        tables.m_externals.size());
+    fmt::print(
+        "strings: {} bytes, {:.1f} bytes per element\n",
+        compactor.string_memory(),
+        static_cast<double>(compactor.string_memory()) / num_elements);
+    fmt::print(
+        "ids:     {} bytes, {:.1f} bytes per element\n",
+        compact.memory(),
+        static_cast<double>(compact.memory()) / num_elements);
+    return 0;
+  }
+
+  if (argc >= 3 && std::strcmp(argv[1], "--pins") == 0) {
+    // the instance pins of the design, or the nets of the given instances and
+    // pins
+    SPEF spef;
+    if (!parse_spef_file(argv[2], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    // the pins are looked up by their names
+    expand_name_map(spef, pool);
+    auto const db = build_pin_database(spef, pool);
+    char const pin_delim = pin_delimiter(spef);
+    auto const print_pin = [&](std::uint32_t pin) {
+      fmt::print(
+          "{}{}{} {} {}\n",
+          db.m_instances[db.instance_of(pin)],
+          pin_delim,
+          db.m_pin_names[pin],
+          spef.m_d_nets[db.m_pin_nets[pin]].m_name,
+          get_direction_type_sv(db.m_pin_directions[pin]));
+    };
+
+    if (argc == 3) {
+      std::array<std::size_t, 3> num_roles{};
+      for (std::uint32_t pin = 0; pin < db.num_pins(); ++pin) {
+        ++num_roles[static_cast<std::size_t>(db.role(pin))];
+      }
+      std::size_t num_undriven = 0;
+      for (std::uint32_t net = 0; net < spef.m_d_nets.size(); ++net) {
+        std::size_t num_drivers = 0;
+        db.for_each_driver(net, [&](std::uint32_t) { ++num_drivers; });
+        num_undriven += num_drivers == 0 ? 1 : 0;
+      }
+      fmt::print(
+          "{} instances, {} pins: {} drivers, {} loads, {} bidirectional\n",
+          db.num_instances(),
+          db.num_pins(),
+          num_roles[static_cast<std::size_t>(PinRole::Driver)],
+          num_roles[static_cast<std::size_t>(PinRole::Load)],
+          num_roles[static_cast<std::size_t>(PinRole::Both)]);
+      fmt::print("{} D_NETs without a driver pin\n", num_undriven);
+      if (db.m_num_unsplit != 0) {
+        std::cerr << db.m_num_unsplit
+                  << " *I entries without a pin delimiter were ignored\n";
+      }
+      return 0;
+    }
+
+    int ret = 0;
+    for (int arg = 3; arg < argc; ++arg) {
+      if (auto const pin = db.find_pin(argv[arg]);
+          pin != PinDatabase::NOT_FOUND) {
+        print_pin(pin);
+      } else if (auto const instance = db.find_instance(argv[arg]);
+                 instance != PinDatabase::NOT_FOUND) {
+        db.for_each_pin(instance, print_pin);
+      } else {
+        std::cerr << "Pin or instance " << argv[arg] << " not found\n";
+        ret = 1;
+      }
+    }
+    return ret;
+  }
+
+  if (argc == 3 && std::strcmp(argv[1], "--reduce") == 0) {
+    SPEF spef;
+    if (!parse_spef_file(argv[2], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    reduce_spef(spef);
+    std::cout << spef;
+    return 0;
+  }
+
+  if (argc == 4 && std::strcmp(argv[1], "--moments") == 0) {
+    std::size_t num_moments{};
+    std::string_view num_moments_sv{argv[2]};
+    auto const [_, ec] = std::from_chars(
+        num_moments_sv.begin(),
+        num_moments_sv.end(),
+        num_moments);
+    handle_from_chars(ec, num_moments_sv);
+    if (num_moments == 0 || num_moments > MAX_MOMENTS) {
+      std::cerr << "The number of moments must be between 1 and "
+                << MAX_MOMENTS << '\n';
+      return 1;
+    }
+
+    SPEF spef;
+    if (!parse_spef_file(argv[3], spef)) {
+      std::cerr << "Parsing failed\n";
+      return 2;
+    }
+    BS::thread_pool pool;
+    auto const moments = compute_load_moments(
+        spef,
+        num_moments,
+        rc_to_time_factor(spef),
+        pool);
+    for (std::size_t idx = 0; idx < moments.size(); ++idx) {
+      for (auto const &load : moments[idx].m_loads) {
+        fmt::print("{} {}", spef.m_d_nets[idx].m_name, load.m_pin);
+        for (std::size_t k = 0; k < num_moments; ++k) {
+          fmt::print(" {}", load.m_moments[k]);
+        }
+        fmt::print("\n");
+      }
+    }
+    return 0;
+  }
+
   if (argc == 3 && std::strcmp(argv[1], "--random") == 0) {
     std::size_t num_random{};
     std::string_view num_random_sv{argv[2]};
@@ -66,42 +909,12 @@ int main(int argc, char const *const *argv) {
 
   std::filesystem::path const spef_file{argv[1]};
 
-  bool success = false;
-
-  // outer try/catch for normal exceptions that might occur for example if the
-  // file is not found
-  try {
-    pegtl::read_input input{spef_file};
-
-    // inner try/catch for the parser exceptions
-    try {
-      //pegtl::tracer<pegtl::tracer_traits<>> tracer(input);
-      //tracer.parse<spef_grammar>(input);
-      SPEF spef;
-      SPEFHelper spef_h;
-      success = pegtl::parse<pegtl::must<spef_grammar>, spef_action>(
-          input,
-          spef,
-          spef_h);
-
-      std::cout << spef;
-    } catch (pegtl::parse_error &err) {
-      std::cerr << "ERROR: An exception occurred during parsing:\n";
-      // this catch block needs access to the input
-      auto const &pos = err.positions().front();
-      std::cerr << err.what() << '\n'
-                << input.line_at(pos) << '\n'
-                << std::setw((int)pos.column) << '^' << std::endl;
-      std::cerr << err.what() << '\n';
-    }
-  } catch (std::exception const &e) {
-    std::cerr << e.what() << std::endl;
-  }
-
-  if (!success) {
+  SPEF spef;
+  if (!parse_spef_file(spef_file, spef)) {
     std::cerr << "Parsing failed\n";
     return 2;
   }
+  std::cout << spef;
 
   return 0;
 }
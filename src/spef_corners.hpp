@@ -0,0 +1,115 @@
+#ifndef SPEF_CORNERS_HPP
+#define SPEF_CORNERS_HPP
+
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+/// Converts min, typ or max to a Corner
+inline Corner convert_corner(std::string_view corner_sv) {
+  if (corner_sv == "min") {
+    return Corner::Min;
+  }
+  if (corner_sv == "typ") {
+    return Corner::Typ;
+  }
+  if (corner_sv == "max") {
+    return Corner::Max;
+  }
+  throw std::runtime_error(fmt::format("Unknown corner: {}", corner_sv));
+}
+
+namespace detail {
+template<typename T, typename Elem>
+void select_corner(
+    std::vector<Elem> &elems,
+    T Elem::*value,
+    CornerValuesView<T> const &corners,
+    Corner corner) {
+  if (corners.empty()) {
+    return;
+  }
+  auto const values = corners[corner];
+  for (std::size_t idx = 0; idx < elems.size(); ++idx) {
+    elems[idx].*value = values[idx];
+  }
+}
+
+template<typename T>
+void select_corner(
+    std::vector<T> &values,
+    CornerValues<T> &corners,
+    Corner corner) {
+  if (!corners.empty()) {
+    auto const selected = corners[corner];
+    values.assign(selected.begin(), selected.end());
+    corners = {};
+  }
+}
+}  // namespace detail
+
+/// Sets the total caps and the values of the caps and the resistors of every
+/// D_NET to their values at the given corner, in parallel, and likewise the
+/// total caps, the pi models, the *RC values, the poles and the residues of
+/// the R_NETs. The corners are dropped, so that the SPEF can be analyzed and
+/// written as a single-corner one
+inline void select_corner(SPEF &spef, Corner corner, BS::thread_pool &pool) {
+  auto &variations = spef.m_d_net_variations;
+  pool.parallelize_loop(
+          spef.m_d_nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              DNet &d_net = spef.m_d_nets[idx];
+              detail::select_corner(
+                  d_net.m_ground_caps,
+                  &DNet::GroundCapacitance::m_cap,
+                  variations.m_ground_cap_corners.net(idx),
+                  corner);
+              detail::select_corner(
+                  d_net.m_coupling_caps,
+                  &DNet::CouplingCapacitance::m_cap,
+                  variations.m_coupling_cap_corners.net(idx),
+                  corner);
+              detail::select_corner(
+                  d_net.m_resistances,
+                  &DNet::Resistance::m_res,
+                  variations.m_res_corners.net(idx),
+                  corner);
+              auto const total_caps = variations.m_total_cap_corners.net(idx);
+              if (!total_caps.empty()) {
+                d_net.m_total_cap = total_caps[corner][0];
+              }
+            }
+          })
+      .wait();
+  variations.m_ground_cap_corners = {};
+  variations.m_coupling_cap_corners = {};
+  variations.m_res_corners = {};
+  variations.m_total_cap_corners = {};
+
+  for (auto &r_net : spef.m_r_nets) {
+    if (r_net.m_total_cap_corners) {
+      r_net.m_total_cap =
+          (*r_net.m_total_cap_corners)[static_cast<std::size_t>(corner)];
+      r_net.m_total_cap_corners.reset();
+    }
+    if (r_net.m_pi_model_corners) {
+      r_net.m_pi_model =
+          (*r_net.m_pi_model_corners)[static_cast<std::size_t>(corner)];
+      r_net.m_pi_model_corners.reset();
+    }
+    detail::select_corner(
+        r_net.m_loads,
+        &RNet::Load::m_rc,
+        r_net.m_rc_corners.view(),
+        corner);
+    r_net.m_rc_corners = {};
+    detail::select_corner(r_net.m_poles, r_net.m_pole_corners, corner);
+    detail::select_corner(r_net.m_residues, r_net.m_residue_corners, corner);
+  }
+}
+
+#endif  // SPEF_CORNERS_HPP
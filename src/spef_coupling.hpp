@@ -0,0 +1,274 @@
+#ifndef SPEF_COUPLING_HPP
+#define SPEF_COUPLING_HPP
+
+#include "spef_name_map.hpp"
+#include "spef_node_name.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// Finds the D_NET that a node belongs to. A node is either a connection of a
+/// net, like inst:A or a port, which are looked up in a map from the *CONN
+/// entries of all the nets, or an internal node like net:3, whose net is the
+/// part before the pin delimiter. A bare net name is a node of the net.
+class NodeNetMap {
+public:
+  static constexpr std::uint32_t NO_NET = static_cast<std::uint32_t>(-1);
+
+private:
+  // the Splitter::split of the delimiters of the SPEF
+  NodeNameParts (*m_split)(std::string_view);
+  std::unordered_map<std::string_view, std::uint32_t> m_nets;
+  std::unordered_map<std::string_view, std::uint32_t> m_conns;
+
+public:
+  /// The maps point into the strings of the SPEF, which must outlive them
+  explicit NodeNetMap(SPEF const &spef)
+      : m_split(with_node_name_splitter(spef, [](auto splitter) {
+          return &decltype(splitter)::split;
+        })) {
+    std::size_t num_conns = 0;
+    for (auto const &d_net : spef.m_d_nets) {
+      num_conns += d_net.m_conns.size();
+    }
+    m_nets.reserve(spef.m_d_nets.size());
+    m_conns.reserve(num_conns);
+    for (std::uint32_t idx = 0; idx < spef.m_d_nets.size(); ++idx) {
+      auto const &d_net = spef.m_d_nets[idx];
+      m_nets.emplace(d_net.m_name, idx);
+      for (auto const &conn : d_net.m_conns) {
+        m_conns.emplace(conn.m_name, idx);
+      }
+    }
+  }
+
+  /// Returns the index of the D_NET of the net named name, or NO_NET
+  [[nodiscard]] std::uint32_t find_net(std::string_view name) const {
+    auto const it = m_nets.find(name);
+    return it == m_nets.end() ? NO_NET : it->second;
+  }
+
+  /// Returns the index of the D_NET that the node belongs to, or NO_NET
+  [[nodiscard]] std::uint32_t net_of(std::string_view node) const {
+    if (auto const it = m_conns.find(node); it != m_conns.end()) {
+      return it->second;
+    }
+    return find_net(m_split(node).m_owner);
+  }
+};
+
+/// The nets that every D_NET couples to, as a graph in compressed sparse row
+/// form: the neighbours of net n are at [m_offsets[n], m_offsets[n + 1]) of
+/// m_neighbors and m_caps, sorted by neighbour. The nets are numbered as in
+/// SPEF::m_d_nets, and all the coupling caps between a pair of nets in a *CAP
+/// section are summed. The graph is symmetric: a coupling cap may be listed
+/// by both nets or by only one of them, so a pair listed by one net is added
+/// to the other, and a pair listed by both has the larger of the two sums, as
+/// they are the same caps seen from either side.
+struct CouplingGraph {
+  std::vector<std::string_view> m_names;  // points into the D_NET strings
+  std::vector<std::size_t> m_offsets;
+  std::vector<std::uint32_t> m_neighbors;
+  std::vector<cap_t> m_caps;
+  std::size_t m_num_unresolved{};  // coupling caps to unknown nets
+
+  [[nodiscard]] std::size_t size() const { return m_names.size(); }
+
+  [[nodiscard]] std::size_t degree(std::uint32_t net) const {
+    return m_offsets[net + 1] - m_offsets[net];
+  }
+
+  /// Calls fn(neighbor, cap) for every net that the net couples to
+  template<typename Fn>
+  void for_each_neighbor(std::uint32_t net, Fn const &fn) const {
+    for (std::size_t idx = m_offsets[net]; idx < m_offsets[net + 1]; ++idx) {
+      fn(m_neighbors[idx], m_caps[idx]);
+    }
+  }
+
+  /// Returns the coupling cap between the two nets, found by binary search
+  [[nodiscard]] cap_t coupling(std::uint32_t net, std::uint32_t other) const {
+    auto const first = m_neighbors.begin() + m_offsets[net];
+    auto const last = m_neighbors.begin() + m_offsets[net + 1];
+    auto const it = std::lower_bound(first, last, other);
+    return it != last && *it == other ? m_caps[it - m_neighbors.begin()] : 0;
+  }
+};
+
+namespace detail {
+/// Frees the memory of the vector, which assigning {} would keep
+template<typename T>
+void free_vector(std::vector<T> &values) {
+  std::vector<T>().swap(values);
+}
+
+/// Returns the couplings of the net, as (neighbour, cap) pairs sorted by
+/// neighbour and summed per neighbour, and the number of coupling caps whose
+/// other node couldn't be resolved
+inline std::pair<std::vector<std::pair<std::uint32_t, cap_t>>, std::size_t>
+net_couplings(
+    DNet const &d_net,
+    std::uint32_t net,
+    NodeNetMap const &node_nets) {
+  std::vector<std::pair<std::uint32_t, cap_t>> couplings;
+  couplings.reserve(d_net.m_coupling_caps.size());
+  std::size_t num_unresolved = 0;
+  for (auto const &coupling_cap : d_net.m_coupling_caps) {
+    // the other node is usually the second one
+    auto other = node_nets.net_of(coupling_cap.m_node2);
+    if (other == net) {
+      other = node_nets.net_of(coupling_cap.m_node1);
+    }
+    if (other == NodeNetMap::NO_NET) {
+      ++num_unresolved;
+    } else if (other != net) {
+      couplings.emplace_back(other, coupling_cap.m_cap);
+    }
+  }
+
+  std::sort(couplings.begin(), couplings.end(), [](auto lhs, auto rhs) {
+    return lhs.first < rhs.first;
+  });
+  std::size_t size = 0;
+  for (auto const &[other, cap] : couplings) {
+    if (size != 0 && couplings[size - 1].first == other) {
+      couplings[size - 1].second += cap;
+    } else {
+      couplings[size++] = {other, cap};
+    }
+  }
+  couplings.resize(size);
+  return {std::move(couplings), num_unresolved};
+}
+}  // namespace detail
+
+/// Builds the coupling graph of the D_NETs of the SPEF. The couplings of every
+/// net are resolved and summed in parallel. They are then symmetrized: every
+/// net looks itself up in the sorted couplings of its neighbours in parallel,
+/// and the pairs that only it lists are scattered to the neighbours. Finally
+/// the couplings are copied to their place in the graph in parallel, after a
+/// prefix sum of the degrees. Every net is written by a single task, so no
+/// locks are needed.
+inline CouplingGraph
+build_coupling_graph(SPEF const &spef, BS::thread_pool &pool) {
+  NodeNetMap const node_nets(spef);
+  std::size_t const num_nets = spef.m_d_nets.size();
+
+  std::vector<std::vector<std::pair<std::uint32_t, cap_t>>> couplings(
+      num_nets);
+  std::vector<std::size_t> num_unresolved(num_nets);
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              std::tie(couplings[idx], num_unresolved[idx]) =
+                  detail::net_couplings(
+                      spef.m_d_nets[idx],
+                      static_cast<std::uint32_t>(idx),
+                      node_nets);
+            }
+          })
+      .wait();
+
+  // the couplings are only read here, so the larger caps and the pairs
+  // missing from the neighbours are collected on the side
+  auto const by_net = [](auto lhs, auto rhs) { return lhs.first < rhs.first; };
+  std::vector<std::vector<cap_t>> symmetric_caps(num_nets);
+  std::vector<std::vector<std::pair<std::uint32_t, cap_t>>> one_sided(
+      num_nets);
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto const net = static_cast<std::uint32_t>(idx);
+              symmetric_caps[idx].reserve(couplings[idx].size());
+              for (auto const &[other, cap] : couplings[idx]) {
+                auto const &reverse = couplings[other];
+                auto const it = std::lower_bound(
+                    reverse.begin(),
+                    reverse.end(),
+                    std::pair<std::uint32_t, cap_t>(net, 0),
+                    by_net);
+                if (it != reverse.end() && it->first == net) {
+                  symmetric_caps[idx].push_back(std::max(cap, it->second));
+                } else {
+                  symmetric_caps[idx].push_back(cap);
+                  one_sided[idx].emplace_back(other, cap);
+                }
+              }
+            }
+          })
+      .wait();
+
+  // the nets are visited in increasing order, so the added pairs of every
+  // net are sorted
+  std::vector<std::vector<std::pair<std::uint32_t, cap_t>>> added(num_nets);
+  for (std::size_t idx = 0; idx < num_nets; ++idx) {
+    for (auto const &[other, cap] : one_sided[idx]) {
+      added[other].emplace_back(static_cast<std::uint32_t>(idx), cap);
+    }
+    detail::free_vector(one_sided[idx]);
+  }
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto &pairs = couplings[idx];
+              for (std::size_t pos = 0; pos < pairs.size(); ++pos) {
+                pairs[pos].second = symmetric_caps[idx][pos];
+              }
+              detail::free_vector(symmetric_caps[idx]);
+              if (added[idx].empty()) {
+                continue;
+              }
+              auto const middle = static_cast<std::ptrdiff_t>(
+                  pairs.size());
+              pairs.insert(
+                  pairs.end(),
+                  added[idx].begin(),
+                  added[idx].end());
+              std::inplace_merge(
+                  pairs.begin(),
+                  pairs.begin() + middle,
+                  pairs.end(),
+                  by_net);
+              detail::free_vector(added[idx]);
+            }
+          })
+      .wait();
+
+  CouplingGraph graph;
+  graph.m_names.reserve(num_nets);
+  graph.m_offsets.resize(num_nets + 1);
+  for (std::size_t idx = 0; idx < num_nets; ++idx) {
+    graph.m_names.push_back(spef.m_d_nets[idx].m_name);
+    graph.m_offsets[idx + 1] = graph.m_offsets[idx] + couplings[idx].size();
+    graph.m_num_unresolved += num_unresolved[idx];
+  }
+  graph.m_neighbors.resize(graph.m_offsets[num_nets]);
+  graph.m_caps.resize(graph.m_offsets[num_nets]);
+
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto pos = graph.m_offsets[idx];
+              for (auto const &[other, cap] : couplings[idx]) {
+                graph.m_neighbors[pos] = other;
+                graph.m_caps[pos] = cap;
+                ++pos;
+              }
+              detail::free_vector(couplings[idx]);
+            }
+          })
+      .wait();
+
+  return graph;
+}
+
+#endif  // SPEF_COUPLING_HPP
@@ -0,0 +1,120 @@
+#ifndef SPEF_DELAY_HPP
+#define SPEF_DELAY_HPP
+
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+/// The 50% step-response delays of the loads of all the R_NETs, in T_UNIT. The
+/// delays of the loads of net n are [m_offsets[n], m_offsets[n + 1]) of
+/// m_delays, in the order of RNet::m_loads.
+struct LoadDelays {
+  std::vector<std::size_t> m_offsets;
+  std::vector<double> m_delays;
+
+  [[nodiscard]] double delay(std::size_t net, std::size_t load) const {
+    return m_delays[m_offsets[net] + load];
+  }
+};
+
+namespace detail {
+/// The step response of a load with the given poles and residues at time t.
+/// The transfer function is sum(k_i / (s - p_i)), so the response is
+/// sum(k_i / p_i * (exp(p_i * t) - 1)), which is real for conjugate pairs.
+inline double step_response(
+    std::complex<double> const *poles,
+    std::complex<double> const *residues,
+    std::size_t num_poles,
+    double t) {
+  std::complex<double> response{};
+  for (std::size_t idx = 0; idx < num_poles; ++idx) {
+    response += residues[idx] / poles[idx] * (std::exp(poles[idx] * t) - 1.0);
+  }
+  return response.real();
+}
+}  // namespace detail
+
+/// Returns the time at which the step response of the load crosses 50% of its
+/// final value. The crossing is bracketed by doubling from the slowest time
+/// constant and then found by bisection, which finds the only crossing of the
+/// monotonic response of an RC network. Loads without poles, and loads whose
+/// poles aren't all stable, fall back to ln(2) times their Elmore delay.
+inline double step_delay(
+    std::complex<double> const *poles,
+    std::complex<double> const *residues,
+    std::size_t num_poles,
+    double elmore) {
+  double const fallback = std::log(2.0) * elmore;
+  double slowest = 0;
+  for (std::size_t idx = 0; idx < num_poles; ++idx) {
+    if (poles[idx].real() >= 0) {
+      return fallback;
+    }
+    slowest = std::max(slowest, -1.0 / poles[idx].real());
+  }
+  double final_value = 0;
+  for (std::size_t idx = 0; idx < num_poles; ++idx) {
+    final_value -= (residues[idx] / poles[idx]).real();
+  }
+  if (num_poles == 0 || final_value <= 0) {
+    return fallback;
+  }
+
+  auto const response = [&](double t) {
+    return detail::step_response(poles, residues, num_poles, t);
+  };
+  double const half = 0.5 * final_value;
+  double lo = 0;
+  double hi = slowest;
+  for (int iter = 0; iter < 64 && response(hi) < half; ++iter) {
+    lo = hi;
+    hi *= 2;
+  }
+  for (int iter = 0; iter < 100 && hi - lo > 1e-12 * hi; ++iter) {
+    double const mid = 0.5 * (lo + hi);
+    if (response(mid) < half) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return 0.5 * (lo + hi);
+}
+
+/// Computes the step-response delay of every load of every R_NET of the SPEF.
+/// The offsets of the nets are found first, and then every net writes the
+/// delays of its loads to its own range in parallel, so no locks are needed.
+inline LoadDelays compute_load_delays(SPEF const &spef, BS::thread_pool &pool) {
+  std::size_t const num_nets = spef.m_r_nets.size();
+  LoadDelays delays;
+  delays.m_offsets.resize(num_nets + 1);
+  for (std::size_t idx = 0; idx < num_nets; ++idx) {
+    delays.m_offsets[idx + 1] =
+        delays.m_offsets[idx] + spef.m_r_nets[idx].m_loads.size();
+  }
+  delays.m_delays.resize(delays.m_offsets[num_nets]);
+
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto const &r_net = spef.m_r_nets[idx];
+              auto pos = delays.m_offsets[idx];
+              for (auto const &load : r_net.m_loads) {
+                delays.m_delays[pos++] = step_delay(
+                    r_net.m_poles.data() + load.m_first_pole,
+                    r_net.m_residues.data() + load.m_first_pole,
+                    load.m_num_poles,
+                    load.m_rc);
+              }
+            }
+          })
+      .wait();
+  return delays;
+}
+
+#endif  // SPEF_DELAY_HPP
@@ -0,0 +1,647 @@
+#ifndef SPEF_DIFF_HPP
+#define SPEF_DIFF_HPP
+
+#include "spef_name_map.hpp"
+#include "spef_structs.hpp"
+#include "spef_units.hpp"
+#include "spef_write.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Net-level comparison of two SPEF files. Every net is brought to a canonical
+// form, independent of the order of its sections, of the *NAME_MAP and of the
+// units of the file, and the canonical form is hashed. Nets are matched by
+// their full name; only the nets whose hashes differ are compared in detail,
+// to apply the tolerances.
+
+struct DiffOptions {
+  double m_cap_tol{};  // relative tolerance of capacitances
+  double m_res_tol{};  // relative tolerance of resistances
+};
+
+enum struct NetDiffType {
+  Added,
+  Removed,
+  Changed
+};
+
+struct NetDiff {
+  NetDiffType m_type;
+  std::string m_name;
+  std::vector<std::string_view> m_sections;  // the sections that changed
+};
+
+/// The values of a net at a corner, in SI units and with its elements sorted
+struct CanonicalValues {
+  using value = std::pair<std::string, double>;
+  using edge_value = std::tuple<std::string, std::string, double>;
+
+  double m_total_cap{};
+  std::vector<value> m_ground_caps;  // parallel caps are summed
+  std::vector<edge_value> m_coupling_caps;  // parallel caps are summed
+  std::vector<edge_value> m_resistances;  // nodes in lexicographic order
+  std::vector<value> m_delays;  // of the loads of R_NETs
+};
+
+/// A net with resolved names. Its values are the typ ones, and the min and
+/// max ones are in m_corners if the net has min:typ:max triplets. The *SC
+/// sensitivities are keyed by their element, like "cap node" or
+/// "res node1 node2".
+struct CanonicalNet {
+  using value = CanonicalValues::value;
+  using edge_value = CanonicalValues::edge_value;
+  using sens_value = std::tuple<std::string, std::uint32_t, double>;
+
+  NetType m_type;
+  std::string m_name;
+  std::vector<std::string> m_conns;  // connection type, direction and name
+  CanonicalValues m_values;
+  std::vector<CanonicalValues> m_corners;  // min and max, or none
+  std::vector<sens_value> m_sensitivities;  // sorted
+};
+
+namespace detail {
+/// The factors that convert the values of a SPEF to SI units
+struct UnitFactors {
+  double m_cap;
+  double m_res;
+  double m_time;
+
+  explicit UnitFactors(SPEF const &spef)
+      : m_cap(si_factor(spef.m_cap_scale)),
+        m_res(si_factor(spef.m_res_scale)),
+        m_time(si_factor(spef.m_time_scale)) {}
+};
+
+/// Sorts the values and sums the ones with the same key
+template<typename Value, typename Key>
+void sort_and_merge(std::vector<Value> &values, Key key) {
+  std::sort(
+      values.begin(),
+      values.end(),
+      [&](auto const &lhs, auto const &rhs) { return key(lhs) < key(rhs); });
+  std::size_t out = 0;
+  for (std::size_t idx = 0; idx < values.size(); ++idx) {
+    if (out != 0 && key(values[out - 1]) == key(values[idx])) {
+      std::get<double>(values[out - 1]) += std::get<double>(values[idx]);
+    } else {
+      values[out++] = std::move(values[idx]);
+    }
+  }
+  values.resize(out);
+}
+
+inline void hash_combine(std::uint64_t &seed, std::uint64_t value) {
+  seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+inline void hash_combine(std::uint64_t &seed, std::string_view str) {
+  hash_combine(seed, std::hash<std::string_view>{}(str));
+}
+
+inline void hash_combine(std::uint64_t &seed, double value) {
+  std::uint64_t bits{};
+  std::memcpy(&bits, &value, sizeof(bits));
+  hash_combine(seed, bits);
+}
+
+inline bool is_close(double lhs, double rhs, double tolerance) {
+  return lhs == rhs ||
+         std::abs(lhs - rhs) <=
+             tolerance * std::max(std::abs(lhs), std::abs(rhs));
+}
+
+template<typename Value, typename Key>
+bool is_close(
+    std::vector<Value> const &lhs,
+    std::vector<Value> const &rhs,
+    Key key,
+    double tolerance) {
+  if (lhs.size() != rhs.size()) {
+    return false;
+  }
+  for (std::size_t idx = 0; idx < lhs.size(); ++idx) {
+    if (key(lhs[idx]) != key(rhs[idx]) ||
+        !is_close(
+            std::get<double>(lhs[idx]),
+            std::get<double>(rhs[idx]),
+            tolerance)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline auto const value_key = [](CanonicalNet::value const &value) {
+  return std::string_view(value.first);
+};
+
+inline auto const edge_key = [](CanonicalNet::edge_value const &value) {
+  return std::make_pair(
+      std::string_view(std::get<0>(value)),
+      std::string_view(std::get<1>(value)));
+};
+
+inline auto const sens_key = [](CanonicalNet::sens_value const &value) {
+  return std::make_pair(
+      std::string_view(std::get<0>(value)),
+      std::get<1>(value));
+};
+
+/// The corners that are kept besides the typ values
+constexpr std::array<Corner, 2> OTHER_CORNERS{Corner::Min, Corner::Max};
+
+/// The value of the element at the corner, the typ one if the net has no
+/// corners
+template<typename T, typename Elem>
+T corner_value(
+    std::vector<Elem> const &elems,
+    T Elem::*value,
+    CornerValuesView<T> const &corners,
+    Corner corner,
+    std::size_t idx) {
+  return corners.empty() ? elems[idx].*value : corners[corner][idx];
+}
+
+/// The resolved node names of the elements of a D_NET, in their order, with
+/// the nodes of the resistors in lexicographic order
+struct ElementNames {
+  std::vector<std::string> m_ground_caps;
+  std::vector<std::pair<std::string, std::string>> m_coupling_caps;
+  std::vector<std::pair<std::string, std::string>> m_resistances;
+
+  ElementNames(DNet const &d_net, NameResolver const &resolver) {
+    for (auto const &cap : d_net.m_ground_caps) {
+      m_ground_caps.push_back(resolver.resolve(cap.m_node));
+    }
+    for (auto const &cap : d_net.m_coupling_caps) {
+      m_coupling_caps.emplace_back(
+          resolver.resolve(cap.m_node1),
+          resolver.resolve(cap.m_node2));
+    }
+    for (auto const &res : d_net.m_resistances) {
+      auto node1 = resolver.resolve(res.m_node1);
+      auto node2 = resolver.resolve(res.m_node2);
+      if (node2 < node1) {
+        std::swap(node1, node2);
+      }
+      m_resistances.emplace_back(std::move(node1), std::move(node2));
+    }
+  }
+};
+
+/// The values of the D_NET at the corner
+inline CanonicalValues canonical_values(
+    DNet const &d_net,
+    DNetVariationsView const &variations,
+    ElementNames const &names,
+    Corner corner,
+    UnitFactors const &factors) {
+  CanonicalValues values;
+  auto const &total_caps = variations.m_total_cap_corners;
+  values.m_total_cap =
+      (total_caps.empty() ? d_net.m_total_cap : total_caps[corner][0]) *
+      factors.m_cap;
+
+  for (std::size_t idx = 0; idx < d_net.m_ground_caps.size(); ++idx) {
+    values.m_ground_caps.emplace_back(
+        names.m_ground_caps[idx],
+        corner_value(
+            d_net.m_ground_caps,
+            &DNet::GroundCapacitance::m_cap,
+            variations.m_ground_cap_corners,
+            corner,
+            idx) *
+            factors.m_cap);
+  }
+  sort_and_merge(values.m_ground_caps, value_key);
+
+  for (std::size_t idx = 0; idx < d_net.m_coupling_caps.size(); ++idx) {
+    auto const &[node1, node2] = names.m_coupling_caps[idx];
+    values.m_coupling_caps.emplace_back(
+        node1,
+        node2,
+        corner_value(
+            d_net.m_coupling_caps,
+            &DNet::CouplingCapacitance::m_cap,
+            variations.m_coupling_cap_corners,
+            corner,
+            idx) *
+            factors.m_cap);
+  }
+  sort_and_merge(values.m_coupling_caps, edge_key);
+
+  for (std::size_t idx = 0; idx < d_net.m_resistances.size(); ++idx) {
+    auto const &[node1, node2] = names.m_resistances[idx];
+    values.m_resistances.emplace_back(
+        node1,
+        node2,
+        corner_value(
+            d_net.m_resistances,
+            &DNet::Resistance::m_res,
+            variations.m_res_corners,
+            corner,
+            idx) *
+            factors.m_res);
+  }
+  std::sort(values.m_resistances.begin(), values.m_resistances.end());
+  return values;
+}
+
+/// Adds the sensitivities of the elements, keyed by key(element)
+template<typename Key>
+void add_sensitivities(
+    SensitivitiesView const &sens,
+    Key const &key,
+    std::vector<CanonicalNet::sens_value> &sensitivities) {
+  for (std::size_t idx = 0; idx < sens.size(); ++idx) {
+    sensitivities.emplace_back(
+        key(sens.m_elements[idx]),
+        sens.m_params[idx],
+        sens.m_coeffs[idx]);
+  }
+}
+
+/// The values of the R_NET at the corner. The pi model is stored as two
+/// ground caps and a resistance.
+inline CanonicalValues canonical_values(
+    RNet const &r_net,
+    std::vector<std::string> const &load_pins,
+    Corner corner,
+    UnitFactors const &factors) {
+  auto const at = [corner](auto const &corners) {
+    return corners[static_cast<std::size_t>(corner)];
+  };
+  CanonicalValues values;
+  values.m_total_cap = (r_net.m_total_cap_corners
+                            ? at(*r_net.m_total_cap_corners)
+                            : r_net.m_total_cap) *
+                       factors.m_cap;
+  if (r_net.m_driver.empty()) {
+    return values;
+  }
+
+  auto const &pi_model = r_net.m_pi_model_corners
+                             ? at(*r_net.m_pi_model_corners)
+                             : r_net.m_pi_model;
+  values.m_ground_caps.emplace_back("C1", pi_model.m_c1 * factors.m_cap);
+  values.m_ground_caps.emplace_back("C2", pi_model.m_c2 * factors.m_cap);
+  values.m_resistances.emplace_back(
+      "C1",
+      "C2",
+      pi_model.m_r1 * factors.m_res);
+  for (std::size_t idx = 0; idx < r_net.m_loads.size(); ++idx) {
+    values.m_delays.emplace_back(
+        load_pins[idx],
+        corner_value(
+            r_net.m_loads,
+            &RNet::Load::m_rc,
+            r_net.m_rc_corners.view(),
+            corner,
+            idx) *
+            factors.m_time);
+  }
+  std::sort(values.m_delays.begin(), values.m_delays.end());
+  return values;
+}
+
+inline void hash_values(std::uint64_t &seed, CanonicalValues const &values) {
+  hash_combine(seed, values.m_total_cap);
+  for (auto const &[node, cap] : values.m_ground_caps) {
+    hash_combine(seed, node);
+    hash_combine(seed, cap);
+  }
+  for (auto const &[node1, node2, cap] : values.m_coupling_caps) {
+    hash_combine(seed, node1);
+    hash_combine(seed, node2);
+    hash_combine(seed, cap);
+  }
+  for (auto const &[node1, node2, res] : values.m_resistances) {
+    hash_combine(seed, node1);
+    hash_combine(seed, node2);
+    hash_combine(seed, res);
+  }
+  for (auto const &[pin, delay] : values.m_delays) {
+    hash_combine(seed, pin);
+    hash_combine(seed, delay);
+  }
+}
+
+/// Adds the sections in which the values differ beyond the tolerances
+inline void compare_values(
+    CanonicalValues const &lhs,
+    CanonicalValues const &rhs,
+    DiffOptions const &options,
+    std::vector<std::string_view> &sections) {
+  if (!is_close(lhs.m_total_cap, rhs.m_total_cap, options.m_cap_tol)) {
+    sections.emplace_back("total_cap");
+  }
+  if (!is_close(
+          lhs.m_ground_caps,
+          rhs.m_ground_caps,
+          value_key,
+          options.m_cap_tol)) {
+    sections.emplace_back("ground_cap");
+  }
+  if (!is_close(
+          lhs.m_coupling_caps,
+          rhs.m_coupling_caps,
+          edge_key,
+          options.m_cap_tol)) {
+    sections.emplace_back("coupling_cap");
+  }
+  if (!is_close(
+          lhs.m_resistances,
+          rhs.m_resistances,
+          edge_key,
+          options.m_res_tol)) {
+    sections.emplace_back("res");
+  }
+  if (!is_close(lhs.m_delays, rhs.m_delays, value_key, 0)) {
+    sections.emplace_back("loads");
+  }
+}
+}  // namespace detail
+
+inline CanonicalNet canonicalize(
+    DNet const &d_net,
+    DNetVariationsView const &variations,
+    NameResolver const &resolver,
+    detail::UnitFactors const &factors) {
+  CanonicalNet net;
+  net.m_type = NetType::Detailed;
+  net.m_name = resolver.resolve(d_net.m_name);
+
+  for (auto const &conn : d_net.m_conns) {
+    net.m_conns.push_back(fmt::format(
+        "{} {} {}",
+        get_connection_type_sv(conn.m_type),
+        get_direction_type_sv(conn.m_direction),
+        resolver.resolve(conn.m_name)));
+  }
+  std::sort(net.m_conns.begin(), net.m_conns.end());
+
+  detail::ElementNames const names(d_net, resolver);
+  net.m_values = detail::canonical_values(
+      d_net,
+      variations,
+      names,
+      Corner::Typ,
+      factors);
+  if (!variations.m_total_cap_corners.empty() ||
+      !variations.m_ground_cap_corners.empty() ||
+      !variations.m_coupling_cap_corners.empty() ||
+      !variations.m_res_corners.empty()) {
+    for (auto const corner : detail::OTHER_CORNERS) {
+      net.m_corners.push_back(detail::canonical_values(
+          d_net,
+          variations,
+          names,
+          corner,
+          factors));
+    }
+  }
+
+  detail::add_sensitivities(
+      variations.m_ground_cap_sens,
+      [&](std::uint32_t idx) {
+        return fmt::format("cap {}", names.m_ground_caps[idx]);
+      },
+      net.m_sensitivities);
+  detail::add_sensitivities(
+      variations.m_coupling_cap_sens,
+      [&](std::uint32_t idx) {
+        auto const &[node1, node2] = names.m_coupling_caps[idx];
+        return fmt::format("cap {} {}", node1, node2);
+      },
+      net.m_sensitivities);
+  detail::add_sensitivities(
+      variations.m_res_sens,
+      [&](std::uint32_t idx) {
+        auto const &[node1, node2] = names.m_resistances[idx];
+        return fmt::format("res {} {}", node1, node2);
+      },
+      net.m_sensitivities);
+  std::sort(net.m_sensitivities.begin(), net.m_sensitivities.end());
+
+  return net;
+}
+
+inline CanonicalNet canonicalize(
+    RNet const &r_net,
+    NameResolver const &resolver,
+    detail::UnitFactors const &factors) {
+  CanonicalNet net;
+  net.m_type = NetType::Reduced;
+  net.m_name = resolver.resolve(r_net.m_name);
+  if (!r_net.m_driver.empty()) {
+    net.m_conns.push_back(fmt::format(
+        "DRIVER {} {}",
+        resolver.resolve(r_net.m_driver),
+        resolver.resolve(r_net.m_driver_cell)));
+  }
+
+  std::vector<std::string> load_pins;
+  for (auto const &load : r_net.m_loads) {
+    load_pins.push_back(resolver.resolve(load.m_pin));
+  }
+  net.m_values =
+      detail::canonical_values(r_net, load_pins, Corner::Typ, factors);
+  if (r_net.m_total_cap_corners || r_net.m_pi_model_corners ||
+      !r_net.m_rc_corners.empty()) {
+    for (auto const corner : detail::OTHER_CORNERS) {
+      net.m_corners.push_back(
+          detail::canonical_values(r_net, load_pins, corner, factors));
+    }
+  }
+  return net;
+}
+
+inline std::uint64_t hash_net(CanonicalNet const &net) {
+  std::uint64_t seed = net.m_type == NetType::Detailed ? 1 : 2;
+  for (auto const &conn : net.m_conns) {
+    detail::hash_combine(seed, conn);
+  }
+  detail::hash_values(seed, net.m_values);
+  for (auto const &values : net.m_corners) {
+    detail::hash_values(seed, values);
+  }
+  for (auto const &[element, param, coeff] : net.m_sensitivities) {
+    detail::hash_combine(seed, element);
+    detail::hash_combine(seed, std::uint64_t{param});
+    detail::hash_combine(seed, coeff);
+  }
+  return seed;
+}
+
+/// Returns the sections in which the two nets differ beyond the tolerances.
+/// The min and max values are compared with the typ ones of a net that has
+/// no corners, and their differences are reported as corners.
+inline std::vector<std::string_view> compare_nets(
+    CanonicalNet const &lhs,
+    CanonicalNet const &rhs,
+    DiffOptions const &options) {
+  std::vector<std::string_view> sections;
+  if (lhs.m_type != rhs.m_type) {
+    sections.emplace_back("type");
+  }
+  if (lhs.m_conns != rhs.m_conns) {
+    sections.emplace_back("conn");
+  }
+  detail::compare_values(lhs.m_values, rhs.m_values, options, sections);
+  if (!lhs.m_corners.empty() || !rhs.m_corners.empty()) {
+    std::vector<std::string_view> corner_sections;
+    for (std::size_t idx = 0; idx < detail::OTHER_CORNERS.size(); ++idx) {
+      detail::compare_values(
+          lhs.m_corners.empty() ? lhs.m_values : lhs.m_corners[idx],
+          rhs.m_corners.empty() ? rhs.m_values : rhs.m_corners[idx],
+          options,
+          corner_sections);
+    }
+    if (!corner_sections.empty()) {
+      sections.emplace_back("corners");
+    }
+  }
+  if (!detail::is_close(
+          lhs.m_sensitivities,
+          rhs.m_sensitivities,
+          detail::sens_key,
+          0)) {
+    sections.emplace_back("sens");
+  }
+  return sections;
+}
+
+/// The full name and the hash of a net. Nets of both types are numbered
+/// together, D_NETs first.
+struct NetHash {
+  std::string m_name;
+  std::uint64_t m_hash;
+  std::size_t m_idx;
+};
+
+namespace detail {
+inline CanonicalNet canonicalize(
+    SPEF const &spef,
+    std::size_t idx,
+    NameResolver const &resolver,
+    UnitFactors const &factors) {
+  if (idx < spef.m_d_nets.size()) {
+    return ::canonicalize(
+        spef.m_d_nets[idx],
+        spef.m_d_net_variations.net(idx),
+        resolver,
+        factors);
+  }
+  return ::canonicalize(
+      spef.m_r_nets[idx - spef.m_d_nets.size()],
+      resolver,
+      factors);
+}
+
+/// Returns the hashes of all the nets of the SPEF, sorted by name
+inline std::vector<NetHash>
+hash_nets(SPEF const &spef, BS::thread_pool &pool) {
+  NameResolver const resolver(spef);
+  UnitFactors const factors(spef);
+  std::vector<NetHash> hashes(spef.m_d_nets.size() + spef.m_r_nets.size());
+  pool.parallelize_loop(
+          hashes.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto net = canonicalize(spef, idx, resolver, factors);
+              hashes[idx] = {std::move(net.m_name), hash_net(net), idx};
+            }
+          })
+      .wait();
+  std::sort(hashes.begin(), hashes.end(), [](auto const &lhs, auto const &rhs) {
+    return lhs.m_name < rhs.m_name;
+  });
+  return hashes;
+}
+}  // namespace detail
+
+/// Compares the nets of the two SPEFs by name. The differences are sorted by
+/// net name.
+inline std::vector<NetDiff> diff_spef(
+    SPEF const &lhs,
+    SPEF const &rhs,
+    DiffOptions const &options,
+    BS::thread_pool &pool) {
+  auto const lhs_hashes = detail::hash_nets(lhs, pool);
+  auto const rhs_hashes = detail::hash_nets(rhs, pool);
+
+  std::vector<NetDiff> diffs;
+  std::vector<std::pair<NetHash const *, NetHash const *>> candidates;
+  auto lhs_it = lhs_hashes.begin();
+  auto rhs_it = rhs_hashes.begin();
+  while (lhs_it != lhs_hashes.end() || rhs_it != rhs_hashes.end()) {
+    if (rhs_it == rhs_hashes.end() ||
+        (lhs_it != lhs_hashes.end() && lhs_it->m_name < rhs_it->m_name)) {
+      diffs.push_back({NetDiffType::Removed, lhs_it->m_name, {}});
+      ++lhs_it;
+    } else if (
+        lhs_it == lhs_hashes.end() || rhs_it->m_name < lhs_it->m_name) {
+      diffs.push_back({NetDiffType::Added, rhs_it->m_name, {}});
+      ++rhs_it;
+    } else {
+      if (lhs_it->m_hash != rhs_it->m_hash) {
+        candidates.emplace_back(&*lhs_it, &*rhs_it);
+      }
+      ++lhs_it;
+      ++rhs_it;
+    }
+  }
+
+  // compare the nets with different hashes in detail, applying the tolerances
+  NameResolver const lhs_resolver(lhs);
+  NameResolver const rhs_resolver(rhs);
+  detail::UnitFactors const lhs_factors(lhs);
+  detail::UnitFactors const rhs_factors(rhs);
+  std::vector<NetDiff> changed(candidates.size());
+  pool.parallelize_loop(
+          candidates.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto const [lhs_hash, rhs_hash] = candidates[idx];
+              changed[idx] = {
+                  NetDiffType::Changed,
+                  lhs_hash->m_name,
+                  compare_nets(
+                      detail::canonicalize(
+                          lhs,
+                          lhs_hash->m_idx,
+                          lhs_resolver,
+                          lhs_factors),
+                      detail::canonicalize(
+                          rhs,
+                          rhs_hash->m_idx,
+                          rhs_resolver,
+                          rhs_factors),
+                      options)};
+            }
+          })
+      .wait();
+  for (auto &diff : changed) {
+    if (!diff.m_sections.empty()) {
+      diffs.push_back(std::move(diff));
+    }
+  }
+
+  std::sort(diffs.begin(), diffs.end(), [](auto const &lhs, auto const &rhs) {
+    return lhs.m_name < rhs.m_name;
+  });
+  return diffs;
+}
+
+#endif  // SPEF_DIFF_HPP
@@ -0,0 +1,250 @@
+#ifndef SPEF_EXTRACT_HPP
+#define SPEF_EXTRACT_HPP
+
+#include "spef_actions.hpp"
+#include "spef_index.hpp"
+#include "spef_name_map.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+#include <ostream>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tao/pegtl.hpp>
+#include <unordered_set>
+#include <vector>
+
+// Extraction of nets from a SPEF file, without loading the whole file. The
+// file is memory-mapped and indexed in parallel, and only the *NAME_MAP and the
+// selected nets are parsed. The nets are copied verbatim, so the extracted
+// SPEF has the same text as the original for every net it keeps.
+
+/// Selects nets by their full name, or by regular expressions that must match
+/// the whole name
+class NetSelector {
+private:
+  std::unordered_set<std::string> m_names;
+  std::vector<std::regex> m_patterns;
+
+public:
+  void add_name(std::string name) { m_names.insert(std::move(name)); }
+
+  void add_pattern(std::string const &pattern) {
+    m_patterns.emplace_back(pattern, std::regex::optimize);
+  }
+
+  [[nodiscard]] bool matches(std::string const &name) const {
+    if (m_names.count(name) != 0) {
+      return true;
+    }
+    return std::any_of(
+        m_patterns.begin(),
+        m_patterns.end(),
+        [&name](std::regex const &pattern) {
+          return std::regex_match(name, pattern);
+        });
+  }
+};
+
+namespace detail {
+/// Calls fn with the number of every *index reference in the text. Keywords
+/// start with a letter, so every '*' followed by a digit is a reference.
+template<typename Fn>
+void for_each_index_ref(std::string_view text, Fn const &fn) {
+  std::size_t pos = 0;
+  while ((pos = text.find('*', pos)) != std::string_view::npos) {
+    std::size_t end = pos + 1;
+    while (end < text.size() &&
+           std::isdigit(static_cast<unsigned char>(text[end])) != 0) {
+      ++end;
+    }
+    if (end != pos + 1) {
+      fn(index_number(text.substr(pos, end - pos)));
+    }
+    pos = end;
+  }
+}
+
+/// Appends the numbers of the *index references of the text to refs
+inline void
+collect_index_refs(std::string_view text, std::vector<std::uint64_t> &refs) {
+  for_each_index_ref(text, [&refs](std::uint64_t ref) { refs.push_back(ref); });
+}
+
+inline void sort_unique(std::vector<std::uint64_t> &refs) {
+  std::sort(refs.begin(), refs.end());
+  refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+}
+
+/// Parses only the *NAME_MAP of an indexed SPEF file into spef
+inline void parse_name_map(
+    char const *data,
+    NetIndex const &index,
+    std::string const &source,
+    SPEF &spef) {
+  if (!index.has_name_map()) {
+    return;
+  }
+  pegtl::memory_input input(
+      data + index.m_name_map_offset,
+      data + index.m_name_map_offset + index.m_name_map_length,
+      source);
+  SPEFHelper spef_h{};
+  pegtl::parse<pegtl::must<spef_name_map>, spef_action>(input, spef, spef_h);
+}
+
+/// Parses the net, to check that it is valid before it is copied
+inline void
+check_net(std::string_view text, NetType type, std::string const &source) {
+  std::string buffer;
+  if (text.empty() || text.back() != '\n') {
+    buffer.reserve(text.size() + 1);
+    buffer.append(text).push_back('\n');
+    text = buffer;
+  }
+  pegtl::memory_input input(text.data(), text.data() + text.size(), source);
+  SPEF spef;
+  SPEFHelper spef_h{};
+  if (type == NetType::Detailed) {
+    pegtl::parse<pegtl::must<spef_d_net>, spef_action>(input, spef, spef_h);
+  } else {
+    pegtl::parse<pegtl::must<spef_r_net>, spef_action>(input, spef, spef_h);
+  }
+}
+
+/// The header of the file, after the *NAME_MAP and up to the first net: the
+/// power and ground nets, the ports and the other definitions
+inline std::string_view header_tail(char const *data, NetIndex const &index) {
+  auto const begin = index.has_name_map()
+                         ? index.m_name_map_offset + index.m_name_map_length
+                         : index.m_nets_offset;
+  return {data + begin, index.m_nets_offset - begin};
+}
+
+/// Writes the header of the file verbatim, except for its *NAME_MAP, which
+/// keeps only the entries whose numbers are in refs (sorted)
+inline void write_header(
+    std::ostream &os,
+    char const *data,
+    NetIndex const &index,
+    SPEF const &name_map,
+    std::vector<std::uint64_t> const &refs) {
+  if (!index.has_name_map()) {
+    os.write(data, static_cast<std::streamsize>(index.m_nets_offset));
+    return;
+  }
+
+  os.write(data, static_cast<std::streamsize>(index.m_name_map_offset));
+  std::vector<std::pair<std::uint64_t, std::string const *>> entries;
+  for (auto const &[ref, name] : name_map.m_name_map) {
+    auto const number = index_number(ref);
+    if (std::binary_search(refs.begin(), refs.end(), number)) {
+      entries.emplace_back(number, &name);
+    }
+  }
+  if (!entries.empty()) {
+    std::sort(entries.begin(), entries.end());
+    fmt::println(os, "*NAME_MAP");
+    for (auto const &[number, name] : entries) {
+      fmt::println(os, "*{} {}", number, *name);
+    }
+    fmt::println(os, "");
+  }
+  auto const tail = header_tail(data, index);
+  os.write(tail.data(), static_cast<std::streamsize>(tail.size()));
+}
+
+/// Writes the text of a net, followed by an empty line
+inline void write_net(std::ostream &os, std::string_view text) {
+  os.write(text.data(), static_cast<std::streamsize>(text.size()));
+  os << (text.empty() || text.back() != '\n' ? "\n\n" : "\n");
+}
+}  // namespace detail
+
+/// Writes a SPEF with the header of the given file and only the nets whose
+/// names are selected. Names written as a *index are matched by the name they
+/// map to, and the *NAME_MAP keeps only the entries that the header and the
+/// selected nets refer to. The nets are found and matched in parallel, and
+/// the matches are parsed in parallel to check them. Returns the number of
+/// nets written.
+inline std::size_t extract_nets(
+    std::filesystem::path const &spef_file,
+    NetSelector const &selector,
+    std::ostream &os,
+    BS::thread_pool &pool) {
+  pegtl::mmap_input<> const file(spef_file);
+  char const *const data = file.begin();
+  auto const source = spef_file.string();
+  auto const index =
+      build_net_index(data, static_cast<std::uint64_t>(file.size()), pool);
+
+  SPEF name_map;
+  detail::parse_name_map(data, index, source, name_map);
+  NameResolver const resolver(name_map);
+
+  std::vector<char> selected(index.m_nets.size());
+  pool.parallelize_loop(
+          index.m_nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto const &name = index.m_nets[idx].m_name;
+              selected[idx] = selector.matches(name) ||
+                              (name.find('*') != std::string::npos &&
+                               selector.matches(resolver.resolve(name)));
+            }
+          })
+      .wait();
+
+  std::vector<NetIndexEntry const *> nets;
+  for (std::size_t idx = 0; idx < index.m_nets.size(); ++idx) {
+    if (selected[idx] != 0) {
+      nets.push_back(&index.m_nets[idx]);
+    }
+  }
+
+  auto const net_text = [data](NetIndexEntry const &entry) {
+    return std::string_view(data + entry.m_offset, entry.m_length);
+  };
+  std::vector<std::vector<std::uint64_t>> net_refs(nets.size());
+  pool.parallelize_loop(
+          nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto const text = net_text(*nets[idx]);
+              // the positions of the parse errors are relative to the net
+              try {
+                detail::check_net(text, nets[idx]->m_type, source);
+              } catch (pegtl::parse_error const &err) {
+                throw std::runtime_error(fmt::format(
+                    "Could not parse the net {} at byte {}: {}",
+                    nets[idx]->m_name,
+                    nets[idx]->m_offset,
+                    err.what()));
+              }
+              detail::collect_index_refs(text, net_refs[idx]);
+            }
+          })
+      .get();
+
+  std::vector<std::uint64_t> refs;
+  detail::collect_index_refs(detail::header_tail(data, index), refs);
+  for (auto const &net_ref : net_refs) {
+    refs.insert(refs.end(), net_ref.begin(), net_ref.end());
+  }
+  detail::sort_unique(refs);
+
+  detail::write_header(os, data, index, name_map, refs);
+  for (auto const *net : nets) {
+    detail::write_net(os, net_text(*net));
+  }
+  return nets.size();
+}
+
+#endif  // SPEF_EXTRACT_HPP
@@ -0,0 +1,506 @@
+#ifndef SPEF_INDEX_HPP
+#define SPEF_INDEX_HPP
+
+#include "spef_actions.hpp"
+#include "spef_scan.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// An index of the byte ranges of all the nets of a SPEF file, so that single
+// nets can be parsed without parsing the whole file. The index is built with a
+// single memchr scan over the file and is persisted next to it, in
+// <filename>.spef.idx.
+
+struct NetIndexEntry {
+  std::uint64_t m_offset;  // offset of the *D_NET/*R_NET keyword
+  std::uint64_t m_length;  // up to and including the line of *END
+  NetType m_type;
+  std::string m_name;  // as written in the file, possibly a *index
+};
+
+struct NetIndex {
+  static constexpr std::string_view MAGIC{"SPEF_NET_INDEX"};
+  static constexpr unsigned int VERSION = 1;
+
+  std::uint64_t m_file_size{};
+  std::int64_t m_file_time{};  // last write time of the indexed file
+  std::uint64_t m_name_map_offset{};  // zero if there is no *NAME_MAP
+  std::uint64_t m_name_map_length{};
+  std::uint64_t m_nets_offset{};  // offset of the first net, end of the header
+  std::vector<NetIndexEntry> m_nets;
+
+  [[nodiscard]] bool has_name_map() const { return m_name_map_length != 0; }
+};
+
+inline std::filesystem::path net_index_path(
+    std::filesystem::path const &spef_file) {
+  std::filesystem::path index_file{spef_file};
+  index_file += ".idx";
+  return index_file;
+}
+
+inline std::int64_t file_time(std::filesystem::path const &file) {
+  return static_cast<std::int64_t>(
+      std::filesystem::last_write_time(file).time_since_epoch().count());
+}
+
+namespace detail {
+inline bool
+starts_with(char const *begin, char const *end, std::string_view str) {
+  return static_cast<std::size_t>(end - begin) >= str.size() &&
+         std::memcmp(begin, str.data(), str.size()) == 0;
+}
+
+inline bool is_keyword_end(char const *pos, char const *end) {
+  return pos == end || *pos == ' ' || *pos == '\t' || *pos == '\r' ||
+         *pos == '\n';
+}
+
+/// Scans the complete lines in [begin, end), which start at the given offset
+/// in the file, and updates the index with the keywords found at line starts
+class NetIndexScanner {
+private:
+  NetIndex &m_index;
+  bool m_in_name_map{};
+  bool m_in_net{};
+  bool m_after_header{};
+
+public:
+  explicit NetIndexScanner(NetIndex &index) : m_index(index) {}
+
+  void scan(char const *begin, char const *end, std::uint64_t offset) {
+    // only keywords at the start of a line are of interest. begin is always
+    // the start of a line.
+    scan_structural_chars(
+        begin,
+        end,
+        true,
+        [&](char const *pos) { scan_keyword(pos, begin, end, offset); });
+  }
+
+  void finish(std::uint64_t file_size) {
+    if (m_in_name_map) {
+      m_index.m_name_map_length = file_size - m_index.m_name_map_offset;
+    }
+    if (!m_after_header) {
+      m_index.m_nets_offset = file_size;
+    }
+    if (m_in_net) {
+      throw std::runtime_error(fmt::format(
+          "Net {} is not terminated by *END",
+          m_index.m_nets.back().m_name));
+    }
+  }
+
+private:
+  void scan_keyword(
+      char const *pos,
+      char const *begin,
+      char const *end,
+      std::uint64_t offset) {
+    static constexpr std::string_view D_NET{"*D_NET"};
+    static constexpr std::string_view R_NET{"*R_NET"};
+    static constexpr std::string_view END{"*END"};
+    static constexpr std::string_view NAME_MAP{"*NAME_MAP"};
+
+    auto const pos_offset = offset + static_cast<std::uint64_t>(pos - begin);
+    char const *const eol = static_cast<char const *>(
+        std::memchr(pos, '\n', static_cast<std::size_t>(end - pos)));
+    char const *const line_end = eol == nullptr ? end : eol + 1;
+
+    if (m_in_name_map &&
+        !(pos + 1 != end &&
+          std::isdigit(static_cast<unsigned char>(pos[1])) != 0)) {
+      // the first line that isn't a name map entry ends the name map
+      m_index.m_name_map_length = pos_offset - m_index.m_name_map_offset;
+      m_in_name_map = false;
+    }
+
+    if (starts_with(pos, end, D_NET) &&
+        is_keyword_end(pos + D_NET.size(), end)) {
+      begin_net(pos + D_NET.size(), line_end, pos_offset, NetType::Detailed);
+    } else if (
+        starts_with(pos, end, R_NET) &&
+        is_keyword_end(pos + R_NET.size(), end)) {
+      begin_net(pos + R_NET.size(), line_end, pos_offset, NetType::Reduced);
+    } else if (
+        m_in_net && starts_with(pos, end, END) &&
+        is_keyword_end(pos + END.size(), end)) {
+      auto &net = m_index.m_nets.back();
+      net.m_length = offset + static_cast<std::uint64_t>(line_end - begin) -
+                     net.m_offset;
+      m_in_net = false;
+    } else if (
+        !m_after_header && starts_with(pos, end, NAME_MAP) &&
+        is_keyword_end(pos + NAME_MAP.size(), end)) {
+      m_index.m_name_map_offset = pos_offset;
+      m_in_name_map = true;
+    }
+  }
+
+  void begin_net(
+      char const *name_begin,
+      char const *line_end,
+      std::uint64_t pos_offset,
+      NetType type) {
+    if (!m_after_header) {
+      m_index.m_nets_offset = pos_offset;
+      m_after_header = true;
+    }
+    if (m_in_net) {
+      throw std::runtime_error(fmt::format(
+          "Net {} is not terminated by *END",
+          m_index.m_nets.back().m_name));
+    }
+
+    std::string_view const line{
+        name_begin,
+        static_cast<std::size_t>(line_end - name_begin)};
+    std::vector<std::string_view> tokens;
+    split(line, tokens, 1);
+    if (tokens.empty()) {
+      throw std::runtime_error(
+          fmt::format("Net without a name at byte {}", pos_offset));
+    }
+    m_index.m_nets.push_back({pos_offset, 0, type, std::string(tokens[0])});
+    m_in_net = true;
+  }
+};
+}  // namespace detail
+
+/// Builds the net index of the given SPEF file. The file is read in blocks,
+/// and only complete lines are scanned; the incomplete last line of a block is
+/// carried over to the next one.
+inline NetIndex build_net_index(std::filesystem::path const &spef_file) {
+  static constexpr std::size_t BLOCK_SIZE = 16 * 1024 * 1024;
+
+  NetIndex index;
+  index.m_file_size = std::filesystem::file_size(spef_file);
+  index.m_file_time = file_time(spef_file);
+
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file(
+      std::fopen(spef_file.c_str(), "rb"),
+      &std::fclose);
+  if (!file) {
+    throw std::runtime_error(
+        fmt::format("Could not open {}", spef_file.string()));
+  }
+
+  detail::NetIndexScanner scanner(index);
+  std::vector<char> buffer(BLOCK_SIZE);
+  std::size_t carry = 0;
+  std::uint64_t offset = 0;
+  while (true) {
+    if (carry == buffer.size()) {
+      // a single line doesn't fit in the buffer
+      buffer.resize(buffer.size() * 2);
+    }
+    auto const bytes_read = std::fread(
+        buffer.data() + carry,
+        sizeof(char),
+        buffer.size() - carry,
+        file.get());
+    auto const size = carry + bytes_read;
+    if (bytes_read == 0) {
+      if (std::ferror(file.get()) != 0) {
+        throw std::runtime_error(
+            fmt::format("Could not read {}", spef_file.string()));
+      }
+      scanner.scan(buffer.data(), buffer.data() + size, offset);
+      break;
+    }
+
+    // scan up to the last complete line
+    char const *last_eol = buffer.data() + size;
+    while (last_eol != buffer.data() && last_eol[-1] != '\n') {
+      --last_eol;
+    }
+    scanner.scan(buffer.data(), last_eol, offset);
+
+    auto const scanned = static_cast<std::size_t>(last_eol - buffer.data());
+    carry = size - scanned;
+    std::memmove(buffer.data(), last_eol, carry);
+    offset += scanned;
+  }
+  scanner.finish(index.m_file_size);
+
+  return index;
+}
+
+namespace detail {
+/// Returns the ranges of the lines that start in [begin, end) with a *D_NET,
+/// *R_NET or *END keyword. The lines can extend up to data_end.
+inline std::vector<std::pair<char const *, char const *>> find_net_lines(
+    char const *begin,
+    char const *end,
+    char const *data_begin,
+    char const *data_end) {
+  static constexpr std::string_view D_NET{"*D_NET"};
+  static constexpr std::string_view R_NET{"*R_NET"};
+  static constexpr std::string_view END{"*END"};
+
+  std::vector<std::pair<char const *, char const *>> lines;
+  auto const on_star = [&](char const *pos) {
+    auto const is_keyword = [pos, data_end](std::string_view keyword) {
+      return starts_with(pos, data_end, keyword) &&
+             is_keyword_end(pos + keyword.size(), data_end);
+    };
+    if (is_keyword(D_NET) || is_keyword(R_NET) || is_keyword(END)) {
+      char const *const eol = static_cast<char const *>(
+          std::memchr(pos, '\n', static_cast<std::size_t>(data_end - pos)));
+      lines.emplace_back(pos, eol == nullptr ? data_end : eol + 1);
+    }
+  };
+  scan_structural_chars(
+      begin,
+      end,
+      begin == data_begin || begin[-1] == '\n',
+      on_star);
+  return lines;
+}
+}  // namespace detail
+
+/// Builds the net index of a SPEF file that is already in memory. The file is
+/// cut in one chunk per thread, and the lines that start or end a net are
+/// found in parallel. The header, and then only those lines, are fed to a
+/// single NetIndexScanner, so the result is the same as a sequential scan.
+/// The file size and time of the index aren't set.
+inline NetIndex
+build_net_index(char const *data, std::uint64_t size, BS::thread_pool &pool) {
+  std::size_t const num_chunks = std::max<std::size_t>(
+      1,
+      std::min<std::uint64_t>(pool.get_thread_count(), size / 4096));
+  std::vector<std::vector<std::pair<char const *, char const *>>> lines(
+      num_chunks);
+  pool.parallelize_loop(
+          num_chunks,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              lines[idx] = detail::find_net_lines(
+                  data + size * idx / num_chunks,
+                  data + size * (idx + 1) / num_chunks,
+                  data,
+                  data + size);
+            }
+          })
+      .wait();
+
+  NetIndex index;
+  detail::NetIndexScanner scanner(index);
+  bool in_header = true;
+  for (auto const &chunk_lines : lines) {
+    for (auto const &[begin, end] : chunk_lines) {
+      if (in_header) {
+        scanner.scan(data, begin, 0);
+        in_header = false;
+      }
+      scanner.scan(begin, end, static_cast<std::uint64_t>(begin - data));
+    }
+  }
+  if (in_header) {
+    scanner.scan(data, data + size, 0);
+  }
+  scanner.finish(size);
+  return index;
+}
+
+inline void write_net_index(
+    NetIndex const &index,
+    std::filesystem::path const &index_file) {
+  std::ofstream out(index_file);
+  fmt::println(out, "{} {}", NetIndex::MAGIC, NetIndex::VERSION);
+  fmt::println(out, "{} {}", index.m_file_size, index.m_file_time);
+  fmt::println(out, "{} {}", index.m_name_map_offset, index.m_name_map_length);
+  fmt::println(out, "{} {}", index.m_nets_offset, index.m_nets.size());
+  for (auto const &net : index.m_nets) {
+    fmt::println(
+        out,
+        "{} {} {} {}",
+        net.m_type == NetType::Detailed ? 'D' : 'R',
+        net.m_offset,
+        net.m_length,
+        net.m_name);
+  }
+  if (!out) {
+    throw std::runtime_error(
+        fmt::format("Could not write {}", index_file.string()));
+  }
+}
+
+/// Reads a net index written by write_net_index. Returns std::nullopt if the
+/// index file doesn't exist or is of a different version.
+inline std::optional<NetIndex> read_net_index(
+    std::filesystem::path const &index_file) {
+  std::ifstream in(index_file);
+  if (!in) {
+    return std::nullopt;
+  }
+
+  std::string magic;
+  unsigned int version{};
+  in >> magic >> version;
+  if (magic != NetIndex::MAGIC || version != NetIndex::VERSION) {
+    return std::nullopt;
+  }
+
+  NetIndex index;
+  std::size_t num_nets{};
+  in >> index.m_file_size >> index.m_file_time >> index.m_name_map_offset >>
+      index.m_name_map_length >> index.m_nets_offset >> num_nets;
+  index.m_nets.resize(num_nets);
+  for (auto &net : index.m_nets) {
+    char type{};
+    in >> type >> net.m_offset >> net.m_length >> net.m_name;
+    net.m_type = type == 'D' ? NetType::Detailed : NetType::Reduced;
+  }
+  if (!in) {
+    throw std::runtime_error(fmt::format(
+        "The net index {} is corrupted",
+        index_file.string()));
+  }
+  return index;
+}
+
+/// Random access to the nets of a SPEF file through its net index. The index
+/// is built (and persisted if possible) if it is missing or older than the
+/// SPEF file.
+class SPEFNetReader {
+private:
+  std::filesystem::path m_spef_file;
+  std::ifstream m_file;
+  NetIndex m_index;
+  std::unordered_map<std::string_view, std::size_t> m_by_name;
+  std::unordered_map<std::string, std::string> m_reverse_name_map;
+  bool m_name_map_loaded{};
+
+public:
+  explicit SPEFNetReader(std::filesystem::path spef_file)
+      : m_spef_file(std::move(spef_file)),
+        m_file(m_spef_file, std::ios::binary) {
+    if (!m_file) {
+      throw std::runtime_error(
+          fmt::format("Could not open {}", m_spef_file.string()));
+    }
+
+    auto const index_file = net_index_path(m_spef_file);
+    auto index = read_net_index(index_file);
+    if (!index ||
+        index->m_file_size != std::filesystem::file_size(m_spef_file) ||
+        index->m_file_time != file_time(m_spef_file)) {
+      index = build_net_index(m_spef_file);
+      // the index is only a cache, e.g. the directory may be read-only
+      try {
+        write_net_index(*index, index_file);
+      } catch (std::exception const &err) {
+        fmt::println(stderr, "Warning: {}", err.what());
+      }
+    }
+    m_index = std::move(*index);
+
+    m_by_name.reserve(m_index.m_nets.size());
+    for (std::size_t idx = 0; idx < m_index.m_nets.size(); ++idx) {
+      m_by_name.emplace(m_index.m_nets[idx].m_name, idx);
+    }
+  }
+
+  [[nodiscard]] NetIndex const &index() const { return m_index; }
+
+  /// Returns the index entry of the net with the given name. The name can be
+  /// either the name used in the file, or the full name of a net written as a
+  /// *index, in which case the *NAME_MAP is read on first use.
+  NetIndexEntry const *find(std::string_view name) {
+    auto it = m_by_name.find(name);
+    if (it == m_by_name.end() && m_index.has_name_map()) {
+      load_name_map();
+      auto const index_it = m_reverse_name_map.find(std::string(name));
+      if (index_it != m_reverse_name_map.end()) {
+        it = m_by_name.find(index_it->second);
+      }
+    }
+    return it == m_by_name.end() ? nullptr : &m_index.m_nets[it->second];
+  }
+
+  /// Reads and parses only the given D_NET
+  std::optional<SingleDNet> get_d_net(std::string_view name) {
+    auto const *entry = find(name);
+    if (entry == nullptr || entry->m_type != NetType::Detailed) {
+      return std::nullopt;
+    }
+
+    SPEF spef;
+    parse_range<spef_d_net>(entry->m_offset, entry->m_length, spef);
+    return take_single_d_net(spef);
+  }
+
+  /// Reads and parses only the given R_NET
+  std::optional<RNet> get_r_net(std::string_view name) {
+    auto const *entry = find(name);
+    if (entry == nullptr || entry->m_type != NetType::Reduced) {
+      return std::nullopt;
+    }
+
+    SPEF spef;
+    parse_range<spef_r_net>(entry->m_offset, entry->m_length, spef);
+    return std::move(spef.m_r_nets.back());
+  }
+
+private:
+  std::string read_range(std::uint64_t offset, std::uint64_t length) {
+    std::string buffer(length, '\0');
+    m_file.seekg(static_cast<std::streamoff>(offset));
+    m_file.read(buffer.data(), static_cast<std::streamsize>(length));
+    if (!m_file) {
+      throw std::runtime_error(
+          fmt::format("Could not read {}", m_spef_file.string()));
+    }
+    // the grammar expects whitespace after *END, which is missing if the net
+    // is at the very end of the file
+    if (buffer.empty() || buffer.back() != '\n') {
+      buffer.push_back('\n');
+    }
+    return buffer;
+  }
+
+  template<typename Rule>
+  void parse_range(std::uint64_t offset, std::uint64_t length, SPEF &spef) {
+    auto const buffer = read_range(offset, length);
+    pegtl::memory_input input(
+        buffer.data(),
+        buffer.data() + buffer.size(),
+        m_spef_file.string());
+    SPEFHelper spef_h{};
+    pegtl::parse<pegtl::must<Rule>, spef_action>(input, spef, spef_h);
+  }
+
+  void load_name_map() {
+    if (m_name_map_loaded) {
+      return;
+    }
+    SPEF spef;
+    parse_range<spef_name_map>(
+        m_index.m_name_map_offset,
+        m_index.m_name_map_length,
+        spef);
+    for (auto &[index, name] : spef.m_name_map) {
+      m_reverse_name_map.emplace(std::move(name), index);
+    }
+    m_name_map_loaded = true;
+  }
+};
+
+#endif  // SPEF_INDEX_HPP
@@ -0,0 +1,178 @@
+#ifndef SPEF_LAZY_HPP
+#define SPEF_LAZY_HPP
+
+#include "spef_actions.hpp"
+#include "spef_index.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <filesystem>
+#include <fmt/core.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tao/pegtl.hpp>
+#include <vector>
+
+// Lazy loading of SPEF files. Loading parses only the header sections, the
+// R_NETs and the first line of every D_NET (its name, total cap and routing
+// confidence), and keeps the byte range of every D_NET in the memory-mapped
+// file. The *CONN, *CAP and *RES sections of a D_NET are parsed the first time
+// they are accessed, so summaries over the nets of huge files never build the
+// connections, capacitors and resistors at all.
+
+/// A D_NET whose header is parsed eagerly and whose body is parsed on first
+/// access. Accessing the body is thread-safe.
+class LazyDNet {
+private:
+  std::string m_name;
+  cap_t m_total_cap{};
+  unsigned int m_routing_conf{};
+  std::string_view m_text;  // the whole net, up to *END, in the mapped file
+  std::shared_ptr<std::string const> m_source;  // for parse errors
+  mutable std::once_flag m_parsed;
+  mutable std::unique_ptr<SingleDNet> m_d_net;
+
+  friend class LazySPEF;
+
+public:
+  [[nodiscard]] std::string const &name() const { return m_name; }
+  [[nodiscard]] cap_t total_cap() const { return m_total_cap; }
+  [[nodiscard]] unsigned int routing_conf() const { return m_routing_conf; }
+  [[nodiscard]] std::string_view text() const { return m_text; }
+
+  /// Returns the fully parsed net, parsing it on the first call. If parsing
+  /// fails the exception is propagated, and the next call tries again.
+  SingleDNet const &get() const {
+    std::call_once(m_parsed, [this] {
+      m_d_net = std::make_unique<SingleDNet>(materialize());
+    });
+    return *m_d_net;
+  }
+
+  DNet const *operator->() const { return &get().m_d_net; }
+
+  /// Parses the net without keeping it, for a single pass over the nets
+  [[nodiscard]] SingleDNet materialize() const {
+    // the grammar expects whitespace after *END, which is missing if the net
+    // is at the very end of the file
+    std::string buffer;
+    std::string_view text = m_text;
+    if (text.empty() || text.back() != '\n') {
+      buffer.reserve(text.size() + 1);
+      buffer.append(text).push_back('\n');
+      text = buffer;
+    }
+
+    pegtl::memory_input input(
+        text.data(),
+        text.data() + text.size(),
+        *m_source);
+    SPEF spef;
+    SPEFHelper spef_h{};
+    pegtl::parse<pegtl::must<spef_d_net>, spef_action>(input, spef, spef_h);
+    return take_single_d_net(spef);
+  }
+};
+
+/// A SPEF file loaded lazily. The header sections and the R_NETs are stored in
+/// header(), whose m_d_nets is always empty, and the D_NETs in d_nets().
+class LazySPEF {
+private:
+  std::unique_ptr<pegtl::mmap_input<>> m_input;
+  SPEF m_header;
+  std::vector<LazyDNet> m_d_nets;
+
+public:
+  /// Loads the given file, parsing the first lines of the D_NETs in parallel.
+  /// An error in any of them is propagated.
+  LazySPEF(std::filesystem::path const &spef_file, BS::thread_pool &pool)
+      : m_input(std::make_unique<pegtl::mmap_input<>>(spef_file)) {
+    char const *const data = m_input->begin();
+    auto const size = static_cast<std::uint64_t>(m_input->size());
+    auto const source =
+        std::make_shared<std::string const>(spef_file.string());
+
+    NetIndex index;
+    detail::NetIndexScanner scanner(index);
+    scanner.scan(data, data + size, 0);
+    scanner.finish(size);
+
+    {
+      pegtl::memory_input input(data, data + index.m_nets_offset, *source);
+      SPEFHelper spef_h{};
+      pegtl::parse<pegtl::must<spef_preamble, pegtl::eof>, spef_action>(
+          input,
+          m_header,
+          spef_h);
+    }
+
+    std::vector<NetIndexEntry const *> d_net_entries;
+    for (auto const &entry : index.m_nets) {
+      if (entry.m_type == NetType::Detailed) {
+        d_net_entries.push_back(&entry);
+        continue;
+      }
+      // R_NETs are rare, and are parsed right away
+      std::string buffer(data + entry.m_offset, entry.m_length);
+      buffer.push_back('\n');
+      pegtl::memory_input input(
+          buffer.data(),
+          buffer.data() + buffer.size(),
+          *source);
+      SPEFHelper spef_h{};
+      pegtl::parse<pegtl::must<spef_r_net>, spef_action>(
+          input,
+          m_header,
+          spef_h);
+    }
+
+    m_d_nets = std::vector<LazyDNet>(d_net_entries.size());
+    pool.parallelize_loop(
+            d_net_entries.size(),
+            [&](std::size_t const first, std::size_t const last) {
+              for (std::size_t idx = first; idx < last; ++idx) {
+                auto const &entry = *d_net_entries[idx];
+                auto &d_net = m_d_nets[idx];
+                d_net.m_text = {data + entry.m_offset, entry.m_length};
+                d_net.m_source = source;
+                parse_header(d_net, entry.m_offset);
+              }
+            })
+        .get();
+  }
+
+  [[nodiscard]] SPEF const &header() const { return m_header; }
+  [[nodiscard]] SPEF &header() { return m_header; }
+  [[nodiscard]] std::vector<LazyDNet> const &d_nets() const { return m_d_nets; }
+
+private:
+  static void parse_header(LazyDNet &d_net, std::uint64_t offset) {
+    pegtl::memory_input input(
+        d_net.m_text.data(),
+        d_net.m_text.data() + d_net.m_text.size(),
+        *d_net.m_source);
+    SPEF spef;
+    SPEFHelper spef_h{};
+    // the positions of the parse errors are relative to the net
+    bool parsed = false;
+    try {
+      parsed =
+          pegtl::parse<spef_d_net_header, spef_action>(input, spef, spef_h);
+    } catch (pegtl::parse_error const &err) {
+      throw std::runtime_error(fmt::format(
+          "Could not parse the *D_NET line at byte {}: {}",
+          offset,
+          err.what()));
+    }
+    if (!parsed) {
+      throw std::runtime_error(
+          fmt::format("Could not parse the *D_NET line at byte {}", offset));
+    }
+    d_net.m_name = std::move(spef_h.m_current_d_net.m_name);
+    d_net.m_total_cap = spef_h.m_current_d_net.m_total_cap;
+    d_net.m_routing_conf = spef_h.m_current_d_net.m_routing_conf;
+  }
+};
+
+#endif  // SPEF_LAZY_HPP
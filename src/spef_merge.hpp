@@ -0,0 +1,418 @@
+#ifndef SPEF_MERGE_HPP
+#define SPEF_MERGE_HPP
+
+#include "spef_lazy.hpp"
+#include "spef_name_map.hpp"
+#include "spef_node_name.hpp"
+#include "spef_structs.hpp"
+#include "spef_units.hpp"
+#include "spef_write.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fmt/core.h>
+#include <future>
+#include <initializer_list>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Merging of SPEF shards, e.g. one per partition of a design, into a single
+// SPEF. The shards are loaded lazily and in parallel, and the header of the
+// first shard is used for the merged file. The shards must have the same
+// delimiters and *VARIATION_PARAMETERS. The values of shards with other
+// units are rescaled, and the *NAME_MAPs of all shards are renumbered into a
+// single one, in which every name appears once. The nets are then parsed,
+// renamed and written in batches, so only a batch of nets is in memory at any
+// time.
+
+struct MergeStats {
+  std::size_t m_num_d_nets{};
+  std::size_t m_num_r_nets{};
+  std::size_t m_num_names{};
+};
+
+namespace detail {
+/// Returns the factor that converts values in the from units to the to units.
+/// If any of the units is missing, they are assumed to be the same.
+inline double unit_factor(scaled_value const &from, scaled_value const &to) {
+  if (!from || !to) {
+    return 1;
+  }
+  double const factor = si_factor(from) / si_factor(to);
+  // 1e-12 / 1e-15 isn't exactly 1000, which would add rounding noise to every
+  // value of the shard
+  double const power_of_ten = std::pow(10.0, std::round(std::log10(factor)));
+  return std::abs(factor / power_of_ten - 1) < 1e-12 ? power_of_ten : factor;
+}
+
+/// Renames and rescales the nets of a shard to the merged SPEF
+class ShardRewriter {
+private:
+  std::unordered_map<std::string, std::string> m_index_map;  // to the merged
+  char m_pin_delim;
+  double m_cap_factor;
+  double m_res_factor;
+  double m_time_factor;
+
+public:
+  ShardRewriter(
+      std::unordered_map<std::string, std::string> index_map,
+      SPEF const &shard,
+      SPEF const &merged)
+      : m_index_map(std::move(index_map)),
+        m_pin_delim(pin_delimiter(shard)),
+        m_cap_factor(unit_factor(shard.m_cap_scale, merged.m_cap_scale)),
+        m_res_factor(unit_factor(shard.m_res_scale, merged.m_res_scale)),
+        m_time_factor(unit_factor(shard.m_time_scale, merged.m_time_scale)) {}
+
+  [[nodiscard]] std::string rename(std::string_view name) const {
+    return map_indices(
+        name,
+        m_pin_delim,
+        [this](std::string_view index) -> std::string const * {
+          auto const it = m_index_map.find(std::string(index));
+          return it == m_index_map.end() ? nullptr : &it->second;
+        });
+  }
+
+  void rewrite(std::vector<std::unique_ptr<ConnAttr>> &conn_attrs) const {
+    for (auto &conn_attr : conn_attrs) {
+      if (conn_attr->m_type == ConnAttrType::CapLoad) {
+        for (auto &cap :
+             static_cast<CapLoadAttr *>(conn_attr.get())->m_cap.m_caps) {
+          cap *= m_cap_factor;
+        }
+      } else if (conn_attr->m_type == ConnAttrType::DrivingCell) {
+        auto &cell = static_cast<DrivingCellAttr *>(conn_attr.get())->m_cell;
+        cell = rename(cell);
+      }
+    }
+  }
+
+  void rewrite(SingleDNet &single) const {
+    DNet &d_net = single.m_d_net;
+    d_net.m_name = rename(d_net.m_name);
+    d_net.m_total_cap *= m_cap_factor;
+    for (auto &conn : d_net.m_conns) {
+      conn.m_name = rename(conn.m_name);
+      rewrite(conn.m_conn_attrs);
+    }
+    for (auto &ground_cap : d_net.m_ground_caps) {
+      ground_cap.m_node = rename(ground_cap.m_node);
+      ground_cap.m_cap *= m_cap_factor;
+    }
+    for (auto &coupling_cap : d_net.m_coupling_caps) {
+      coupling_cap.m_node1 = rename(coupling_cap.m_node1);
+      coupling_cap.m_node2 = rename(coupling_cap.m_node2);
+      coupling_cap.m_cap *= m_cap_factor;
+    }
+    for (auto &res : d_net.m_resistances) {
+      res.m_node1 = rename(res.m_node1);
+      res.m_node2 = rename(res.m_node2);
+      res.m_res *= m_res_factor;
+    }
+    single.m_variations.m_ground_cap_corners.scale(m_cap_factor);
+    single.m_variations.m_coupling_cap_corners.scale(m_cap_factor);
+    single.m_variations.m_res_corners.scale(m_res_factor);
+    single.m_variations.m_total_cap_corners.scale(m_cap_factor);
+  }
+
+  void rewrite(RNet &r_net) const {
+    r_net.m_name = rename(r_net.m_name);
+    r_net.m_total_cap *= m_cap_factor;
+    r_net.m_driver = rename(r_net.m_driver);
+    r_net.m_driver_cell = rename(r_net.m_driver_cell);
+    r_net.m_pi_model.m_c2 *= m_cap_factor;
+    r_net.m_pi_model.m_r1 *= m_res_factor;
+    r_net.m_pi_model.m_c1 *= m_cap_factor;
+    for (auto &load : r_net.m_loads) {
+      load.m_pin = rename(load.m_pin);
+      load.m_rc *= m_time_factor;
+    }
+    // the poles and the residues are in 1 / T_UNIT
+    for (auto &pole : r_net.m_poles) {
+      pole /= m_time_factor;
+    }
+    for (auto &residue : r_net.m_residues) {
+      residue /= m_time_factor;
+    }
+    if (r_net.m_total_cap_corners) {
+      for (auto &cap : *r_net.m_total_cap_corners) {
+        cap *= m_cap_factor;
+      }
+    }
+    if (r_net.m_pi_model_corners) {
+      for (auto &pi_model : *r_net.m_pi_model_corners) {
+        pi_model.m_c2 *= m_cap_factor;
+        pi_model.m_r1 *= m_res_factor;
+        pi_model.m_c1 *= m_cap_factor;
+      }
+    }
+    r_net.m_rc_corners.scale(m_time_factor);
+    for (auto *corners : {&r_net.m_pole_corners, &r_net.m_residue_corners}) {
+      for (auto &values : corners->m_values) {
+        for (auto &value : values) {
+          value /= m_time_factor;
+        }
+      }
+    }
+  }
+};
+
+inline void check_delimiters(
+    SPEF const &shard,
+    SPEF const &merged,
+    std::filesystem::path const &shard_file) {
+  if (shard.m_hierarchy_div_def != merged.m_hierarchy_div_def ||
+      shard.m_pin_delim_def != merged.m_pin_delim_def ||
+      shard.m_prefix_bus_delim != merged.m_prefix_bus_delim ||
+      shard.m_suffix_bus_delim != merged.m_suffix_bus_delim) {
+    throw std::runtime_error(fmt::format(
+        "The delimiters of {} differ from those of the first shard",
+        shard_file.string()));
+  }
+}
+
+/// The sensitivities of the nets refer to the parameters by their ids, so the
+/// shards must all have the *VARIATION_PARAMETERS of the merged SPEF
+inline void check_variation_params(
+    SPEF const &shard,
+    SPEF const &merged,
+    std::filesystem::path const &shard_file) {
+  auto const same_param = [](VariationParameter const &lhs,
+                             VariationParameter const &rhs) {
+    return lhs.m_id == rhs.m_id && lhs.m_name == rhs.m_name &&
+           lhs.m_cap_type == rhs.m_cap_type &&
+           lhs.m_res_type == rhs.m_res_type &&
+           lhs.m_induct_type == rhs.m_induct_type &&
+           lhs.m_var_coeff == rhs.m_var_coeff &&
+           lhs.m_normalization == rhs.m_normalization;
+  };
+  auto const same_coeffs = [](std::optional<TemperatureCoeffs> const &lhs,
+                              std::optional<TemperatureCoeffs> const &rhs) {
+    if (!lhs || !rhs) {
+      return !lhs && !rhs;
+    }
+    return lhs->m_crt1 == rhs->m_crt1 && lhs->m_crt2 == rhs->m_crt2 &&
+           lhs->m_nominal_temp == rhs->m_nominal_temp;
+  };
+  if (!std::equal(
+          shard.m_variation_params.begin(),
+          shard.m_variation_params.end(),
+          merged.m_variation_params.begin(),
+          merged.m_variation_params.end(),
+          same_param) ||
+      !same_coeffs(shard.m_temperature_coeffs, merged.m_temperature_coeffs)) {
+    throw std::runtime_error(fmt::format(
+        "The variation parameters of {} differ from those of the first shard",
+        shard_file.string()));
+  }
+}
+
+/// Throws if a net, a D_NET or an R_NET, is in several shards or several
+/// times in a shard, with the first duplicates and the shards they are in
+inline void check_duplicate_nets(
+    std::vector<LazySPEF> const &shards,
+    std::vector<std::filesystem::path> const &shard_files) {
+  constexpr std::size_t MAX_REPORTED = 10;
+  std::unordered_map<std::string, std::size_t> net_shards;
+  std::size_t num_duplicates = 0;
+  std::string reported;
+  auto const add_net = [&](std::string name, std::size_t shard_idx) {
+    auto const [it, inserted] = net_shards.emplace(std::move(name), shard_idx);
+    if (inserted) {
+      return;
+    }
+    if (num_duplicates++ < MAX_REPORTED) {
+      reported += fmt::format(
+          "\n  {} in {} and {}",
+          it->first,
+          shard_files[it->second].string(),
+          shard_files[shard_idx].string());
+    }
+  };
+  for (std::size_t shard_idx = 0; shard_idx < shards.size(); ++shard_idx) {
+    NameResolver const resolver(shards[shard_idx].header());
+    for (auto const &d_net : shards[shard_idx].d_nets()) {
+      add_net(resolver.resolve(d_net.name()), shard_idx);
+    }
+    for (auto const &r_net : shards[shard_idx].header().m_r_nets) {
+      add_net(resolver.resolve(r_net.m_name), shard_idx);
+    }
+  }
+  if (num_duplicates > 0) {
+    throw std::runtime_error(fmt::format(
+        "{} {} defined more than once:{}{}",
+        num_duplicates,
+        num_duplicates == 1 ? "net is" : "nets are",
+        reported,
+        num_duplicates > MAX_REPORTED ? "\n  ..." : ""));
+  }
+}
+}  // namespace detail
+
+/// Merges the given SPEF shards into os. The nets of every shard are parsed,
+/// renamed and written batch_size at a time. The shards must not have nets
+/// with the same full name, which is checked before anything is written.
+inline MergeStats merge_spef_files(
+    std::vector<std::filesystem::path> const &shard_files,
+    std::ostream &os,
+    BS::thread_pool &pool,
+    std::size_t batch_size = 4096) {
+  if (shard_files.empty()) {
+    throw std::runtime_error("No shards to merge");
+  }
+
+  // load the shards in parallel. Each shard parses its nets on the pool, so
+  // the shards are loaded by their own threads to avoid waiting on the pool
+  // from within the pool.
+  std::vector<std::future<LazySPEF>> loading;
+  for (auto const &shard_file : shard_files) {
+    loading.push_back(std::async(std::launch::async, [&shard_file, &pool] {
+      return LazySPEF(shard_file, pool);
+    }));
+  }
+  std::vector<LazySPEF> shards;
+  for (auto &future : loading) {
+    shards.push_back(future.get());
+  }
+
+  // the header of the first shard is the header of the merged SPEF
+  SPEF const &first = shards.front().header();
+  SPEF merged;
+  merged.m_version = first.m_version;
+  merged.m_design_name = first.m_design_name;
+  merged.m_date = first.m_date;
+  merged.m_vendor = first.m_vendor;
+  merged.m_program_name = first.m_program_name;
+  merged.m_program_version = first.m_program_version;
+  merged.m_design_flow = first.m_design_flow;
+  merged.m_hierarchy_div_def = first.m_hierarchy_div_def;
+  merged.m_pin_delim_def = first.m_pin_delim_def;
+  merged.m_prefix_bus_delim = first.m_prefix_bus_delim;
+  merged.m_suffix_bus_delim = first.m_suffix_bus_delim;
+  merged.m_time_scale = first.m_time_scale;
+  merged.m_cap_scale = first.m_cap_scale;
+  merged.m_res_scale = first.m_res_scale;
+  merged.m_induct_scale = first.m_induct_scale;
+  merged.m_variation_params = first.m_variation_params;
+  merged.m_temperature_coeffs = first.m_temperature_coeffs;
+
+  // renumber the name maps. The indices are assigned in the order of the
+  // shards, and within a shard in the order of its indices, so that the
+  // result doesn't depend on the order of the unordered maps.
+  std::unordered_map<std::string, std::string> merged_index;
+  std::vector<detail::ShardRewriter> rewriters;
+  for (std::size_t shard_idx = 0; shard_idx < shards.size(); ++shard_idx) {
+    SPEF const &shard = shards[shard_idx].header();
+    detail::check_delimiters(shard, merged, shard_files[shard_idx]);
+    detail::check_variation_params(shard, merged, shard_files[shard_idx]);
+
+    std::vector<std::pair<std::string const, std::string> const *> entries;
+    entries.reserve(shard.m_name_map.size());
+    for (auto const &entry : shard.m_name_map) {
+      entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](auto lhs, auto rhs) {
+      return index_number(lhs->first) < index_number(rhs->first);
+    });
+
+    std::unordered_map<std::string, std::string> index_map;
+    index_map.reserve(entries.size());
+    for (auto const *entry : entries) {
+      auto const [it, inserted] = merged_index.emplace(
+          entry->second,
+          fmt::format("*{}", merged_index.size() + 1));
+      if (inserted) {
+        merged.m_name_map.emplace(it->second, entry->second);
+      }
+      index_map.emplace(entry->first, it->second);
+    }
+    rewriters.emplace_back(std::move(index_map), shard, merged);
+  }
+
+  // the power nets, ground nets and ports of all shards, without duplicates
+  std::unordered_set<std::string> seen_power_nets;
+  std::unordered_set<std::string> seen_ground_nets;
+  std::unordered_set<std::string> seen_ports;
+  for (std::size_t shard_idx = 0; shard_idx < shards.size(); ++shard_idx) {
+    SPEF &shard = shards[shard_idx].header();
+    auto const &rewriter = rewriters[shard_idx];
+    for (auto const &power_net : shard.m_power_nets) {
+      auto name = rewriter.rename(power_net);
+      if (seen_power_nets.insert(name).second) {
+        merged.m_power_nets.push_back(std::move(name));
+      }
+    }
+    for (auto const &ground_net : shard.m_ground_nets) {
+      auto name = rewriter.rename(ground_net);
+      if (seen_ground_nets.insert(name).second) {
+        merged.m_ground_nets.push_back(std::move(name));
+      }
+    }
+    for (auto &port : shard.m_ports) {
+      port.m_name = rewriter.rename(port.m_name);
+      if (seen_ports.insert(port.m_name).second) {
+        rewriter.rewrite(port.m_conn_attrs);
+        merged.m_ports.push_back(std::move(port));
+      }
+    }
+  }
+  detail::check_duplicate_nets(shards, shard_files);
+  os << merged;
+
+  MergeStats stats;
+  stats.m_num_names = merged.m_name_map.size();
+
+  // the D_NETs are written with the delimiters of the merged SPEF
+  auto const write_net = with_node_name_splitter(merged, [](auto splitter) {
+    return &write_d_net<decltype(splitter)>;
+  });
+  std::vector<std::string> batch;
+  for (std::size_t shard_idx = 0; shard_idx < shards.size(); ++shard_idx) {
+    auto const &d_nets = shards[shard_idx].d_nets();
+    auto const &rewriter = rewriters[shard_idx];
+    for (std::size_t first = 0; first < d_nets.size(); first += batch_size) {
+      std::size_t const last = std::min(first + batch_size, d_nets.size());
+      batch.assign(last - first, std::string());
+      pool.parallelize_loop(
+              first,
+              last,
+              [&](std::size_t const begin, std::size_t const end) {
+                std::ostringstream out;
+                for (std::size_t idx = begin; idx < end; ++idx) {
+                  SingleDNet d_net = d_nets[idx].materialize();
+                  rewriter.rewrite(d_net);
+                  out.str(std::string());
+                  write_net(out, d_net.m_d_net, d_net.variations());
+                  batch[idx - first] = out.str();
+                }
+              })
+          .get();
+      for (auto const &net : batch) {
+        os << net;
+      }
+      stats.m_num_d_nets += batch.size();
+    }
+  }
+
+  // R_NETs are parsed while loading, and are written last
+  for (std::size_t shard_idx = 0; shard_idx < shards.size(); ++shard_idx) {
+    for (auto &r_net : shards[shard_idx].header().m_r_nets) {
+      rewriters[shard_idx].rewrite(r_net);
+      os << r_net;
+      ++stats.m_num_r_nets;
+    }
+  }
+  os << '\n';
+
+  return stats;
+}
+
+#endif  // SPEF_MERGE_HPP
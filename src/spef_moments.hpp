@@ -0,0 +1,235 @@
+#ifndef SPEF_MOMENTS_HPP
+#define SPEF_MOMENTS_HPP
+
+#include "spef_rc_tree.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <array>
+#include <fmt/core.h>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+// Transfer-function moments of the RC trees of D_NETs. With an ideal step at
+// the driver, the moments of the voltage at every node are m0 = 1 and
+//   m_k(i) = m_k(parent(i)) - R(i) * sum_{j in subtree(i)} C(j) * m_{k-1}(j)
+// so every moment costs one bottom-up and one top-down walk over the tree
+// (m1 is the negated Elmore delay).
+//
+// Most nets are small, so walking them one at a time leaves the vector units
+// idle. Small nets with the same tree topology (the same parent array) are
+// therefore batched into groups of MOMENT_LANES, stored lane-minor, and walked
+// together: the topology is shared, so the inner loop over the lanes has no
+// gathers and is vectorized by the compiler. Large nets are walked one at a
+// time, in parallel.
+
+static constexpr std::size_t MAX_MOMENTS = 4;
+static constexpr std::size_t MOMENT_LANES = 8;
+static constexpr std::size_t MAX_BATCHED_NODES = 64;
+
+struct LoadMoments {
+  std::string_view m_pin;  // points into the D_NET strings
+  std::array<double, MAX_MOMENTS> m_moments;  // m1 to m4, in T_UNIT^k
+};
+
+struct NetMoments {
+  std::vector<LoadMoments> m_loads;
+};
+
+/// Computes the moments m1 to m_{num_moments} of all the nodes of a batch of
+/// up to Lanes trees with the given topology. The values are stored
+/// lane-minor: the value of node n of lane l is at [n * Lanes + l], and the
+/// moments are stored one after the other in moments. The moments are
+/// computed in double, whatever the type of the values.
+template<std::size_t Lanes, typename Res, typename Cap>
+void compute_moments_batch(
+    std::vector<std::uint32_t> const &parent,
+    std::vector<Res> const &res,
+    std::vector<Cap> const &cap,
+    std::size_t num_moments,
+    std::vector<double> &moments) {
+  std::size_t const num_nodes = parent.size();
+  std::size_t const size = num_nodes * Lanes;
+  moments.assign(num_moments * size, 0.0);
+
+  std::vector<double> prev(size, 1.0);  // m0
+  std::vector<double> charge(size);
+  for (std::size_t k = 0; k < num_moments; ++k) {
+    double *const curr = moments.data() + k * size;
+
+    for (std::size_t idx = 0; idx < size; ++idx) {
+      charge[idx] = cap[idx] * prev[idx];
+    }
+    for (std::size_t node = num_nodes; node-- > 1;) {
+      double *const dst = charge.data() + parent[node] * Lanes;
+      double const *const src = charge.data() + node * Lanes;
+      for (std::size_t lane = 0; lane < Lanes; ++lane) {
+        dst[lane] += src[lane];
+      }
+    }
+    for (std::size_t node = 1; node < num_nodes; ++node) {
+      double *const dst = curr + node * Lanes;
+      double const *const up = curr + parent[node] * Lanes;
+      Res const *const r = res.data() + node * Lanes;
+      double const *const q = charge.data() + node * Lanes;
+      for (std::size_t lane = 0; lane < Lanes; ++lane) {
+        dst[lane] = up[lane] - r[lane] * q[lane];
+      }
+    }
+
+    std::copy(curr, curr + size, prev.begin());
+  }
+}
+
+/// Computes the moments of the loads of a single net from the moments of its
+/// tree, stored as in compute_moments_batch
+inline NetMoments collect_load_moments(
+    DNet const &d_net,
+    std::size_t driver_idx,
+    RCTree const &tree,
+    std::vector<double> const &moments,
+    std::size_t lanes,
+    std::size_t lane,
+    std::size_t num_moments,
+    double rc_to_time) {
+  NetMoments net_moments;
+  std::size_t const size = tree.size() * lanes;
+  for (std::size_t idx = 0; idx < d_net.m_conns.size(); ++idx) {
+    if (idx == driver_idx) {
+      continue;
+    }
+    auto const &conn = d_net.m_conns[idx];
+    LoadMoments &load = net_moments.m_loads.emplace_back();
+    load.m_pin = conn.m_name;
+    load.m_moments.fill(0);
+    auto const node = tree.find(conn.m_name);
+    if (node == RCTree::NO_NODE) {
+      continue;
+    }
+    double scale = 1;
+    for (std::size_t k = 0; k < num_moments; ++k) {
+      scale *= rc_to_time;
+      load.m_moments[k] = moments[k * size + node * lanes + lane] * scale;
+    }
+  }
+  return net_moments;
+}
+
+/// Computes the first num_moments (1 to MAX_MOMENTS) transfer-function
+/// moments at the loads of all the D_NETs of the SPEF, in T_UNIT^k. Nets
+/// without a driver get no loads.
+inline std::vector<NetMoments> compute_load_moments(
+    SPEF const &spef,
+    std::size_t num_moments,
+    double rc_to_time,
+    BS::thread_pool &pool) {
+  if (num_moments == 0 || num_moments > MAX_MOMENTS) {
+    throw std::runtime_error(fmt::format(
+        "The number of moments must be between 1 and {}, not {}",
+        MAX_MOMENTS,
+        num_moments));
+  }
+  auto const &d_nets = spef.m_d_nets;
+  std::vector<NetMoments> result(d_nets.size());
+
+  // build the trees of all nets
+  std::vector<RCTree> trees(d_nets.size());
+  std::vector<std::size_t> drivers(d_nets.size());
+  pool.parallelize_loop(
+          d_nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              drivers[idx] = find_driver(d_nets[idx]);
+              if (drivers[idx] != d_nets[idx].m_conns.size()) {
+                trees[idx] = build_rc_tree(
+                    d_nets[idx],
+                    d_nets[idx].m_conns[drivers[idx]].m_name);
+              }
+            }
+          })
+      .wait();
+
+  // group the small nets by topology
+  std::map<std::vector<std::uint32_t>, std::vector<std::size_t>> groups;
+  std::vector<std::size_t> large_nets;
+  for (std::size_t idx = 0; idx < d_nets.size(); ++idx) {
+    if (drivers[idx] == d_nets[idx].m_conns.size()) {
+      continue;
+    }
+    if (trees[idx].size() <= MAX_BATCHED_NODES) {
+      groups[trees[idx].m_parent].push_back(idx);
+    } else {
+      large_nets.push_back(idx);
+    }
+  }
+
+  auto const process_batch = [&](std::vector<std::uint32_t> const &parent,
+                                 std::size_t const *nets,
+                                 std::size_t num_nets) {
+    std::size_t const num_nodes = parent.size();
+    std::vector<double> res(num_nodes * MOMENT_LANES, 0.0);
+    std::vector<double> cap(num_nodes * MOMENT_LANES, 0.0);
+    for (std::size_t lane = 0; lane < num_nets; ++lane) {
+      RCTree const &tree = trees[nets[lane]];
+      for (std::size_t node = 0; node < num_nodes; ++node) {
+        res[node * MOMENT_LANES + lane] = tree.m_res[node];
+        cap[node * MOMENT_LANES + lane] = tree.m_cap[node];
+      }
+    }
+
+    std::vector<double> moments;
+    compute_moments_batch<MOMENT_LANES>(parent, res, cap, num_moments, moments);
+
+    for (std::size_t lane = 0; lane < num_nets; ++lane) {
+      auto const net = nets[lane];
+      result[net] = collect_load_moments(
+          d_nets[net],
+          drivers[net],
+          trees[net],
+          moments,
+          MOMENT_LANES,
+          lane,
+          num_moments,
+          rc_to_time);
+    }
+  };
+
+  auto const process_large = [&](std::size_t net) {
+    RCTree const &tree = trees[net];
+    std::vector<double> moments;
+    compute_moments_batch<1>(
+        tree.m_parent,
+        tree.m_res,
+        tree.m_cap,
+        num_moments,
+        moments);
+    result[net] = collect_load_moments(
+        d_nets[net],
+        drivers[net],
+        tree,
+        moments,
+        1,
+        0,
+        num_moments,
+        rc_to_time);
+  };
+
+  for (auto const &[parent, nets] : groups) {
+    for (std::size_t first = 0; first < nets.size(); first += MOMENT_LANES) {
+      pool.push_task(
+          process_batch,
+          std::cref(parent),
+          nets.data() + first,
+          std::min(MOMENT_LANES, nets.size() - first));
+    }
+  }
+  for (std::size_t net : large_nets) {
+    pool.push_task(process_large, net);
+  }
+  pool.wait_for_tasks();
+
+  return result;
+}
+
+#endif  // SPEF_MOMENTS_HPP
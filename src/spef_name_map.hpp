@@ -0,0 +1,369 @@
+#ifndef SPEF_NAME_MAP_HPP
+#define SPEF_NAME_MAP_HPP
+
+#include "spef_node_name.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <fmt/core.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Returns the number of a *index, or 0 if it isn't a valid index
+inline std::uint64_t index_number(std::string_view index) {
+  std::uint64_t number{};
+  if (index.size() < 2 || index[0] != '*') {
+    return 0;
+  }
+  auto const [ptr, ec] =
+      std::from_chars(index.data() + 1, index.data() + index.size(), number);
+  return ec == std::errc() && ptr == index.data() + index.size() ? number : 0;
+}
+
+/// Returns the name with every *index reference replaced by lookup(index),
+/// which returns a pointer to the replacement, or nullptr to keep the index.
+/// An index can appear at the start of a name, or right after the pin
+/// delimiter, e.g. *12:*7 for pin *7 of instance *12.
+template<typename Lookup>
+std::string
+map_indices(std::string_view name, char pin_delim, Lookup const &lookup) {
+  std::string mapped;
+  mapped.reserve(name.size());
+  std::size_t pos = 0;
+  while (pos < name.size()) {
+    if (name[pos] == '*' && (pos == 0 || name[pos - 1] == pin_delim)) {
+      std::size_t end = pos + 1;
+      while (end < name.size() &&
+             std::isdigit(static_cast<unsigned char>(name[end])) != 0) {
+        ++end;
+      }
+      std::string const *replacement =
+          end == pos + 1 ? nullptr : lookup(name.substr(pos, end - pos));
+      if (replacement != nullptr) {
+        mapped += *replacement;
+        pos = end;
+        continue;
+      }
+    }
+    mapped += name[pos];
+    ++pos;
+  }
+  return mapped;
+}
+
+/// Expands the *index references of names through the *NAME_MAP of a SPEF
+class NameResolver {
+private:
+  SPEF const &m_spef;
+  char m_pin_delim;
+
+public:
+  explicit NameResolver(SPEF const &spef)
+      : m_spef(spef),
+        m_pin_delim(pin_delimiter(spef)) {}
+
+  [[nodiscard]] std::string resolve(std::string_view name) const {
+    return map_indices(
+        name,
+        m_pin_delim,
+        [this](std::string_view index) -> std::string const * {
+          auto const it = m_spef.m_name_map.find(std::string(index));
+          return it == m_spef.m_name_map.end() ? nullptr : &it->second;
+        });
+  }
+};
+
+/// Calls fn on every name of the net: its name, the names of its connections
+/// and internal nodes, and the nodes of its capacitors and resistors
+template<typename Fn>
+void for_each_name(DNet &d_net, Fn const &fn) {
+  fn(d_net.m_name);
+  for (auto &conn : d_net.m_conns) {
+    fn(conn.m_name);
+  }
+  for (auto &node : d_net.m_nodes) {
+    fn(node.m_name);
+  }
+  for (auto &ground_cap : d_net.m_ground_caps) {
+    fn(ground_cap.m_node);
+  }
+  for (auto &coupling_cap : d_net.m_coupling_caps) {
+    fn(coupling_cap.m_node1);
+    fn(coupling_cap.m_node2);
+  }
+  for (auto &res : d_net.m_resistances) {
+    fn(res.m_node1);
+    fn(res.m_node2);
+  }
+}
+
+/// Calls fn on every name of the net: its name, its driver and its loads
+template<typename Fn>
+void for_each_name(RNet &r_net, Fn const &fn) {
+  fn(r_net.m_name);
+  if (!r_net.m_driver.empty()) {
+    fn(r_net.m_driver);
+  }
+  for (auto &load : r_net.m_loads) {
+    fn(load.m_pin);
+  }
+}
+
+/// Calls fn on every name of the header: the power and ground nets and the
+/// ports
+template<typename Fn>
+void for_each_header_name(SPEF &spef, Fn const &fn) {
+  for (auto &power_net : spef.m_power_nets) {
+    fn(power_net);
+  }
+  for (auto &ground_net : spef.m_ground_nets) {
+    fn(ground_net);
+  }
+  for (auto &port : spef.m_ports) {
+    fn(port.m_name);
+  }
+}
+
+/// Expands *index references like NameResolver, but looks the indices up in a
+/// dense table, which is much faster than hashing every index. Maps whose
+/// indices are too sparse for a table fall back to the hash map.
+class DenseNameResolver {
+private:
+  NameResolver m_fallback;
+  char m_pin_delim;
+  std::vector<std::string const *> m_names;  // by index, nullptr if unused
+  bool m_dense{true};
+
+public:
+  explicit DenseNameResolver(SPEF const &spef)
+      : m_fallback(spef),
+        m_pin_delim(pin_delimiter(spef)) {
+    std::uint64_t max_index = 0;
+    for (auto const &[index, _] : spef.m_name_map) {
+      max_index = std::max(max_index, index_number(index));
+    }
+    if (max_index > 2 * spef.m_name_map.size() + 1024) {
+      m_dense = false;
+      return;
+    }
+    m_names.resize(max_index + 1, nullptr);
+    for (auto const &[index, name] : spef.m_name_map) {
+      m_names[index_number(index)] = &name;
+    }
+  }
+
+  [[nodiscard]] std::string resolve(std::string_view name) const {
+    if (!m_dense) {
+      return m_fallback.resolve(name);
+    }
+    return map_indices(
+        name,
+        m_pin_delim,
+        [this](std::string_view index) -> std::string const * {
+          auto const number = index_number(index);
+          return number < m_names.size() ? m_names[number] : nullptr;
+        });
+  }
+};
+
+namespace detail {
+/// A hash map from names to the position of their first use, split in shards
+/// with their own locks so that many threads can insert at the same time
+class ConcurrentNameTable {
+private:
+  static constexpr std::size_t NUM_SHARDS = 64;
+
+  struct Shard {
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::size_t> m_first_use;
+  };
+  std::array<Shard, NUM_SHARDS> m_shards;
+
+public:
+  void insert(std::string_view name, std::size_t position) {
+    auto &shard = m_shards[std::hash<std::string_view>{}(name) % NUM_SHARDS];
+    std::scoped_lock lock(shard.m_mutex);
+    auto const [it, inserted] =
+        shard.m_first_use.emplace(std::string(name), position);
+    if (!inserted) {
+      it->second = std::min(it->second, position);
+    }
+  }
+
+  /// Returns the names ordered by their first use, and then by name
+  [[nodiscard]] std::vector<std::string> ordered_names() {
+    std::vector<std::pair<std::size_t, std::string>> names;
+    for (auto &shard : m_shards) {
+      for (auto &[name, position] : shard.m_first_use) {
+        names.emplace_back(position, name);
+      }
+      shard.m_first_use.clear();
+    }
+    std::sort(names.begin(), names.end());
+
+    std::vector<std::string> ordered;
+    ordered.reserve(names.size());
+    for (auto &[_, name] : names) {
+      ordered.push_back(std::move(name));
+    }
+    return ordered;
+  }
+};
+
+/// Calls fn on the cell names of the driving cell (*D) attributes
+template<typename Fn>
+void for_each_driving_cell(
+    std::vector<std::unique_ptr<ConnAttr>> &conn_attrs,
+    Fn const &fn) {
+  for (auto &conn_attr : conn_attrs) {
+    if (conn_attr->m_type == ConnAttrType::DrivingCell) {
+      fn(static_cast<DrivingCellAttr *>(conn_attr.get())->m_cell);
+    }
+  }
+}
+}  // namespace detail
+
+/// Replaces the names of all the nets and instances of the SPEF with *index
+/// references, and replaces its *NAME_MAP with one that maps them. Existing
+/// references are resolved first. A name with a pin delimiter is mapped up to
+/// the delimiter, so *CAP and *RES nodes become references to their nets and
+/// pins become references to their instances, e.g. *12:3 and *7:A. The cells
+/// of the drivers are not mapped.
+///
+/// The names are collected into a concurrent hash map in parallel. They are
+/// numbered in the order of their first use, so the indices don't depend on
+/// the number of threads, and the names are then rewritten in parallel.
+template<typename Splitter>
+void build_name_map(SPEF &spef, BS::thread_pool &pool, Splitter) {
+  NameResolver const resolver(spef);
+  std::size_t const num_nets = spef.m_d_nets.size() + spef.m_r_nets.size();
+
+  // the header comes first, and the nets are numbered from 1
+  auto const for_each_net_name = [&spef](std::size_t idx, auto const &fn) {
+    if (idx < spef.m_d_nets.size()) {
+      for_each_name(spef.m_d_nets[idx], fn);
+    } else {
+      for_each_name(spef.m_r_nets[idx - spef.m_d_nets.size()], fn);
+    }
+  };
+
+  // the cells may refer to the *NAME_MAP that is replaced
+  auto const resolve = [&resolver](std::string &name) {
+    name = resolver.resolve(name);
+  };
+  auto const resolve_cells = [&](std::size_t idx) {
+    if (idx < spef.m_d_nets.size()) {
+      for (auto &conn : spef.m_d_nets[idx].m_conns) {
+        detail::for_each_driving_cell(conn.m_conn_attrs, resolve);
+      }
+    } else {
+      resolve(spef.m_r_nets[idx - spef.m_d_nets.size()].m_driver_cell);
+    }
+  };
+
+  detail::ConcurrentNameTable table;
+  for_each_header_name(spef, [&](std::string &name) {
+    name = resolver.resolve(name);
+    table.insert(Splitter::split(name).m_owner, 0);
+  });
+  for (auto &port : spef.m_ports) {
+    detail::for_each_driving_cell(port.m_conn_attrs, resolve);
+  }
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              for_each_net_name(idx, [&](std::string &name) {
+                name = resolver.resolve(name);
+                table.insert(Splitter::split(name).m_owner, idx + 1);
+              });
+              resolve_cells(idx);
+            }
+          })
+      .wait();
+
+  auto const names = table.ordered_names();
+  std::unordered_map<std::string_view, std::string> index_of;
+  index_of.reserve(names.size());
+  for (std::size_t idx = 0; idx < names.size(); ++idx) {
+    index_of.emplace(names[idx], fmt::format("*{}", idx + 1));
+  }
+
+  auto const rename = [&](std::string &name) {
+    auto const pos = Splitter::find_pin_delim(name);
+    auto const &index = index_of.at(std::string_view(name).substr(0, pos));
+    name = pos == std::string::npos ? index : index + name.substr(pos);
+  };
+  for_each_header_name(spef, rename);
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              for_each_net_name(idx, rename);
+            }
+          })
+      .wait();
+
+  spef.m_name_map.clear();
+  spef.m_name_map.reserve(names.size());
+  for (auto const &name : names) {
+    spef.m_name_map.emplace(index_of.at(name), name);
+  }
+}
+
+/// The node names are split with the delimiters of the SPEF
+inline void build_name_map(SPEF &spef, BS::thread_pool &pool) {
+  with_node_name_splitter(spef, [&](auto splitter) {
+    build_name_map(spef, pool, splitter);
+  });
+}
+
+/// Replaces all the *index references of the SPEF with the names they map to,
+/// in the nets, the ports, the power and ground nets and the driving cells,
+/// and clears its *NAME_MAP. The nets are expanded in parallel.
+inline void expand_name_map(SPEF &spef, BS::thread_pool &pool) {
+  if (spef.m_name_map.empty()) {
+    return;
+  }
+
+  DenseNameResolver const resolver(spef);
+  auto const expand = [&resolver](std::string &name) {
+    if (name.find('*') != std::string::npos) {
+      name = resolver.resolve(name);
+    }
+  };
+
+  for_each_header_name(spef, expand);
+  for (auto &port : spef.m_ports) {
+    detail::for_each_driving_cell(port.m_conn_attrs, expand);
+  }
+  pool.parallelize_loop(
+          spef.m_d_nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto &d_net = spef.m_d_nets[idx];
+              for_each_name(d_net, expand);
+              for (auto &conn : d_net.m_conns) {
+                detail::for_each_driving_cell(conn.m_conn_attrs, expand);
+              }
+            }
+          })
+      .wait();
+  for (auto &r_net : spef.m_r_nets) {
+    for_each_name(r_net, expand);
+    expand(r_net.m_driver_cell);
+  }
+
+  spef.m_name_map.clear();
+}
+
+#endif  // SPEF_NAME_MAP_HPP
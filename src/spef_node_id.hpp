@@ -0,0 +1,433 @@
+#ifndef SPEF_NODE_ID_HPP
+#define SPEF_NODE_ID_HPP
+
+#include "spef_node_name.hpp"
+#include "spef_structs.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <fmt/core.h>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// The nodes of the *CAP and *RES elements as 64-bit ids instead of strings.
+// Almost all nodes are either an internal node of a net, like net_1:8, or a
+// pin of an instance, like inst_0:ZN, so a node is a net and a node index, or
+// an instance and a pin, numbered in tables of the SPEF. The pin names are
+// shared by all the instances. The few other nodes, like ports, are numbered
+// in a table of their own. The nets are compacted one by one while the file is
+// parsed, so the node strings of only one net are alive at a time, and the
+// names are only re-created for the output.
+
+/// A node of a D_NET: a tag in the top 2 bits, the net, the instance or the
+/// external name in the next 32 bits, and the node index or the pin in the
+/// low 30 bits
+struct NodeId {
+  enum class Kind : std::uint8_t { Internal, Pin, External };
+
+  static constexpr std::uint32_t MAX_SUB = (std::uint32_t{1} << 30) - 1;
+
+  std::uint64_t m_bits{};
+
+  static NodeId internal(std::uint32_t net, std::uint32_t index) {
+    return make(Kind::Internal, net, index);
+  }
+  static NodeId pin(std::uint32_t instance, std::uint32_t pin) {
+    return make(Kind::Pin, instance, pin);
+  }
+  static NodeId external(std::uint32_t name) {
+    return make(Kind::External, name, 0);
+  }
+
+  [[nodiscard]] Kind kind() const { return static_cast<Kind>(m_bits >> 62); }
+  /// The net, the instance or the external name
+  [[nodiscard]] std::uint32_t owner() const {
+    return static_cast<std::uint32_t>(m_bits >> 30);
+  }
+  /// The node index or the pin
+  [[nodiscard]] std::uint32_t sub() const {
+    return static_cast<std::uint32_t>(m_bits) & MAX_SUB;
+  }
+
+  friend bool operator==(NodeId lhs, NodeId rhs) {
+    return lhs.m_bits == rhs.m_bits;
+  }
+  friend bool operator!=(NodeId lhs, NodeId rhs) { return !(lhs == rhs); }
+
+private:
+  static NodeId make(Kind kind, std::uint32_t owner, std::uint32_t sub) {
+    return {
+        (static_cast<std::uint64_t>(kind) << 62) |
+        (static_cast<std::uint64_t>(owner) << 30) | sub};
+  }
+};
+
+/// Names stored back to back in a single buffer, numbered from 0
+class NameTable {
+private:
+  std::string m_chars;
+  std::vector<std::size_t> m_offsets{0};
+
+public:
+  [[nodiscard]] std::uint32_t size() const {
+    return static_cast<std::uint32_t>(m_offsets.size() - 1);
+  }
+
+  [[nodiscard]] std::string_view operator[](std::uint32_t id) const {
+    return std::string_view(m_chars).substr(
+        m_offsets[id],
+        m_offsets[id + 1] - m_offsets[id]);
+  }
+
+  void push_back(std::string_view name) {
+    m_chars.append(name);
+    m_offsets.push_back(m_chars.size());
+  }
+
+  [[nodiscard]] std::size_t memory() const {
+    return m_chars.capacity() + m_offsets.capacity() * sizeof(std::size_t);
+  }
+};
+
+/// The tables that the NodeIds of a SPEF are numbered in. A node with a node
+/// index after its pin delimiter is an internal node of the net it is named
+/// after, and the nets are numbered in the order they are first used, as a
+/// node may refer to a net whose D_NET comes later in the file.
+struct NodeTables {
+  char m_pin_delim = ':';
+  NameTable m_nets;
+  NameTable m_instances;
+  NameTable m_pins;
+  NameTable m_externals;
+
+  /// Appends the name of the node to name
+  void append_name(NodeId node, std::string &name) const {
+    switch (node.kind()) {
+    case NodeId::Kind::Internal:
+      name.append(m_nets[node.owner()]);
+      name += m_pin_delim;
+      name.append(std::to_string(node.sub()));
+      break;
+    case NodeId::Kind::Pin:
+      name.append(m_instances[node.owner()]);
+      name += m_pin_delim;
+      name.append(m_pins[node.sub()]);
+      break;
+    case NodeId::Kind::External:
+      name.append(m_externals[node.owner()]);
+      break;
+    }
+  }
+
+  [[nodiscard]] std::string name(NodeId node) const {
+    std::string name;
+    append_name(node, name);
+    return name;
+  }
+
+  [[nodiscard]] std::size_t memory() const {
+    return m_nets.memory() + m_instances.memory() + m_pins.memory() +
+           m_externals.memory();
+  }
+};
+
+struct CompactGroundCap {
+  NodeId m_node;
+  cap_t m_cap;
+};
+
+struct CompactCouplingCap {
+  NodeId m_node1;
+  NodeId m_node2;
+  cap_t m_cap;
+};
+
+/// A *RES element. Its id is the number of the id, or NAMED_ID with the index
+/// of the id in CompactParasitics::m_res_ids if the id isn't written back the
+/// same as a number, like 01.
+struct CompactResistance {
+  static constexpr std::uint32_t NAMED_ID = std::uint32_t{1} << 31;
+
+  NodeId m_node1;
+  NodeId m_node2;
+  res_t m_res;
+  std::uint32_t m_id;
+};
+
+/// The *CAP and *RES elements of all the D_NETs of a SPEF, with their nodes as
+/// NodeIds. The elements of net n are at [offsets[n], offsets[n + 1]) of each
+/// array, in the order of the D_NET, so they line up with the sensitivities
+/// and the corner values of the net. The nets are numbered as in
+/// SPEF::m_d_nets.
+struct CompactParasitics {
+  NodeTables m_tables;
+  NameTable m_res_ids;
+  std::vector<std::size_t> m_ground_cap_offsets{0};
+  std::vector<std::size_t> m_coupling_cap_offsets{0};
+  std::vector<std::size_t> m_res_offsets{0};
+  std::vector<CompactGroundCap> m_ground_caps;
+  std::vector<CompactCouplingCap> m_coupling_caps;
+  std::vector<CompactResistance> m_resistances;
+
+  [[nodiscard]] std::size_t num_nets() const {
+    return m_ground_cap_offsets.size() - 1;
+  }
+
+  [[nodiscard]] std::size_t num_elements() const {
+    return m_ground_caps.size() + m_coupling_caps.size() +
+           m_resistances.size();
+  }
+
+  /// The id of the resistor as it is in the file
+  [[nodiscard]] std::string res_id(CompactResistance const &res) const {
+    if ((res.m_id & CompactResistance::NAMED_ID) != 0) {
+      return std::string{m_res_ids[res.m_id & ~CompactResistance::NAMED_ID]};
+    }
+    return std::to_string(res.m_id);
+  }
+
+  /// The bytes of the elements, their offsets and the name tables
+  [[nodiscard]] std::size_t memory() const {
+    return m_tables.memory() + m_res_ids.memory() +
+           (m_ground_cap_offsets.capacity() +
+            m_coupling_cap_offsets.capacity() + m_res_offsets.capacity()) *
+               sizeof(std::size_t) +
+           m_ground_caps.capacity() * sizeof(CompactGroundCap) +
+           m_coupling_caps.capacity() * sizeof(CompactCouplingCap) +
+           m_resistances.capacity() * sizeof(CompactResistance);
+  }
+};
+
+/// The bytes used by the *CAP and *RES elements of the D_NET, including the
+/// heap buffers of their strings
+inline std::size_t element_memory(DNet const &d_net) {
+  auto const heap = [](std::string const &str) {
+    // short strings are stored in the string itself
+    return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0;
+  };
+  std::size_t memory =
+      d_net.m_ground_caps.capacity() * sizeof(DNet::GroundCapacitance) +
+      d_net.m_coupling_caps.capacity() * sizeof(DNet::CouplingCapacitance) +
+      d_net.m_resistances.capacity() * sizeof(DNet::Resistance);
+  for (auto const &element : d_net.m_ground_caps) {
+    memory += heap(element.m_node);
+  }
+  for (auto const &element : d_net.m_coupling_caps) {
+    memory += heap(element.m_node1) + heap(element.m_node2);
+  }
+  for (auto const &element : d_net.m_resistances) {
+    memory +=
+        heap(element.m_id) + heap(element.m_node1) + heap(element.m_node2);
+  }
+  return memory;
+}
+
+namespace detail {
+/// Parses a number that is written back the same, without a sign or leading
+/// zeros, and that isn't larger than max_value
+inline bool parse_canonical_number(
+    std::string_view text,
+    std::uint32_t max_value,
+    std::uint32_t &value) {
+  if (text.empty() || (text[0] == '0' && text.size() > 1)) {
+    return false;
+  }
+  auto const [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && ptr == text.data() + text.size() &&
+         value <= max_value;
+}
+
+/// The ids of the names of a NameTable, to find the id of a name. The set
+/// only holds the ids, and hashes and compares the names they have in the
+/// table, so the names aren't stored twice. The name that is looked up has
+/// the id PROBE.
+class NameIds {
+private:
+  static constexpr std::uint32_t PROBE = UINT32_MAX;
+
+  struct Hash {
+    NameIds const *m_ids;
+    std::size_t operator()(std::uint32_t id) const {
+      return std::hash<std::string_view>{}(m_ids->name(id));
+    }
+  };
+
+  struct Equal {
+    NameIds const *m_ids;
+    bool operator()(std::uint32_t lhs, std::uint32_t rhs) const {
+      return m_ids->name(lhs) == m_ids->name(rhs);
+    }
+  };
+
+  NameTable *m_table;
+  std::string_view m_probe;
+  std::unordered_set<std::uint32_t, Hash, Equal> m_ids;
+
+  [[nodiscard]] std::string_view name(std::uint32_t id) const {
+    return id == PROBE ? m_probe : (*m_table)[id];
+  }
+
+public:
+  explicit NameIds(NameTable &table)
+      : m_table(&table), m_ids(0, Hash{this}, Equal{this}) {}
+  NameIds(NameIds const &) = delete;
+  NameIds &operator=(NameIds const &) = delete;
+
+  /// Returns the id of the name, and adds it to the table if it is new
+  std::uint32_t
+  id(std::string_view name, std::uint32_t max_id, char const *what) {
+    m_probe = name;
+    if (auto const it = m_ids.find(PROBE); it != m_ids.end()) {
+      return *it;
+    }
+    std::uint32_t const id = m_table->size();
+    if (id > max_id) {
+      throw std::runtime_error(fmt::format("Too many {} names", what));
+    }
+    m_table->push_back(name);
+    m_ids.insert(id);
+    return id;
+  }
+};
+}  // namespace detail
+
+/// Moves the *CAP and *RES elements of the D_NETs into a CompactParasitics
+/// while the SPEF is parsed. Every net is added at its *END, before it is
+/// appended to SPEF::m_d_nets, so the node strings of only one net are alive
+/// at a time. The names are numbered in the order they are first used in the
+/// file.
+class ParasiticsCompactor {
+private:
+  CompactParasitics m_compact;
+  detail::NameIds m_nets{m_compact.m_tables.m_nets};
+  detail::NameIds m_instances{m_compact.m_tables.m_instances};
+  detail::NameIds m_pins{m_compact.m_tables.m_pins};
+  detail::NameIds m_externals{m_compact.m_tables.m_externals};
+  std::size_t m_string_memory{};
+
+  template<typename Splitter>
+  NodeId node_id(std::string_view name) {
+    auto const parts = Splitter::split(name);
+    if (!parts.has_pin()) {
+      return NodeId::external(
+          m_externals.id(name, UINT32_MAX, "external node"));
+    }
+    std::uint32_t index{};
+    if (detail::parse_canonical_number(parts.m_pin, NodeId::MAX_SUB, index)) {
+      return NodeId::internal(
+          m_nets.id(parts.m_owner, UINT32_MAX, "net"),
+          index);
+    }
+    return NodeId::pin(
+        m_instances.id(parts.m_owner, UINT32_MAX, "instance"),
+        m_pins.id(parts.m_pin, NodeId::MAX_SUB, "pin"));
+  }
+
+  std::uint32_t res_id(std::string const &id) {
+    auto constexpr MAX_NUMBER = CompactResistance::NAMED_ID - 1;
+    std::uint32_t number{};
+    if (detail::parse_canonical_number(id, MAX_NUMBER, number)) {
+      return number;
+    }
+    auto &res_ids = m_compact.m_res_ids;
+    if (res_ids.size() > MAX_NUMBER) {
+      throw std::runtime_error("Too many resistor ids with leading zeros");
+    }
+    res_ids.push_back(id);
+    return CompactResistance::NAMED_ID | (res_ids.size() - 1);
+  }
+
+  template<typename Splitter>
+  void add(DNet &d_net) {
+    for (auto const &element : d_net.m_ground_caps) {
+      m_compact.m_ground_caps.push_back(
+          {node_id<Splitter>(element.m_node), element.m_cap});
+    }
+    for (auto const &element : d_net.m_coupling_caps) {
+      m_compact.m_coupling_caps.push_back(
+          {node_id<Splitter>(element.m_node1),
+           node_id<Splitter>(element.m_node2),
+           element.m_cap});
+    }
+    for (auto const &element : d_net.m_resistances) {
+      m_compact.m_resistances.push_back(
+          {node_id<Splitter>(element.m_node1),
+           node_id<Splitter>(element.m_node2),
+           element.m_res,
+           res_id(element.m_id)});
+    }
+    m_compact.m_ground_cap_offsets.push_back(m_compact.m_ground_caps.size());
+    m_compact.m_coupling_cap_offsets.push_back(
+        m_compact.m_coupling_caps.size());
+    m_compact.m_res_offsets.push_back(m_compact.m_resistances.size());
+  }
+
+public:
+  ParasiticsCompactor() = default;
+  ParasiticsCompactor(ParasiticsCompactor const &) = delete;
+  ParasiticsCompactor &operator=(ParasiticsCompactor const &) = delete;
+
+  /// Moves the elements of the next D_NET of the SPEF into the compact
+  /// arrays, and frees their strings. The name of the net stays, as the *N
+  /// lines and the other nets refer to it.
+  void add(SPEF const &spef, DNet &d_net) {
+    m_compact.m_tables.m_pin_delim = pin_delimiter(spef);
+    m_string_memory += element_memory(d_net);
+    with_node_name_splitter(spef, [&](auto splitter) {
+      add<decltype(splitter)>(d_net);
+    });
+    // assigning {} would keep the capacity of the vectors
+    std::vector<DNet::GroundCapacitance>().swap(d_net.m_ground_caps);
+    std::vector<DNet::CouplingCapacitance>().swap(d_net.m_coupling_caps);
+    std::vector<DNet::Resistance>().swap(d_net.m_resistances);
+  }
+
+  [[nodiscard]] CompactParasitics const &compact() const { return m_compact; }
+
+  /// The bytes that the elements of the added nets used as strings
+  [[nodiscard]] std::size_t string_memory() const { return m_string_memory; }
+};
+
+/// Re-creates the elements of the D_NET net, with their node names
+inline void restore_parasitics(
+    CompactParasitics const &compact,
+    std::size_t net,
+    DNet &d_net) {
+  auto const &tables = compact.m_tables;
+  d_net.m_ground_caps.clear();
+  for (auto idx = compact.m_ground_cap_offsets[net];
+       idx < compact.m_ground_cap_offsets[net + 1];
+       ++idx) {
+    auto const &element = compact.m_ground_caps[idx];
+    d_net.m_ground_caps.push_back(
+        {tables.name(element.m_node), element.m_cap});
+  }
+  d_net.m_coupling_caps.clear();
+  for (auto idx = compact.m_coupling_cap_offsets[net];
+       idx < compact.m_coupling_cap_offsets[net + 1];
+       ++idx) {
+    auto const &element = compact.m_coupling_caps[idx];
+    d_net.m_coupling_caps.push_back(
+        {tables.name(element.m_node1),
+         tables.name(element.m_node2),
+         element.m_cap});
+  }
+  d_net.m_resistances.clear();
+  for (auto idx = compact.m_res_offsets[net];
+       idx < compact.m_res_offsets[net + 1];
+       ++idx) {
+    auto const &element = compact.m_resistances[idx];
+    d_net.m_resistances.push_back(
+        {compact.res_id(element),
+         tables.name(element.m_node1),
+         tables.name(element.m_node2),
+         element.m_res});
+  }
+}
+
+#endif  // SPEF_NODE_ID_HPP
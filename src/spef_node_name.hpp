@@ -0,0 +1,108 @@
+#ifndef SPEF_NODE_NAME_HPP
+#define SPEF_NODE_NAME_HPP
+
+#include "spef_structs.hpp"
+#include <cstddef>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <string_view>
+
+/// The pin delimiter of the SPEF, ':' if it doesn't declare one
+inline char pin_delimiter(SPEF const &spef) {
+  return spef.m_pin_delim_def == '\0' ? ':' : spef.m_pin_delim_def;
+}
+
+/// The hierarchy divider of the SPEF, '/' if it doesn't declare one
+inline char hierarchy_divider(SPEF const &spef) {
+  return spef.m_hierarchy_div_def == '\0' ? '/' : spef.m_hierarchy_div_def;
+}
+
+/// A node name split at its pin delimiter: the name of an instance or a net,
+/// and the name of a pin or the index of an internal node. A name without a
+/// pin delimiter, like a port or a bare net, is all owner.
+struct NodeNameParts {
+  std::string_view m_owner;
+  std::string_view m_pin;
+
+  [[nodiscard]] bool has_pin() const { return m_pin.data() != nullptr; }
+};
+
+/// Splits node names with the delimiters of a SPEF, which are known at
+/// compile time, so the loop over the characters compares them with
+/// constants. The pin delimiter is the last unescaped one that isn't followed
+/// by a hierarchy divider, as pins and node indices aren't hierarchical.
+template<char PIN_DELIM, char HIER_DIV>
+struct NodeNameSplitter {
+  static constexpr char pin_delim = PIN_DELIM;
+  static constexpr char hier_div = HIER_DIV;
+
+  /// Returns the position of the pin delimiter, or std::string_view::npos
+  static std::size_t find_pin_delim(std::string_view name) {
+    for (std::size_t pos = name.size(); pos-- > 1;) {
+      char const chr = name[pos];
+      if (chr == PIN_DELIM && name[pos - 1] != '\\') {
+        return pos;
+      }
+      if constexpr (HIER_DIV != PIN_DELIM) {
+        if (chr == HIER_DIV && name[pos - 1] != '\\') {
+          return std::string_view::npos;
+        }
+      }
+    }
+    return std::string_view::npos;
+  }
+
+  static NodeNameParts split(std::string_view name) {
+    auto const pos = find_pin_delim(name);
+    if (pos == std::string_view::npos) {
+      return {name, {}};
+    }
+    return {name.substr(0, pos), name.substr(pos + 1)};
+  }
+};
+
+/// The splitter of the default delimiters
+using DefaultNodeNameSplitter = NodeNameSplitter<':', '/'>;
+
+namespace detail {
+template<char PIN_DELIM, typename Fn>
+decltype(auto) with_hierarchy_divider(char hier_div, Fn &&fn) {
+  switch (hier_div) {
+  case '.':
+    return fn(NodeNameSplitter<PIN_DELIM, '.'>{});
+  case '/':
+    return fn(NodeNameSplitter<PIN_DELIM, '/'>{});
+  case ':':
+    return fn(NodeNameSplitter<PIN_DELIM, ':'>{});
+  case '|':
+    return fn(NodeNameSplitter<PIN_DELIM, '|'>{});
+  default:
+    throw std::runtime_error(
+        fmt::format("Unsupported hierarchy divider: {}", hier_div));
+  }
+}
+}  // namespace detail
+
+/// Calls fn with the NodeNameSplitter of the delimiters of the SPEF, and
+/// returns its result. All the combinations of the delimiters . / : | are
+/// instantiated, so the delimiters are dispatched once per file, and the code
+/// of fn has them as constants.
+template<typename Fn>
+decltype(auto) with_node_name_splitter(SPEF const &spef, Fn &&fn) {
+  char const hier_div = hierarchy_divider(spef);
+  switch (pin_delimiter(spef)) {
+  case '.':
+    return detail::with_hierarchy_divider<'.'>(hier_div, fn);
+  case '/':
+    return detail::with_hierarchy_divider<'/'>(hier_div, fn);
+  case ':':
+    return detail::with_hierarchy_divider<':'>(hier_div, fn);
+  case '|':
+    return detail::with_hierarchy_divider<'|'>(hier_div, fn);
+  default:
+    throw std::runtime_error(
+        fmt::format("Unsupported pin delimiter: {}", pin_delimiter(spef)));
+  }
+}
+
+#endif  // SPEF_NODE_NAME_HPP
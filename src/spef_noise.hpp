@@ -0,0 +1,236 @@
+#ifndef SPEF_NOISE_HPP
+#define SPEF_NOISE_HPP
+
+#include "spef_coupling.hpp"
+#include "spef_rc_tree.hpp"
+#include "spef_reduce.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct NoiseOptions {
+  std::size_t m_top{20};  // the number of victims to report
+  // the transition time of the aggressors, in T_UNIT. If set, the glitch is
+  // also bounded by the RC of the victim (see estimate_glitch)
+  double m_slew{0};
+};
+
+/// The estimated glitch of a victim net, as a fraction of the supply voltage
+struct VictimNoise {
+  std::uint32_t m_net;  // index in SPEF::m_d_nets
+  double m_glitch;
+  cap_t m_coupling_cap;  // to other nets
+  cap_t m_total_cap;     // ground and coupling
+};
+
+namespace detail {
+/// A coupling cap of a *CAP section between a node of the net and a node of
+/// another net
+struct ForeignCoupling {
+  std::uint32_t m_other;          // the other net
+  std::string_view m_node;        // on the net
+  std::string_view m_other_node;  // on the other net
+  cap_t m_cap;
+};
+
+/// Returns the coupling caps of the *CAP section of the net to other nets,
+/// sorted by the other net
+inline std::vector<ForeignCoupling> foreign_couplings(
+    DNet const &d_net,
+    std::uint32_t net,
+    NodeNetMap const &node_nets) {
+  std::vector<ForeignCoupling> foreign;
+  for (auto const &coupling_cap : d_net.m_coupling_caps) {
+    std::string_view node = coupling_cap.m_node1;
+    std::string_view other_node = coupling_cap.m_node2;
+    auto other = node_nets.net_of(other_node);
+    if (other == net) {
+      std::swap(node, other_node);
+      other = node_nets.net_of(other_node);
+    }
+    if (other != net && other != NodeNetMap::NO_NET) {
+      foreign.push_back({other, node, other_node, coupling_cap.m_cap});
+    }
+  }
+  std::stable_sort(foreign.begin(), foreign.end(), [](auto lhs, auto rhs) {
+    return lhs.m_other < rhs.m_other;
+  });
+  return foreign;
+}
+}  // namespace detail
+
+/// Estimates the glitch that the aggressors of the net induce on it when they
+/// all switch together and the victim is held quiet by its driver.
+///
+/// The coupling cap to every aggressor is the one of the coupling graph, in
+/// which a pair of nets listed by one net only is coupled both ways. own are
+/// the coupling caps to other nets of the *CAP section of the net, and
+/// listed_by_others those of the *CAP sections of the other nets to the net,
+/// as seen from the net, both sorted by the other net. They give the nodes of
+/// the net that the caps are on, from the side that lists the larger cap.
+///
+/// The charge-sharing bound is the coupling cap to other nets over the total
+/// cap of the net. If a slew is given, the glitch is also bounded by the
+/// coupled current times the resistance that holds the node to the driver,
+/// sum(R_k * Cc_k) / slew, where R_k is the resistance from the driver to the
+/// node of the k-th coupling cap, and the smaller of the two is returned.
+/// Coupling caps between nodes of the same net or to unknown nets aren't
+/// noise, and are counted only in the total cap.
+inline VictimNoise estimate_glitch(
+    DNet const &d_net,
+    std::uint32_t net,
+    CouplingGraph const &graph,
+    std::vector<detail::ForeignCoupling> const &own,
+    std::vector<detail::ForeignCoupling> const &listed_by_others,
+    NoiseOptions const &options,
+    double rc_to_time) {
+  VictimNoise noise{net, 0, 0, 0};
+  for (auto const &ground_cap : d_net.m_ground_caps) {
+    noise.m_total_cap += ground_cap.m_cap;
+  }
+  for (auto const &coupling_cap : d_net.m_coupling_caps) {
+    noise.m_total_cap += coupling_cap.m_cap;
+  }
+  for (auto const &coupling : own) {
+    noise.m_total_cap -= coupling.m_cap;
+  }
+  graph.for_each_neighbor(net, [&](std::uint32_t, cap_t cap) {
+    noise.m_coupling_cap += cap;
+  });
+  noise.m_total_cap += noise.m_coupling_cap;
+  if (noise.m_total_cap <= 0) {
+    return noise;
+  }
+  noise.m_glitch = noise.m_coupling_cap / noise.m_total_cap;
+
+  auto const driver = find_driver(d_net);
+  if (options.m_slew <= 0 || noise.m_coupling_cap <= 0 ||
+      driver == d_net.m_conns.size()) {
+    return noise;
+  }
+
+  // the nodes of the coupling caps to every aggressor, from the side that
+  // lists the larger cap, which is the cap of the graph
+  auto const sum = [](auto first, auto last) {
+    cap_t total{};
+    for (; first != last; ++first) {
+      total += first->m_cap;
+    }
+    return total;
+  };
+  std::vector<std::pair<std::string_view, cap_t>> foreign;
+  auto own_it = own.begin();
+  auto others_it = listed_by_others.begin();
+  while (own_it != own.end() || others_it != listed_by_others.end()) {
+    std::uint32_t const other = std::min(
+        own_it != own.end() ? own_it->m_other : NodeNetMap::NO_NET,
+        others_it != listed_by_others.end() ? others_it->m_other
+                                            : NodeNetMap::NO_NET);
+    auto const is_past = [other](detail::ForeignCoupling const &coupling) {
+      return coupling.m_other != other;
+    };
+    auto const own_last = std::find_if(own_it, own.end(), is_past);
+    auto const others_last =
+        std::find_if(others_it, listed_by_others.end(), is_past);
+    bool const others_larger =
+        sum(others_it, others_last) > sum(own_it, own_last);
+    auto first = others_larger ? others_it : own_it;
+    auto const last = others_larger ? others_last : own_last;
+    for (; first != last; ++first) {
+      foreign.emplace_back(first->m_node, first->m_cap);
+    }
+    own_it = own_last;
+    others_it = others_last;
+  }
+
+  RCTree const tree = build_rc_tree(d_net, d_net.m_conns[driver].m_name);
+  std::vector<double> path_res(tree.size(), 0.0);
+  for (std::size_t node = 1; node < tree.size(); ++node) {
+    path_res[node] = path_res[tree.m_parent[node]] + tree.m_res[node];
+  }
+  double rc = 0;
+  for (auto const &[node, cap] : foreign) {
+    auto const idx = tree.find(node);
+    if (idx != RCTree::NO_NODE) {
+      rc += path_res[idx] * cap;
+    }
+  }
+  noise.m_glitch =
+      std::min(noise.m_glitch, rc * rc_to_time / options.m_slew);
+  return noise;
+}
+
+/// Estimates the glitch of every D_NET of the SPEF in parallel, and returns the
+/// options.m_top noisiest ones, noisiest first
+inline std::vector<VictimNoise> estimate_noise(
+    SPEF const &spef,
+    NoiseOptions const &options,
+    BS::thread_pool &pool) {
+  NodeNetMap const node_nets(spef);
+  double const rc_to_time = rc_to_time_factor(spef);
+  std::size_t const num_nets = spef.m_d_nets.size();
+  CouplingGraph const graph = build_coupling_graph(spef, pool);
+
+  std::vector<std::vector<detail::ForeignCoupling>> own(num_nets);
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              own[idx] = detail::foreign_couplings(
+                  spef.m_d_nets[idx],
+                  static_cast<std::uint32_t>(idx),
+                  node_nets);
+            }
+          })
+      .wait();
+  // the nets are visited in increasing order, so the couplings listed by
+  // others are sorted by the other net
+  std::vector<std::vector<detail::ForeignCoupling>> listed_by_others(
+      num_nets);
+  for (std::size_t idx = 0; idx < num_nets; ++idx) {
+    for (auto const &coupling : own[idx]) {
+      listed_by_others[coupling.m_other].push_back(
+          {static_cast<std::uint32_t>(idx),
+           coupling.m_other_node,
+           coupling.m_node,
+           coupling.m_cap});
+    }
+  }
+
+  std::vector<VictimNoise> noises(num_nets);
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              noises[idx] = estimate_glitch(
+                  spef.m_d_nets[idx],
+                  static_cast<std::uint32_t>(idx),
+                  graph,
+                  own[idx],
+                  listed_by_others[idx],
+                  options,
+                  rc_to_time);
+            }
+          })
+      .wait();
+
+  // ties are broken by the order of the nets, so the result is deterministic
+  auto const noisier = [](VictimNoise const &lhs, VictimNoise const &rhs) {
+    return lhs.m_glitch != rhs.m_glitch ? lhs.m_glitch > rhs.m_glitch
+                                        : lhs.m_net < rhs.m_net;
+  };
+  std::size_t const top = std::min(options.m_top, noises.size());
+  std::partial_sort(
+      noises.begin(),
+      noises.begin() + static_cast<std::ptrdiff_t>(top),
+      noises.end(),
+      noisier);
+  noises.resize(top);
+  return noises;
+}
+
+#endif  // SPEF_NOISE_HPP
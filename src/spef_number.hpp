@@ -0,0 +1,160 @@
+#ifndef SPEF_NUMBER_HPP
+#define SPEF_NUMBER_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <type_traits>
+
+// A parser for the numbers of SPEF files, which are almost all short decimals
+// like 0.0141, without an exponent. Their digits are validated and converted
+// eight at a time in a 64-bit register (SWAR), and the value is the mantissa
+// divided by a power of ten. When both are exactly representable, that single
+// division is correctly rounded, so the value is the same as the one of
+// std::from_chars (Clinger's fast path). All the other numbers, with an
+// exponent, a '+' sign or too many digits, are parsed by std::from_chars.
+
+namespace detail {
+template<typename T>
+struct FastPathLimits;
+
+template<>
+struct FastPathLimits<double> {
+  static constexpr std::uint64_t MAX_MANTISSA = std::uint64_t{1} << 53;
+  static constexpr int MAX_POW10 = 22;
+};
+
+template<>
+struct FastPathLimits<float> {
+  static constexpr std::uint64_t MAX_MANTISSA = std::uint64_t{1} << 24;
+  static constexpr int MAX_POW10 = 10;
+};
+
+template<typename T>
+constexpr T pow10(int exp) {
+  T value = 1;
+  for (int idx = 0; idx < exp; ++idx) {
+    value *= 10;
+  }
+  return value;
+}
+
+template<typename T>
+struct Pow10Table {
+  static constexpr int SIZE = FastPathLimits<T>::MAX_POW10 + 1;
+  T m_values[SIZE];
+
+  constexpr Pow10Table() : m_values{} {
+    for (int idx = 0; idx < SIZE; ++idx) {
+      m_values[idx] = pow10<T>(idx);
+    }
+  }
+};
+
+/// Loads 8 characters, the first one in the lowest byte
+inline std::uint64_t load_8_chars(char const *pos) {
+  std::uint64_t chars{};
+  std::memcpy(&chars, pos, sizeof(chars));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  chars = __builtin_bswap64(chars);
+#endif
+  return chars;
+}
+
+/// Whether all the 8 characters are digits. A byte is a digit if its high
+/// nibble is 3 and adding 6 to it doesn't carry into the high nibble.
+inline bool are_8_digits(std::uint64_t chars) {
+  return ((chars & 0xF0F0F0F0F0F0F0F0) |
+          (((chars + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+/// Converts 8 digits to their value, combining pairs of digits, then pairs of
+/// pairs, and then the two halves
+inline std::uint32_t convert_8_digits(std::uint64_t chars) {
+  constexpr std::uint64_t MASK = 0x000000FF000000FF;
+  constexpr std::uint64_t MUL1 = 100 + (std::uint64_t{1000000} << 32);
+  constexpr std::uint64_t MUL2 = 1 + (std::uint64_t{10000} << 32);
+  chars -= 0x3030303030303030;
+  chars = (chars * 10) + (chars >> 8);
+  chars = (((chars & MASK) * MUL1) + (((chars >> 16) & MASK) * MUL2)) >> 32;
+  return static_cast<std::uint32_t>(chars);
+}
+
+inline bool is_digit(char chr) {
+  return static_cast<unsigned char>(chr - '0') < 10;
+}
+
+/// Appends the digits at pos to mantissa, and returns the end of the digits
+inline char const *
+parse_digits(char const *pos, char const *last, std::uint64_t &mantissa) {
+  while (last - pos >= 8) {
+    auto const chars = load_8_chars(pos);
+    if (!are_8_digits(chars)) {
+      break;
+    }
+    mantissa = mantissa * 100000000 + convert_8_digits(chars);
+    pos += 8;
+  }
+  while (pos != last && is_digit(*pos)) {
+    mantissa = mantissa * 10 + static_cast<std::uint64_t>(*pos - '0');
+    ++pos;
+  }
+  return pos;
+}
+
+/// Parses [first, last) if it starts with a number that is in the fast path.
+/// Returns nullptr otherwise.
+template<typename T>
+char const *parse_fast_path(char const *first, char const *last, T &value) {
+  using Limits = FastPathLimits<T>;
+  static constexpr Pow10Table<T> POW10{};
+
+  char const *pos = first;
+  bool const negative = pos != last && *pos == '-';
+  pos += negative ? 1 : 0;
+
+  std::uint64_t mantissa = 0;
+  char const *const int_begin = pos;
+  pos = parse_digits(pos, last, mantissa);
+  auto num_digits = pos - int_begin;
+  std::ptrdiff_t num_fraction_digits = 0;
+  if (pos != last && *pos == '.') {
+    char const *const fraction_begin = ++pos;
+    pos = parse_digits(pos, last, mantissa);
+    num_fraction_digits = pos - fraction_begin;
+    num_digits += num_fraction_digits;
+  }
+
+  // the mantissa may have overflowed with more than 19 digits
+  if (num_digits == 0 || num_digits > 19 ||
+      (pos != last && (*pos == 'e' || *pos == 'E')) ||
+      mantissa > Limits::MAX_MANTISSA ||
+      num_fraction_digits > Limits::MAX_POW10) {
+    return nullptr;
+  }
+
+  value = static_cast<T>(mantissa) / POW10.m_values[num_fraction_digits];
+  if (negative) {
+    value = -value;
+  }
+  return pos;
+}
+}  // namespace detail
+
+/// A drop-in replacement of std::from_chars for the numbers of SPEF files,
+/// with the same results, that is faster for the usual decimals
+template<typename T>
+std::from_chars_result
+parse_number(char const *first, char const *last, T &value) {
+  if constexpr (std::is_same_v<T, double> || std::is_same_v<T, float>) {
+    if (char const *const end = detail::parse_fast_path(first, last, value)) {
+      return {end, std::errc{}};
+    }
+  }
+  return std::from_chars(first, last, value);
+}
+
+#endif  // SPEF_NUMBER_HPP
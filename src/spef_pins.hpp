@@ -0,0 +1,303 @@
+#ifndef SPEF_PINS_HPP
+#define SPEF_PINS_HPP
+
+#include "spef_node_name.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+/// What a pin does on its net, from the direction of its *CONN entry
+enum struct PinRole {
+  Driver,
+  Load,
+  Both
+};
+
+inline PinRole pin_role(DirType direction) {
+  switch (direction) {
+  case DirType::Output:
+    return PinRole::Driver;
+  case DirType::Input:
+    return PinRole::Load;
+  case DirType::Bidirectional:
+    break;
+  }
+  return PinRole::Both;
+}
+
+/// The instance pins of a design, from the *I entries of the *CONN sections of
+/// all the D_NETs. The instances are sorted by name, and the pins of instance
+/// i are [m_pin_offsets[i], m_pin_offsets[i + 1]) of the pin arrays, sorted by
+/// name, so finding an instance or a pin is a binary search and the pins of an
+/// instance are a range. The pins of net n, in the order of its *CONN
+/// section, are [m_net_pin_offsets[n], m_net_pin_offsets[n + 1]) of
+/// m_net_pins. The nets are numbered as in SPEF::m_d_nets, and the names point
+/// into the strings of the SPEF. Ports aren't instance pins and aren't
+/// included.
+struct PinDatabase {
+  static constexpr std::uint32_t NOT_FOUND = static_cast<std::uint32_t>(-1);
+
+  std::vector<std::string_view> m_instances;
+  std::vector<std::size_t> m_pin_offsets;
+  std::vector<std::string_view> m_pin_names;
+  std::vector<std::uint32_t> m_pin_nets;
+  std::vector<DirType> m_pin_directions;
+  std::vector<std::size_t> m_net_pin_offsets;
+  std::vector<std::uint32_t> m_net_pins;
+  std::size_t m_num_unsplit{};  // *I names without a pin delimiter
+  // the Splitter::split of the delimiters of the SPEF
+  NodeNameParts (*m_split)(std::string_view) = nullptr;
+
+  [[nodiscard]] std::size_t num_instances() const {
+    return m_instances.size();
+  }
+  [[nodiscard]] std::size_t num_pins() const { return m_pin_names.size(); }
+
+  /// Returns the index of the instance, or NOT_FOUND
+  [[nodiscard]] std::uint32_t find_instance(std::string_view name) const {
+    auto const it =
+        std::lower_bound(m_instances.begin(), m_instances.end(), name);
+    return it != m_instances.end() && *it == name
+               ? static_cast<std::uint32_t>(it - m_instances.begin())
+               : NOT_FOUND;
+  }
+
+  /// Returns the index of the pin of the instance, or NOT_FOUND
+  [[nodiscard]] std::uint32_t
+  find_pin(std::uint32_t instance, std::string_view pin) const {
+    auto const first = m_pin_names.begin() + m_pin_offsets[instance];
+    auto const last = m_pin_names.begin() + m_pin_offsets[instance + 1];
+    auto const it = std::lower_bound(first, last, pin);
+    return it != last && *it == pin
+               ? static_cast<std::uint32_t>(it - m_pin_names.begin())
+               : NOT_FOUND;
+  }
+
+  /// Returns the index of the pin named like in the SPEF, e.g. inst:A, or
+  /// NOT_FOUND
+  [[nodiscard]] std::uint32_t find_pin(std::string_view name) const {
+    auto const parts = m_split(name);
+    if (!parts.has_pin()) {
+      return NOT_FOUND;
+    }
+    auto const instance = find_instance(parts.m_owner);
+    return instance == NOT_FOUND ? NOT_FOUND : find_pin(instance, parts.m_pin);
+  }
+
+  /// Returns the index of the D_NET that the pin is on, or NOT_FOUND
+  [[nodiscard]] std::uint32_t net_of(std::string_view pin_name) const {
+    auto const pin = find_pin(pin_name);
+    return pin == NOT_FOUND ? NOT_FOUND : m_pin_nets[pin];
+  }
+
+  /// Returns the index of the instance of the pin
+  [[nodiscard]] std::uint32_t instance_of(std::uint32_t pin) const {
+    auto const it =
+        std::upper_bound(m_pin_offsets.begin(), m_pin_offsets.end(), pin);
+    return static_cast<std::uint32_t>(it - m_pin_offsets.begin() - 1);
+  }
+
+  [[nodiscard]] PinRole role(std::uint32_t pin) const {
+    return pin_role(m_pin_directions[pin]);
+  }
+
+  /// Calls fn(pin) for the pins of the instance
+  template<typename Fn>
+  void for_each_pin(std::uint32_t instance, Fn const &fn) const {
+    for (auto pin = m_pin_offsets[instance]; pin < m_pin_offsets[instance + 1];
+         ++pin) {
+      fn(static_cast<std::uint32_t>(pin));
+    }
+  }
+
+  /// Calls fn(pin) for the pins on the net that drive it, bidirectional ones
+  /// included
+  template<typename Fn>
+  void for_each_driver(std::uint32_t net, Fn const &fn) const {
+    for_each_net_pin(net, PinRole::Load, fn);
+  }
+
+  /// Calls fn(pin) for the pins on the net that it drives, bidirectional ones
+  /// included
+  template<typename Fn>
+  void for_each_load(std::uint32_t net, Fn const &fn) const {
+    for_each_net_pin(net, PinRole::Driver, fn);
+  }
+
+private:
+  template<typename Fn>
+  void
+  for_each_net_pin(std::uint32_t net, PinRole skipped, Fn const &fn) const {
+    for (auto idx = m_net_pin_offsets[net]; idx < m_net_pin_offsets[net + 1];
+         ++idx) {
+      if (role(m_net_pins[idx]) != skipped) {
+        fn(m_net_pins[idx]);
+      }
+    }
+  }
+};
+
+namespace detail {
+/// Sorts the values in chunks in parallel, and then merges pairs of sorted
+/// ranges in parallel, doubling their size in every round
+template<typename T, typename Less>
+void parallel_sort(std::vector<T> &values, Less less, BS::thread_pool &pool) {
+  std::size_t const num_chunks = std::max<std::size_t>(
+      1,
+      std::min<std::size_t>(pool.get_thread_count(), values.size() / 4096));
+  auto const bound = [&](std::size_t chunk) {
+    return values.begin() + static_cast<std::ptrdiff_t>(
+                                values.size() * chunk / num_chunks);
+  };
+  pool.parallelize_loop(
+          num_chunks,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t chunk = first; chunk < last; ++chunk) {
+              std::sort(bound(chunk), bound(chunk + 1), less);
+            }
+          })
+      .wait();
+  for (std::size_t width = 1; width < num_chunks; width *= 2) {
+    std::size_t const num_pairs = (num_chunks + 2 * width - 1) / (2 * width);
+    pool.parallelize_loop(
+            num_pairs,
+            [&](std::size_t const first, std::size_t const last) {
+              for (std::size_t pair = first; pair < last; ++pair) {
+                auto const begin = 2 * pair * width;
+                std::inplace_merge(
+                    bound(begin),
+                    bound(std::min(begin + width, num_chunks)),
+                    bound(std::min(begin + 2 * width, num_chunks)),
+                    less);
+              }
+            })
+        .wait();
+  }
+}
+
+/// An *I entry of a *CONN section, split into its instance and pin
+struct PinRecord {
+  std::string_view m_instance;
+  std::string_view m_pin;
+  std::uint32_t m_net;
+  DirType m_direction;
+  std::size_t m_conn;  // the position in SPEF order, in m_net_pins
+};
+}  // namespace detail
+
+/// Builds the pin database of the D_NETs of the SPEF. The *I entries of every
+/// net are split into flat arrays at the offsets of a prefix sum, in parallel,
+/// and then sorted by instance and pin with a parallel merge sort. The
+/// instances and their pin ranges are found in a single sweep of the sorted
+/// pins, and the pins of the nets are scattered back in parallel.
+inline PinDatabase build_pin_database(SPEF const &spef, BS::thread_pool &pool) {
+  PinDatabase db;
+  db.m_split = with_node_name_splitter(spef, [](auto splitter) {
+    return &decltype(splitter)::split;
+  });
+  std::size_t const num_nets = spef.m_d_nets.size();
+
+  std::vector<std::size_t> num_pins(num_nets);
+  std::vector<std::size_t> num_unsplit(num_nets);
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              for (auto const &conn : spef.m_d_nets[idx].m_conns) {
+                if (conn.m_type != ConnType::InternalConnection) {
+                  continue;
+                }
+                if (db.m_split(conn.m_name).has_pin()) {
+                  ++num_pins[idx];
+                } else {
+                  ++num_unsplit[idx];
+                }
+              }
+            }
+          })
+      .wait();
+  db.m_net_pin_offsets.resize(num_nets + 1);
+  for (std::size_t idx = 0; idx < num_nets; ++idx) {
+    db.m_net_pin_offsets[idx + 1] = db.m_net_pin_offsets[idx] + num_pins[idx];
+    db.m_num_unsplit += num_unsplit[idx];
+  }
+  std::size_t const total = db.m_net_pin_offsets[num_nets];
+  if (total >= PinDatabase::NOT_FOUND) {
+    throw std::runtime_error("Too many pins");
+  }
+
+  std::vector<detail::PinRecord> records(total);
+  pool.parallelize_loop(
+          num_nets,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto pos = db.m_net_pin_offsets[idx];
+              for (auto const &conn : spef.m_d_nets[idx].m_conns) {
+                if (conn.m_type != ConnType::InternalConnection) {
+                  continue;
+                }
+                auto const parts = db.m_split(conn.m_name);
+                if (parts.has_pin()) {
+                  records[pos] = {
+                      parts.m_owner,
+                      parts.m_pin,
+                      static_cast<std::uint32_t>(idx),
+                      conn.m_direction,
+                      pos};
+                  ++pos;
+                }
+              }
+            }
+          })
+      .wait();
+  if (total == 0) {
+    db.m_pin_offsets.push_back(0);
+    return db;
+  }
+
+  // a pin on several nets is kept once per net, in the order of the file
+  detail::parallel_sort(
+      records,
+      [](detail::PinRecord const &lhs, detail::PinRecord const &rhs) {
+        if (lhs.m_instance != rhs.m_instance) {
+          return lhs.m_instance < rhs.m_instance;
+        }
+        if (lhs.m_pin != rhs.m_pin) {
+          return lhs.m_pin < rhs.m_pin;
+        }
+        return lhs.m_conn < rhs.m_conn;
+      },
+      pool);
+
+  for (std::size_t pin = 0; pin < total; ++pin) {
+    if (pin == 0 || records[pin].m_instance != records[pin - 1].m_instance) {
+      db.m_instances.push_back(records[pin].m_instance);
+      db.m_pin_offsets.push_back(pin);
+    }
+  }
+  db.m_pin_offsets.push_back(total);
+
+  db.m_pin_names.resize(total);
+  db.m_pin_nets.resize(total);
+  db.m_pin_directions.resize(total);
+  db.m_net_pins.resize(total);
+  pool.parallelize_loop(
+          total,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t pin = first; pin < last; ++pin) {
+              auto const &record = records[pin];
+              db.m_pin_names[pin] = record.m_pin;
+              db.m_pin_nets[pin] = record.m_net;
+              db.m_pin_directions[pin] = record.m_direction;
+              db.m_net_pins[record.m_conn] = static_cast<std::uint32_t>(pin);
+            }
+          })
+      .wait();
+  return db;
+}
+
+#endif  // SPEF_PINS_HPP
@@ -0,0 +1,253 @@
+#ifndef SPEF_PROFILE_HPP
+#define SPEF_PROFILE_HPP
+
+#include "spef_actions.hpp"
+#include "spef_structs.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tao/pegtl.hpp>
+#include <vector>
+
+/// The number of times that rules were tried while parsing, and how many of
+/// the tries failed. Every failed try is work that the parser throws away when
+/// it backtracks, and its input is read again by the next alternative.
+struct RuleCounts {
+  std::uint64_t m_starts{};
+  std::uint64_t m_failures{};
+};
+
+namespace detail {
+/// The counts of the parses of the current thread
+inline RuleCounts &rule_counts() {
+  static thread_local RuleCounts counts;
+  return counts;
+}
+}  // namespace detail
+
+/// A PEGTL control that counts the rules tried by the parser in the
+/// rule_counts() of the thread. The default control is used otherwise, so
+/// normal parses pay nothing for it.
+template<typename Rule>
+struct spef_count_control : pegtl::normal<Rule> {
+  template<typename Input, typename... States>
+  static void start(Input const &, States &&...) {
+    ++detail::rule_counts().m_starts;
+  }
+
+  template<typename Input, typename... States>
+  static void failure(Input const &, States &&...) {
+    ++detail::rule_counts().m_failures;
+  }
+};
+
+/// Parses the given SPEF file with spef_count_control, and returns the counts
+inline RuleCounts count_rules(std::filesystem::path const &spef_file) {
+  pegtl::read_input input{spef_file};
+  SPEF spef;
+  SPEFHelper spef_h{};
+  detail::rule_counts() = {};
+  pegtl::parse<pegtl::must<spef_grammar>, spef_action, spef_count_control>(
+      input,
+      spef,
+      spef_h);
+  return detail::rule_counts();
+}
+
+/// The profile of a rule of the grammar over a parse
+struct RuleProfile {
+  std::string_view m_name;
+  std::uint64_t m_starts{};
+  std::uint64_t m_successes{};
+  std::uint64_t m_failures{};
+  std::chrono::nanoseconds m_total_time{};  // with the rules it contains
+  std::chrono::nanoseconds m_self_time{};   // without them
+};
+
+namespace detail {
+/// The profiles of the rules that the current thread has tried, in the order
+/// they were first tried
+inline std::vector<std::unique_ptr<RuleProfile>> &rule_profiles() {
+  static thread_local std::vector<std::unique_ptr<RuleProfile>> profiles;
+  return profiles;
+}
+
+/// A rule that is being matched
+struct ActiveRule {
+  RuleProfile *m_profile;
+  std::chrono::steady_clock::time_point m_start;
+  std::chrono::nanoseconds m_nested_time{};  // in the rules it contains
+};
+
+/// The rules that are being matched, innermost last
+inline std::vector<ActiveRule> &active_rules() {
+  static thread_local std::vector<ActiveRule> rules;
+  return rules;
+}
+
+/// The profile of the rule, which is added to rule_profiles() when the rule
+/// is first tried
+template<typename Rule>
+RuleProfile &rule_profile() {
+  static thread_local RuleProfile *const profile = [] {
+    auto &profiles = rule_profiles();
+    profiles.push_back(std::make_unique<RuleProfile>());
+    profiles.back()->m_name = pegtl::demangle<Rule>();
+    return profiles.back().get();
+  }();
+  return *profile;
+}
+
+/// Ends the innermost active rule, and adds its time to its profile
+inline void end_rule() {
+  auto &rules = active_rules();
+  auto &profile = *rules.back().m_profile;
+  auto const time = std::chrono::steady_clock::now() - rules.back().m_start;
+  profile.m_total_time += time;
+  profile.m_self_time += time - rules.back().m_nested_time;
+  rules.pop_back();
+  if (!rules.empty()) {
+    rules.back().m_nested_time += time;
+  }
+}
+}  // namespace detail
+
+/// A PEGTL control that profiles every rule: the times it was tried, matched
+/// and failed, and the time spent in it. Being a separate instantiation of the
+/// parser, it costs nothing to the parses that use the default control.
+template<typename Rule>
+struct spef_profile_control : pegtl::normal<Rule> {
+  template<typename Input, typename... States>
+  static void start(Input const &, States &&...) {
+    auto &profile = detail::rule_profile<Rule>();
+    ++profile.m_starts;
+    detail::active_rules().push_back(
+        {&profile, std::chrono::steady_clock::now()});
+  }
+
+  template<typename Input, typename... States>
+  static void success(Input const &, States &&...) {
+    ++detail::rule_profile<Rule>().m_successes;
+    detail::end_rule();
+  }
+
+  template<typename Input, typename... States>
+  static void failure(Input const &, States &&...) {
+    ++detail::rule_profile<Rule>().m_failures;
+    detail::end_rule();
+  }
+};
+
+/// The profiles of the rules tried by a parse, and its error if it failed
+struct GrammarProfile {
+  std::vector<RuleProfile> m_rules;
+  std::string m_error;  // empty if the parse succeeded
+};
+
+/// Parses the given SPEF file with spef_profile_control, and returns the
+/// profiles of all the rules that were tried. The profiles point to names that
+/// live as long as the program. On a parse error, the rules that were being
+/// matched are ended where the parser stopped, so the profiles cover the
+/// parse up to the error.
+inline GrammarProfile profile_grammar(std::filesystem::path const &spef_file) {
+  pegtl::read_input input{spef_file};
+  SPEF spef;
+  SPEFHelper spef_h{};
+  for (auto &profile : detail::rule_profiles()) {
+    *profile = RuleProfile{profile->m_name};
+  }
+  detail::active_rules().clear();
+  GrammarProfile result;
+  try {
+    pegtl::parse<pegtl::must<spef_grammar>, spef_action, spef_profile_control>(
+        input,
+        spef,
+        spef_h);
+  } catch (pegtl::parse_error const &err) {
+    result.m_error = err.what();
+    while (!detail::active_rules().empty()) {
+      detail::end_rule();
+    }
+  }
+
+  for (auto const &profile : detail::rule_profiles()) {
+    if (profile->m_starts != 0) {
+      result.m_rules.push_back(*profile);
+    }
+  }
+  return result;
+}
+
+namespace detail {
+/// The name of the rule, cut to the given width, as the names of the rules
+/// that are built from PEGTL templates can be very long
+inline std::string_view rule_name(std::string_view name, std::size_t width) {
+  return name.size() <= width ? name : name.substr(0, width);
+}
+
+inline double to_ms(std::chrono::nanoseconds time) {
+  return std::chrono::duration<double, std::milli>(time).count();
+}
+
+inline void write_profile_rows(
+    std::ostream &os,
+    std::vector<RuleProfile> const &profiles,
+    std::size_t top) {
+  fmt::println(
+      os,
+      "{:<60} {:>12} {:>12} {:>12} {:>10} {:>10}",
+      "rule",
+      "starts",
+      "successes",
+      "failures",
+      "self (ms)",
+      "total (ms)");
+  for (std::size_t idx = 0; idx < std::min(top, profiles.size()); ++idx) {
+    auto const &profile = profiles[idx];
+    fmt::println(
+        os,
+        "{:<60} {:>12} {:>12} {:>12} {:>10.3f} {:>10.3f}",
+        rule_name(profile.m_name, 60),
+        profile.m_starts,
+        profile.m_successes,
+        profile.m_failures,
+        to_ms(profile.m_self_time),
+        to_ms(profile.m_total_time));
+  }
+}
+}  // namespace detail
+
+/// Writes the top rules by the time spent in them, excluding the rules they
+/// contain, and the top rules by the number of times they failed, i.e. made
+/// the parser backtrack
+inline void write_rule_profiles(
+    std::ostream &os,
+    std::vector<RuleProfile> profiles,
+    std::size_t top) {
+  std::sort(
+      profiles.begin(),
+      profiles.end(),
+      [](RuleProfile const &lhs, RuleProfile const &rhs) {
+        return lhs.m_self_time > rhs.m_self_time;
+      });
+  fmt::println(os, "Hottest rules, by the time spent in the rule itself:");
+  detail::write_profile_rows(os, profiles, top);
+
+  std::sort(
+      profiles.begin(),
+      profiles.end(),
+      [](RuleProfile const &lhs, RuleProfile const &rhs) {
+        return lhs.m_failures > rhs.m_failures;
+      });
+  fmt::println(os, "\nMost backtracked rules:");
+  detail::write_profile_rows(os, profiles, top);
+}
+
+#endif  // SPEF_PROFILE_HPP
@@ -130,10 +130,18 @@ private:
       }
     } while (m_spef.m_prefix_bus_delim == m_spef.m_hierarchy_div_def ||
              m_spef.m_prefix_bus_delim == m_spef.m_pin_delim_def);
-    m_spef.m_time_scale = scaled_value{1, r_choose({"NS", "PS"})};
-    m_spef.m_cap_scale = scaled_value{1, r_choose({"FF", "PF"})};
-    m_spef.m_res_scale = scaled_value{1, r_choose({"OHM", "KOHM"})};
-    m_spef.m_induct_scale = scaled_value{1, r_choose({"HENRY", "MH", "UH"})};
+    m_spef.m_time_scale = scaled_value{
+        1,
+        r_choose({UnitType::Nanosecond, UnitType::Picosecond})};
+    m_spef.m_cap_scale = scaled_value{
+        1,
+        r_choose({UnitType::Femtofarad, UnitType::Picofarad})};
+    m_spef.m_res_scale =
+        scaled_value{1, r_choose({UnitType::Ohm, UnitType::Kiloohm})};
+    m_spef.m_induct_scale = scaled_value{
+        1,
+        r_choose(
+            {UnitType::Henry, UnitType::Millihenry, UnitType::Microhenry})};
   }
 
   void gen_name_map() {}
@@ -223,10 +231,12 @@ private:
   void gen_d_nets_ground_capacitances() {
     for (DNet &d_net : m_spef.m_d_nets) {
       for (DNet::Connection &conn : d_net.m_conns) {
-        d_net.m_ground_caps.push_back({conn.m_name, r_rand(1.0, 10.0)});
+        d_net.m_ground_caps.push_back(
+            {conn.m_name, static_cast<cap_t>(r_rand(1.0, 10.0))});
       }
       for (DNet::InternalNode &node : d_net.m_nodes) {
-        d_net.m_ground_caps.push_back({node.m_name, r_rand(1.0, 10.0)});
+        d_net.m_ground_caps.push_back(
+            {node.m_name, static_cast<cap_t>(r_rand(1.0, 10.0))});
       }
     }
   }
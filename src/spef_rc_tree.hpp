@@ -0,0 +1,161 @@
+#ifndef SPEF_RC_TREE_HPP
+#define SPEF_RC_TREE_HPP
+
+#include "spef_structs.hpp"
+#include <cstdint>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// The RC tree of a D_NET, rooted at its driver. The nodes are stored in BFS
+/// order, so the root is node 0 and the parent of every node comes before the
+/// node itself. Walking the nodes backwards visits the children before their
+/// parents.
+struct RCTree {
+  static constexpr std::uint32_t NO_NODE = static_cast<std::uint32_t>(-1);
+
+  std::vector<std::string_view> m_names;  // points into the D_NET strings
+  std::vector<std::uint32_t> m_parent;    // the root is its own parent
+  std::vector<res_t> m_res;               // resistance to the parent
+  std::vector<cap_t> m_cap;               // ground and (grounded) coupling caps
+  std::unordered_map<std::string_view, std::uint32_t> m_index;
+  std::size_t m_num_loop_res{};  // resistors closing a loop, which are ignored
+
+  [[nodiscard]] std::size_t size() const { return m_names.size(); }
+
+  [[nodiscard]] std::uint32_t find(std::string_view name) const {
+    auto const it = m_index.find(name);
+    return it == m_index.end() ? NO_NODE : it->second;
+  }
+};
+
+/// Returns the index of the connection that drives the net: an output pin of
+/// an instance, or an input port of the design. A bidirectional connection is
+/// used only if nothing else drives the net. Returns m_conns.size() if the net
+/// has no driver.
+inline std::size_t find_driver(DNet const &d_net) {
+  std::size_t bidirectional = d_net.m_conns.size();
+  for (std::size_t idx = 0; idx < d_net.m_conns.size(); ++idx) {
+    auto const &conn = d_net.m_conns[idx];
+    if ((conn.m_type == ConnType::InternalConnection &&
+         conn.m_direction == DirType::Output) ||
+        (conn.m_type == ConnType::ExternalConnection &&
+         conn.m_direction == DirType::Input)) {
+      return idx;
+    }
+    if (conn.m_direction == DirType::Bidirectional &&
+        bidirectional == d_net.m_conns.size()) {
+      bidirectional = idx;
+    }
+  }
+  return bidirectional;
+}
+
+/// Builds the RC tree of the given net, rooted at the node named root.
+/// Coupling caps are treated as grounded. Resistors that close a loop are
+/// dropped (and counted in m_num_loop_res), and the caps of nodes that aren't
+/// reachable from the root are lumped onto the root, so that the total cap of
+/// the tree matches the sum of the caps of the net.
+inline RCTree build_rc_tree(DNet const &d_net, std::string_view root) {
+  // number the nodes in order of appearance
+  std::vector<std::string_view> names;
+  std::unordered_map<std::string_view, std::uint32_t> index;
+  auto const get_index = [&names, &index](std::string_view name) {
+    auto const [it, inserted] =
+        index.emplace(name, static_cast<std::uint32_t>(names.size()));
+    if (inserted) {
+      names.push_back(name);
+    }
+    return it->second;
+  };
+
+  get_index(root);
+  std::vector<cap_t> caps;
+  for (auto const &ground_cap : d_net.m_ground_caps) {
+    auto const idx = get_index(ground_cap.m_node);
+    caps.resize(names.size());
+    caps[idx] += ground_cap.m_cap;
+  }
+  for (auto const &coupling_cap : d_net.m_coupling_caps) {
+    auto const idx = get_index(coupling_cap.m_node1);
+    caps.resize(names.size());
+    caps[idx] += coupling_cap.m_cap;
+  }
+
+  // adjacency lists of the resistor graph, as (neighbour, resistance) pairs
+  std::vector<std::vector<std::pair<std::uint32_t, res_t>>> adjacent;
+  for (auto const &res : d_net.m_resistances) {
+    auto const idx1 = get_index(res.m_node1);
+    auto const idx2 = get_index(res.m_node2);
+    adjacent.resize(names.size());
+    adjacent[idx1].emplace_back(idx2, res.m_res);
+    adjacent[idx2].emplace_back(idx1, res.m_res);
+  }
+  caps.resize(names.size());
+  adjacent.resize(names.size());
+
+  // traverse the resistor graph from the root, renumbering the nodes in BFS
+  // order
+  RCTree tree;
+  std::vector<std::uint32_t> new_idx(names.size(), RCTree::NO_NODE);
+  std::queue<std::uint32_t> queue;
+  auto const visit = [&](std::uint32_t old_idx,
+                         std::uint32_t parent,
+                         res_t res) {
+    new_idx[old_idx] = static_cast<std::uint32_t>(tree.m_names.size());
+    tree.m_names.push_back(names[old_idx]);
+    tree.m_parent.push_back(parent);
+    tree.m_res.push_back(res);
+    tree.m_cap.push_back(caps[old_idx]);
+    queue.push(old_idx);
+  };
+
+  visit(0, 0, 0);
+  std::size_t num_tree_res = 0;
+  std::size_t num_res = 0;
+  while (!queue.empty()) {
+    auto const old_idx = queue.front();
+    queue.pop();
+    for (auto const &[neighbour, res] : adjacent[old_idx]) {
+      ++num_res;
+      if (new_idx[neighbour] == RCTree::NO_NODE) {
+        visit(neighbour, new_idx[old_idx], res);
+        ++num_tree_res;
+      }
+    }
+  }
+  // every resistor between visited nodes was seen twice, once from each end
+  tree.m_num_loop_res = num_res / 2 - num_tree_res;
+
+  for (std::uint32_t old_idx = 0; old_idx < names.size(); ++old_idx) {
+    if (new_idx[old_idx] == RCTree::NO_NODE) {
+      tree.m_cap[0] += caps[old_idx];
+    }
+  }
+
+  tree.m_index.reserve(tree.m_names.size());
+  for (std::uint32_t idx = 0; idx < tree.m_names.size(); ++idx) {
+    tree.m_index.emplace(tree.m_names[idx], idx);
+  }
+
+  return tree;
+}
+
+/// Returns the Elmore delay from the root to every node of the tree, in units
+/// of the resistance times the capacitance units of the net
+inline std::vector<double> elmore_delays(RCTree const &tree) {
+  // accumulate the downstream capacitance of every node
+  std::vector<double> down_cap(tree.m_cap.begin(), tree.m_cap.end());
+  for (std::size_t idx = tree.size(); idx-- > 1;) {
+    down_cap[tree.m_parent[idx]] += down_cap[idx];
+  }
+
+  std::vector<double> delays(tree.size(), 0.0);
+  for (std::size_t idx = 1; idx < tree.size(); ++idx) {
+    delays[idx] = delays[tree.m_parent[idx]] + tree.m_res[idx] * down_cap[idx];
+  }
+  return delays;
+}
+
+#endif  // SPEF_RC_TREE_HPP
@@ -0,0 +1,232 @@
+#ifndef SPEF_RECOVER_HPP
+#define SPEF_RECOVER_HPP
+
+#include "spef_actions.hpp"
+#include "spef_index.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tao/pegtl.hpp>
+#include <vector>
+
+// Parsing that recovers from errors. The file is cut at the lines that start
+// with *D_NET or *R_NET, and every net is parsed on its own, so an error
+// inside a net loses only that net: the parser resyncs at the start of the
+// next one. The nets are parsed in parallel, and a single pass reports all the
+// errors of the file.
+
+/// An error found while parsing. m_net is empty for the errors in the header.
+struct SPEFParseError {
+  std::size_t m_line{};  // 1-based, in the file
+  std::size_t m_column{};  // 1-based
+  std::string m_net;
+  std::string m_message;
+};
+
+namespace detail {
+/// The nets are followed by the optional physical nets, which belong to no
+/// net, and the net must be the only thing up to the start of the next one
+template<typename Net>
+using recover_net_rule = pegtl::must<
+    Net,
+    pegtl::star<pegtl::sor<spef_d_pnet, spef_r_pnet>>,
+    pegtl::eof>;
+
+/// A part of the file that is parsed on its own
+struct RecoverSegment {
+  std::string_view m_text;
+  NetType m_type;
+};
+
+/// The lines that start a net, found in one chunk of the file per thread
+inline std::vector<char const *>
+find_net_starts(char const *data, std::uint64_t size, BS::thread_pool &pool) {
+  std::size_t const num_chunks = std::max<std::size_t>(
+      1,
+      std::min<std::uint64_t>(pool.get_thread_count(), size / 4096));
+  std::vector<std::vector<std::pair<char const *, char const *>>> lines(
+      num_chunks);
+  pool.parallelize_loop(
+          num_chunks,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              lines[idx] = find_net_lines(
+                  data + size * idx / num_chunks,
+                  data + size * (idx + 1) / num_chunks,
+                  data,
+                  data + size);
+            }
+          })
+      .wait();
+
+  std::vector<char const *> starts;
+  for (auto const &chunk_lines : lines) {
+    for (auto const &[begin, end] : chunk_lines) {
+      if (!starts_with(begin, end, "*END")) {
+        starts.push_back(begin);
+      }
+    }
+  }
+  return starts;
+}
+
+/// The name of the net that starts at the given line, as written in the file
+inline std::string net_name(std::string_view text) {
+  auto const eol = text.find('\n');
+  std::string_view const line =
+      text.substr(0, eol).substr(std::min(text.size(), std::size_t{6}));
+  std::vector<std::string_view> tokens;
+  split(line, tokens, 1);
+  return tokens.empty() ? std::string{} : std::string(tokens[0]);
+}
+
+/// Parses the segment into spef with Rule. On an error, the nets that were
+/// added to spef are dropped, and the error is returned with its line relative
+/// to the start of the segment.
+template<typename Rule>
+std::optional<SPEFParseError>
+parse_segment(std::string_view text, std::string const &source, SPEF &spef) {
+  std::string buffer;
+  if (!text.empty() && text.back() != '\n') {
+    buffer.reserve(text.size() + 1);
+    buffer.append(text).push_back('\n');
+    text = buffer;
+  }
+
+  auto const num_d_nets = spef.m_d_nets.size();
+  auto const num_r_nets = spef.m_r_nets.size();
+  pegtl::memory_input input(text.data(), text.data() + text.size(), source);
+  SPEFParseError error;
+  try {
+    SPEFHelper spef_h{};
+    pegtl::parse<Rule, spef_action>(input, spef, spef_h);
+    return std::nullopt;
+  } catch (pegtl::parse_error const &err) {
+    auto const &pos = err.positions().front();
+    error = {pos.line, pos.column, {}, std::string(err.message())};
+  } catch (std::exception const &err) {
+    // the errors of the actions are reported where the parser stopped
+    auto const pos = input.position();
+    error = {pos.line, pos.column, {}, err.what()};
+  }
+  spef.m_d_nets.resize(num_d_nets);
+  spef.m_d_net_variations.truncate(num_d_nets);
+  spef.m_r_nets.resize(num_r_nets);
+  return error;
+}
+}  // namespace detail
+
+/// Parses the given SPEF file into spef, skipping the nets that have errors,
+/// and returns the errors in the order they appear in the file. An error in
+/// the header is reported, and the parse goes on with the nets.
+inline std::vector<SPEFParseError> parse_spef_recovering(
+    std::filesystem::path const &spef_file,
+    SPEF &spef,
+    BS::thread_pool &pool) {
+  pegtl::mmap_input<> const file{spef_file};
+  char const *const data = file.begin();
+  auto const size = static_cast<std::uint64_t>(file.size());
+  std::string const source = spef_file.string();
+
+  auto const starts = detail::find_net_starts(data, size, pool);
+  std::vector<detail::RecoverSegment> segments;
+  segments.reserve(starts.size());
+  for (std::size_t idx = 0; idx < starts.size(); ++idx) {
+    char const *const end = idx + 1 < starts.size() ? starts[idx + 1]
+                                                    : data + size;
+    segments.push_back(
+        {{starts[idx], static_cast<std::size_t>(end - starts[idx])},
+         starts[idx][1] == 'D' ? NetType::Detailed : NetType::Reduced});
+  }
+
+  // the errors, with the offset of the segment they were found in
+  std::vector<std::pair<std::uint64_t, SPEFParseError>> errors;
+  std::string_view const header{
+      data,
+      starts.empty() ? size : static_cast<std::size_t>(starts[0] - data)};
+  if (auto error = detail::parse_segment<
+          pegtl::must<spef_preamble, pegtl::eof>>(header, source, spef)) {
+    errors.emplace_back(0, std::move(*error));
+  }
+
+  // the nets are parsed in blocks, each into its own SPEF, which are then
+  // appended in order, so the nets keep the order of the file
+  std::size_t const num_blocks =
+      std::min<std::size_t>(segments.size(), pool.get_thread_count() * 4);
+  std::vector<SPEF> block_spefs(num_blocks);
+  std::vector<std::vector<std::pair<std::uint64_t, SPEFParseError>>>
+      block_errors(num_blocks);
+  pool.parallelize_loop(
+          num_blocks,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t block = first; block < last; ++block) {
+              auto const begin = segments.size() * block / num_blocks;
+              auto const end = segments.size() * (block + 1) / num_blocks;
+              for (auto idx = begin; idx < end; ++idx) {
+                auto const &segment = segments[idx];
+                auto error =
+                    segment.m_type == NetType::Detailed
+                        ? detail::parse_segment<
+                              detail::recover_net_rule<spef_d_net>>(
+                              segment.m_text,
+                              source,
+                              block_spefs[block])
+                        : detail::parse_segment<
+                              detail::recover_net_rule<spef_r_net>>(
+                              segment.m_text,
+                              source,
+                              block_spefs[block]);
+                if (error) {
+                  error->m_net = detail::net_name(segment.m_text);
+                  block_errors[block].emplace_back(
+                      static_cast<std::uint64_t>(segment.m_text.data() - data),
+                      std::move(*error));
+                }
+              }
+            }
+          })
+      .get();
+
+  for (std::size_t block = 0; block < num_blocks; ++block) {
+    auto &d_nets = block_spefs[block].m_d_nets;
+    auto &r_nets = block_spefs[block].m_r_nets;
+    spef.m_d_net_variations.append(
+        spef.m_d_nets.size(),
+        block_spefs[block].m_d_net_variations);
+    spef.m_d_nets.insert(
+        spef.m_d_nets.end(),
+        std::make_move_iterator(d_nets.begin()),
+        std::make_move_iterator(d_nets.end()));
+    spef.m_r_nets.insert(
+        spef.m_r_nets.end(),
+        std::make_move_iterator(r_nets.begin()),
+        std::make_move_iterator(r_nets.end()));
+    errors.insert(
+        errors.end(),
+        std::make_move_iterator(block_errors[block].begin()),
+        std::make_move_iterator(block_errors[block].end()));
+  }
+
+  // the lines of the errors are relative to their segments. The errors are in
+  // the order of the file, so the newlines are counted in a single sweep.
+  std::vector<SPEFParseError> result;
+  result.reserve(errors.size());
+  std::uint64_t counted = 0;
+  std::size_t line = 0;
+  for (auto &[offset, error] : errors) {
+    line += static_cast<std::size_t>(
+        std::count(data + counted, data + offset, '\n'));
+    counted = offset;
+    error.m_line += line;
+    result.push_back(std::move(error));
+  }
+  return result;
+}
+
+#endif  // SPEF_RECOVER_HPP
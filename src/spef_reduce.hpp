@@ -0,0 +1,134 @@
+#ifndef SPEF_REDUCE_HPP
+#define SPEF_REDUCE_HPP
+
+#include "spef_rc_tree.hpp"
+#include "spef_structs.hpp"
+#include "spef_units.hpp"
+#include <array>
+#include <stdexcept>
+#include <string_view>
+
+// Model-order reduction of D_NETs to R_NETs. The driving-point admittance of
+// the RC tree of every net is expanded as
+//   Y(s) = y1 * s + y2 * s^2 + y3 * s^3 + ...
+// and the first three moments are matched by a C2-R1-C1 pi model, following
+// O'Brien and Savarino, "Modeling the driving-point characteristic of resistive
+// interconnect for accurate delay estimation", ICCAD 1989.
+
+using admittance_moments = std::array<double, 3>;
+
+/// Returns the factor that converts the product of a resistance and a
+/// capacitance, in the units of the SPEF, to its time unit. If any of the units
+/// is missing, the values are assumed to be consistent.
+inline double rc_to_time_factor(SPEF const &spef) {
+  if (!spef.m_res_scale || !spef.m_cap_scale || !spef.m_time_scale) {
+    return 1;
+  }
+  return si_factor(spef.m_res_scale) * si_factor(spef.m_cap_scale) /
+         si_factor(spef.m_time_scale);
+}
+
+/// Computes the first three moments of the driving-point admittance of the
+/// tree, seen from its root. The admittance of every subtree is propagated
+/// through the resistor connecting it to its parent, using the expansion of
+/// Y / (1 + R * Y) up to s^3.
+inline admittance_moments compute_admittance_moments(RCTree const &tree) {
+  std::vector<admittance_moments> moments(tree.size());
+  for (std::size_t idx = 0; idx < tree.size(); ++idx) {
+    moments[idx] = {tree.m_cap[idx], 0, 0};
+  }
+
+  for (std::size_t idx = tree.size(); idx-- > 1;) {
+    auto const [y1, y2, y3] = moments[idx];
+    double const res = tree.m_res[idx];
+    auto &parent = moments[tree.m_parent[idx]];
+    parent[0] += y1;
+    parent[1] += y2 - res * y1 * y1;
+    parent[2] += y3 - 2 * res * y1 * y2 + res * res * y1 * y1 * y1;
+  }
+
+  return moments[0];
+}
+
+/// Synthesizes the pi model that matches the given admittance moments. If the
+/// net is (almost) purely capacitive, the whole capacitance is placed at the
+/// driver side.
+inline RNet::PiModel synthesize_pi_model(admittance_moments const &moments) {
+  auto const [y1, y2, y3] = moments;
+  if (y2 >= 0 || y3 <= 0) {
+    return {static_cast<cap_t>(y1), 0, 0};
+  }
+
+  double const c1 = y2 * y2 / y3;
+  double const r1 = -y3 * y3 / (y2 * y2 * y2);
+  return {
+      static_cast<cap_t>(y1 - c1),
+      static_cast<res_t>(r1),
+      static_cast<cap_t>(c1)};
+}
+
+/// Reduces the given D_NET to an R_NET. The rc_to_time factor converts the
+/// Elmore delays of the loads to the time unit of the SPEF. Nets without a
+/// driver or without loads keep only their name and total cap.
+inline RNet reduce_d_net(DNet const &d_net, double rc_to_time) {
+  static constexpr std::string_view UNKNOWN_CELL{"UNKNOWN"};
+
+  RNet r_net{};
+  r_net.m_name = d_net.m_name;
+  r_net.m_total_cap = d_net.m_total_cap;
+  r_net.m_routing_conf = d_net.m_routing_conf;
+
+  auto const driver_idx = find_driver(d_net);
+  if (driver_idx == d_net.m_conns.size() || d_net.m_conns.size() == 1) {
+    return r_net;
+  }
+
+  auto const &driver = d_net.m_conns[driver_idx];
+  RCTree const tree = build_rc_tree(d_net, driver.m_name);
+  auto const delays = elmore_delays(tree);
+
+  r_net.m_driver = driver.m_name;
+  r_net.m_driver_cell = UNKNOWN_CELL;
+  for (auto const &conn_attr : driver.m_conn_attrs) {
+    if (conn_attr->m_type == ConnAttrType::DrivingCell) {
+      r_net.m_driver_cell =
+          static_cast<DrivingCellAttr const *>(conn_attr.get())->m_cell;
+    }
+  }
+  r_net.m_pi_model = synthesize_pi_model(compute_admittance_moments(tree));
+
+  for (std::size_t idx = 0; idx < d_net.m_conns.size(); ++idx) {
+    if (idx == driver_idx) {
+      continue;
+    }
+    auto const &conn = d_net.m_conns[idx];
+    auto const node = tree.find(conn.m_name);
+    double const delay = node == RCTree::NO_NODE ? 0 : delays[node];
+    r_net.m_loads.push_back({conn.m_name, delay * rc_to_time});
+  }
+
+  return r_net;
+}
+
+/// Replaces all the D_NETs of the SPEF with their reduced R_NETs. The corners
+/// of the total caps are kept.
+inline void reduce_spef(SPEF &spef) {
+  double const rc_to_time = rc_to_time_factor(spef);
+  spef.m_r_nets.reserve(spef.m_r_nets.size() + spef.m_d_nets.size());
+  for (std::size_t idx = 0; idx < spef.m_d_nets.size(); ++idx) {
+    auto &r_net = spef.m_r_nets.emplace_back(
+        reduce_d_net(spef.m_d_nets[idx], rc_to_time));
+    auto const total_caps =
+        spef.m_d_net_variations.m_total_cap_corners.net(idx);
+    if (!total_caps.empty()) {
+      r_net.m_total_cap_corners = {
+          total_caps[Corner::Min][0],
+          total_caps[Corner::Typ][0],
+          total_caps[Corner::Max][0]};
+    }
+  }
+  spef.m_d_nets.clear();
+  spef.m_d_net_variations = {};
+}
+
+#endif  // SPEF_REDUCE_HPP
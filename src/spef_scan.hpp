@@ -0,0 +1,445 @@
+#ifndef SPEF_SCAN_HPP
+#define SPEF_SCAN_HPP
+
+#include "file_reader.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// A structural scanner of SPEF files, which finds the keywords at the start of
+// lines, like *D_NET and *END, without running the grammar. The bytes are
+// classified 64 at a time into bitmasks of the newlines and the '*'s, and a '*'
+// starts a keyword if the byte before it is a newline, which is a shift of the
+// newline mask. Only the set bits of the result are visited, so the cost is a
+// few instructions per 64 bytes plus one per keyword.
+//
+// The chunks of a file can be scanned independently, in parallel, and then
+// stitched in order, which resolves the keywords that straddle the boundaries
+// of the chunks.
+
+namespace detail {
+/// The bits of the bytes of a block of 64 that are equal to chr, the first
+/// byte in the lowest bit
+inline std::uint64_t char_mask(char const *block, char chr) {
+  std::uint64_t mask = 0;
+#if defined(__SSE2__)
+  __m128i const chrs = _mm_set1_epi8(chr);
+  for (int idx = 0; idx < 4; ++idx) {
+    __m128i const chars = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(block + 16 * idx));
+    auto const bits = static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chars, chrs)));
+    mask |= std::uint64_t{bits} << (16 * idx);
+  }
+#else
+  for (int idx = 0; idx < 64; ++idx) {
+    mask |= std::uint64_t{block[idx] == chr} << idx;
+  }
+#endif
+  return mask;
+}
+
+template<typename Callback>
+void for_each_bit(std::uint64_t bits, char const *base, Callback &&callback) {
+  while (bits != 0) {
+    callback(base + __builtin_ctzll(bits));
+    bits &= bits - 1;
+  }
+}
+
+/// Returns the first whitespace in [begin, end), or end
+inline char const *find_keyword_end(char const *begin, char const *end) {
+  while (begin != end && *begin != ' ' && *begin != '\n' && *begin != '\t' &&
+         *begin != '\r') {
+    ++begin;
+  }
+  return begin;
+}
+
+/// Without NEWLINES, the blocks without a '*', which are most of them, are
+/// skipped without finding their newlines
+template<bool NEWLINES, typename OnStar, typename OnNewline>
+void scan_blocks(
+    char const *begin,
+    char const *end,
+    bool at_line_start,
+    OnStar &&on_star,
+    OnNewline &&on_newline) {
+  std::uint64_t carry = at_line_start ? 1 : 0;
+  auto const scan_block = [&](char const *block,
+                              char const *base,
+                              std::uint64_t valid) {
+    auto const stars = char_mask(block, '*') & valid;
+    if (!NEWLINES && stars == 0) {
+      carry = (valid >> 63) != 0 && block[63] == '\n' ? 1 : 0;
+      return;
+    }
+    auto const newlines = char_mask(block, '\n') & valid;
+    for_each_bit(stars & ((newlines << 1) | carry), base, on_star);
+    if constexpr (NEWLINES) {
+      for_each_bit(newlines, base, on_newline);
+    }
+    carry = newlines >> 63;
+  };
+
+  char const *pos = begin;
+  for (; end - pos >= 64; pos += 64) {
+    scan_block(pos, pos, ~std::uint64_t{0});
+  }
+  if (pos != end) {
+    // the last bytes are copied to a full block, which is never read past
+    auto const size = static_cast<std::size_t>(end - pos);
+    char block[64] = {};
+    std::memcpy(block, pos, size);
+    scan_block(block, pos, (std::uint64_t{1} << size) - 1);
+  }
+}
+}  // namespace detail
+
+/// Calls on_star for every '*' at the start of a line in [begin, end), in
+/// order. begin is taken to be at the start of a line if at_line_start.
+template<typename OnStar>
+void scan_structural_chars(
+    char const *begin,
+    char const *end,
+    bool at_line_start,
+    OnStar &&on_star) {
+  detail::scan_blocks<false>(
+      begin,
+      end,
+      at_line_start,
+      on_star,
+      [](char const *) {});
+}
+
+/// Calls on_star for every '*' at the start of a line, and on_newline for
+/// every newline, in order
+template<typename OnStar, typename OnNewline>
+void scan_structural_chars(
+    char const *begin,
+    char const *end,
+    bool at_line_start,
+    OnStar &&on_star,
+    OnNewline &&on_newline) {
+  detail::scan_blocks<true>(
+      begin,
+      end,
+      at_line_start,
+      on_star,
+      on_newline);
+}
+
+enum struct KeywordType {
+  DNet,
+  RNet,
+  DPNet,
+  RPNet,
+  End,
+  NameMap,
+  Other
+};
+
+/// A keyword at the start of a line
+struct StructuralKeyword {
+  std::uint64_t m_offset;  // of its '*'
+  KeywordType m_type;
+};
+
+/// A net, from its *D_NET or *R_NET up to its *END. A net that isn't
+/// terminated by *END ends at the start of the next net, or the end of the
+/// file.
+struct NetBoundary {
+  std::uint64_t m_begin;
+  std::uint64_t m_end;  // the offset of the '*' of its *END
+  NetType m_type;
+  bool m_terminated;
+};
+
+/// The structure of a SPEF file
+struct StructuralIndex {
+  std::uint64_t m_size{};
+  std::vector<StructuralKeyword> m_keywords;
+  std::vector<std::uint64_t> m_newlines;  // only if they were requested
+  std::vector<NetBoundary> m_nets;
+};
+
+/// The longest keyword that is told apart from the others
+static constexpr std::size_t MAX_KEYWORD_LENGTH = 32;
+
+/// Classifies the text after the '*' of a keyword. Returns std::nullopt for
+/// the entries of the *NAME_MAP, like *12, which aren't keywords.
+inline std::optional<KeywordType> classify_keyword(std::string_view keyword) {
+  if (keyword.empty()) {
+    return KeywordType::Other;
+  }
+  switch (keyword[0]) {
+  case 'D':
+    return keyword == "D_NET"    ? KeywordType::DNet
+           : keyword == "D_PNET" ? KeywordType::DPNet
+                                 : KeywordType::Other;
+  case 'R':
+    return keyword == "R_NET"    ? KeywordType::RNet
+           : keyword == "R_PNET" ? KeywordType::RPNet
+                                 : KeywordType::Other;
+  case 'E':
+    return keyword == "END" ? KeywordType::End : KeywordType::Other;
+  case 'N':
+    return keyword == "NAME_MAP" ? KeywordType::NameMap : KeywordType::Other;
+  default:
+    if (keyword[0] >= '0' && keyword[0] <= '9') {
+      return std::nullopt;
+    }
+    return KeywordType::Other;
+  }
+}
+
+/// The structure of a chunk of a file, which is completed by the chunks
+/// around it
+struct ChunkStructure {
+  std::uint64_t m_offset{};
+  std::uint64_t m_size{};
+  // the keywords after the first byte, that end in the chunk
+  std::vector<StructuralKeyword> m_keywords;
+  std::vector<std::uint64_t> m_newlines;
+  // the chunk up to its first whitespace, which ends a keyword of the previous
+  // chunks or is a keyword itself if the chunk starts a line
+  std::string m_head;
+  bool m_head_ends{};  // whether there is whitespace in the chunk
+  // the keyword that the chunk ends in, without its '*'
+  std::optional<std::pair<std::uint64_t, std::string>> m_tail;
+  bool m_ends_line{};
+};
+
+namespace detail {
+inline std::string_view
+truncate_keyword(char const *begin, char const *end) {
+  return {
+      begin,
+      std::min(static_cast<std::size_t>(end - begin), MAX_KEYWORD_LENGTH + 1)};
+}
+}  // namespace detail
+
+/// Scans the chunk of a file at the given offset. Chunks can be scanned in
+/// any order, and in parallel.
+inline ChunkStructure scan_chunk(
+    char const *data,
+    std::size_t size,
+    std::uint64_t offset,
+    bool record_newlines) {
+  ChunkStructure chunk;
+  chunk.m_offset = offset;
+  chunk.m_size = size;
+  if (size == 0) {
+    return chunk;
+  }
+  char const *const end = data + size;
+  char const *const head_end = detail::find_keyword_end(data, end);
+  chunk.m_head = detail::truncate_keyword(data, head_end);
+  chunk.m_head_ends = head_end != end;
+  chunk.m_ends_line = end[-1] == '\n';
+
+  auto const on_star = [&](char const *pos) {
+    char const *const keyword_end = detail::find_keyword_end(pos + 1, end);
+    auto const keyword = detail::truncate_keyword(pos + 1, keyword_end);
+    auto const pos_offset = offset + static_cast<std::uint64_t>(pos - data);
+    if (keyword_end == end) {
+      chunk.m_tail.emplace(pos_offset, keyword);
+    } else if (auto const type = classify_keyword(keyword)) {
+      chunk.m_keywords.push_back({pos_offset, *type});
+    }
+  };
+  if (record_newlines) {
+    scan_structural_chars(data, end, false, on_star, [&](char const *pos) {
+      chunk.m_newlines.push_back(
+          offset + static_cast<std::uint64_t>(pos - data));
+    });
+  } else {
+    scan_structural_chars(data, end, false, on_star);
+  }
+  return chunk;
+}
+
+/// Joins the structures of the chunks of a file, which must be appended in
+/// the order of the file
+class StructureStitcher {
+private:
+  StructuralIndex m_index;
+  bool m_at_line_start{true};
+  // a keyword that started in a previous chunk
+  std::optional<std::pair<std::uint64_t, std::string>> m_keyword;
+
+public:
+  void append(ChunkStructure &&chunk) {
+    if (chunk.m_size == 0) {
+      return;
+    }
+    m_index.m_size = chunk.m_offset + chunk.m_size;
+
+    if (m_keyword) {
+      m_keyword->second += chunk.m_head;
+      m_keyword->second.resize(
+          std::min(m_keyword->second.size(), MAX_KEYWORD_LENGTH + 1));
+    } else if (
+        m_at_line_start && !chunk.m_head.empty() && chunk.m_head[0] == '*') {
+      m_keyword.emplace(chunk.m_offset, chunk.m_head.substr(1));
+    }
+    if (!chunk.m_head_ends) {
+      // the whole chunk is part of the keyword
+      m_at_line_start = false;
+      return;
+    }
+    end_keyword();
+
+    m_index.m_keywords.insert(
+        m_index.m_keywords.end(),
+        chunk.m_keywords.begin(),
+        chunk.m_keywords.end());
+    m_index.m_newlines.insert(
+        m_index.m_newlines.end(),
+        chunk.m_newlines.begin(),
+        chunk.m_newlines.end());
+    m_keyword = std::move(chunk.m_tail);
+    m_at_line_start = chunk.m_ends_line;
+  }
+
+  /// Returns the structure of the file, with the boundaries of its nets
+  StructuralIndex finish() {
+    end_keyword();
+    std::optional<NetBoundary> net;
+    for (auto const &keyword : m_index.m_keywords) {
+      bool const is_d_net = keyword.m_type == KeywordType::DNet;
+      if (is_d_net || keyword.m_type == KeywordType::RNet) {
+        if (net) {
+          net->m_end = keyword.m_offset;
+          m_index.m_nets.push_back(*net);
+        }
+        net = NetBoundary{
+            keyword.m_offset,
+            0,
+            is_d_net ? NetType::Detailed : NetType::Reduced,
+            false};
+      } else if (net && keyword.m_type == KeywordType::End) {
+        net->m_end = keyword.m_offset;
+        net->m_terminated = true;
+        m_index.m_nets.push_back(*net);
+        net.reset();
+      }
+    }
+    if (net) {
+      net->m_end = m_index.m_size;
+      m_index.m_nets.push_back(*net);
+    }
+    return std::move(m_index);
+  }
+
+private:
+  void end_keyword() {
+    if (!m_keyword) {
+      return;
+    }
+    if (auto const type = classify_keyword(m_keyword->second)) {
+      m_index.m_keywords.push_back({m_keyword->first, *type});
+    }
+    m_keyword.reset();
+  }
+};
+
+/// Scans a file that is in memory, in one chunk per thread
+inline StructuralIndex scan_structure(
+    char const *data,
+    std::uint64_t size,
+    BS::thread_pool &pool,
+    bool record_newlines = false) {
+  std::size_t const num_chunks = std::max<std::size_t>(
+      1,
+      std::min<std::uint64_t>(pool.get_thread_count(), size / 4096));
+  std::vector<ChunkStructure> chunks(num_chunks);
+  pool.parallelize_loop(
+          num_chunks,
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto const begin = size * idx / num_chunks;
+              auto const end = size * (idx + 1) / num_chunks;
+              chunks[idx] = scan_chunk(
+                  data + begin,
+                  static_cast<std::size_t>(end - begin),
+                  begin,
+                  record_newlines);
+            }
+          })
+      .wait();
+
+  StructureStitcher stitcher;
+  for (auto &chunk : chunks) {
+    stitcher.append(std::move(chunk));
+  }
+  return stitcher.finish();
+}
+
+/// Scans a file as it is read by an MTFileReader, in chunks of buffer_size
+/// bytes. The consumers scan the chunks as soon as they are read, and the
+/// chunks are stitched at the end.
+inline StructuralIndex scan_file_structure(
+    std::filesystem::path const &spef_file,
+    std::size_t num_producers,
+    std::size_t num_consumers,
+    std::size_t buffer_size,
+    bool record_newlines = false) {
+  auto const size = std::filesystem::file_size(spef_file);
+  std::vector<ChunkStructure> chunks(size / buffer_size + 1);
+  MTFileReader reader(spef_file.c_str(), num_producers, buffer_size);
+  std::atomic<std::size_t> next_idx{0};
+
+  auto const consume = [&] {
+    while (true) {
+      auto const idx = next_idx.fetch_add(1);
+      auto const &[chunk, stop] = reader.get_chunk(idx);
+      if (chunk.empty()) {
+        break;
+      }
+      chunks[idx] = scan_chunk(
+          chunk.data(),
+          chunk.size(),
+          idx * buffer_size,
+          record_newlines);
+      reader.mark_chunk(idx);
+      if (stop) {
+        break;
+      }
+    }
+  };
+
+  BS::thread_pool pool(num_consumers + num_producers - 1);
+  for (std::size_t idx = 0; idx < num_consumers; ++idx) {
+    pool.push_task(consume);
+  }
+  for (std::size_t idx = 0; idx + 1 < num_producers; ++idx) {
+    pool.push_task(&MTFileReader::produce_uncomp, std::ref(reader));
+  }
+  reader.produce_uncomp();
+  pool.wait_for_tasks();
+
+  StructureStitcher stitcher;
+  for (auto &chunk : chunks) {
+    stitcher.append(std::move(chunk));
+  }
+  return stitcher.finish();
+}
+
+#endif  // SPEF_SCAN_HPP
@@ -0,0 +1,143 @@
+#ifndef SPEF_SHARD_HPP
+#define SPEF_SHARD_HPP
+
+#include "spef_extract.hpp"
+#include "spef_index.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum struct ShardBalance {
+  Bytes,     // the size of the nets in the file
+  Elements,  // the number of lines of the nets: connections, caps, resistors
+};
+
+struct ShardInfo {
+  std::filesystem::path m_file;
+  std::size_t m_num_nets{};
+  std::uint64_t m_weight{};  // in the unit of the balance
+};
+
+namespace detail {
+/// Cuts the nets, in the order of the file, into at most num_shards runs with
+/// about the same total weight. Returns the index of the first net of every
+/// shard, followed by the number of nets.
+inline std::vector<std::size_t> balance_shards(
+    std::vector<std::uint64_t> const &weights,
+    std::size_t num_shards) {
+  std::uint64_t total = 0;
+  for (auto const weight : weights) {
+    total += weight;
+  }
+
+  std::vector<std::size_t> bounds{0};
+  std::uint64_t sum = 0;
+  for (std::size_t idx = 0; idx < weights.size(); ++idx) {
+    // cut before the net that starts past the share of the current shard
+    auto const shard = bounds.size();
+    if (shard < num_shards && sum >= total * shard / num_shards &&
+        idx != bounds.back()) {
+      bounds.push_back(idx);
+    }
+    sum += weights[idx];
+  }
+  bounds.push_back(weights.size());
+  return bounds;
+}
+}  // namespace detail
+
+/// Cuts a SPEF file into num_shards standalone SPEF files, named
+/// <prefix>_000.spef, <prefix>_001.spef and so on, for processing the nets
+/// independently. The shards keep the nets in the order of the file, and are
+/// balanced by the given weight of the nets, rather than their number. Every
+/// shard has the header of the file, and the entries of the *NAME_MAP that it
+/// refers to.
+///
+/// The file is memory-mapped and indexed in parallel, and the shards are
+/// written in parallel, one per task. The nets are copied verbatim, so the
+/// shards can be merged back with merge_spef_files.
+inline std::vector<ShardInfo> shard_spef_file(
+    std::filesystem::path const &spef_file,
+    std::string const &prefix,
+    std::size_t num_shards,
+    ShardBalance balance,
+    BS::thread_pool &pool) {
+  pegtl::mmap_input<> const file(spef_file);
+  char const *const data = file.begin();
+  auto const index =
+      build_net_index(data, static_cast<std::uint64_t>(file.size()), pool);
+  auto const net_text = [data](NetIndexEntry const &entry) {
+    return std::string_view(data + entry.m_offset, entry.m_length);
+  };
+
+  SPEF name_map;
+  detail::parse_name_map(data, index, spef_file.string(), name_map);
+
+  std::vector<std::uint64_t> weights(index.m_nets.size());
+  pool.parallelize_loop(
+          index.m_nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              auto const text = net_text(index.m_nets[idx]);
+              if (balance == ShardBalance::Bytes) {
+                weights[idx] = text.size();
+              } else {
+                weights[idx] = static_cast<std::uint64_t>(
+                    std::count(text.begin(), text.end(), '\n'));
+              }
+            }
+          })
+      .wait();
+  auto const bounds =
+      detail::balance_shards(weights, std::max<std::size_t>(num_shards, 1));
+
+  std::vector<ShardInfo> shards(bounds.size() - 1);
+  std::vector<std::future<void>> written;
+  for (std::size_t shard = 0; shard + 1 < bounds.size(); ++shard) {
+    written.push_back(pool.submit([&, shard] {
+      auto const first = bounds[shard];
+      auto const last = bounds[shard + 1];
+
+      std::vector<std::uint64_t> refs;
+      detail::collect_index_refs(detail::header_tail(data, index), refs);
+      for (std::size_t idx = first; idx < last; ++idx) {
+        detail::collect_index_refs(net_text(index.m_nets[idx]), refs);
+      }
+      detail::sort_unique(refs);
+
+      auto &info = shards[shard];
+      info.m_file = fmt::format("{}_{:03d}.spef", prefix, shard);
+      info.m_num_nets = last - first;
+      std::ofstream out(info.m_file, std::ios::binary);
+      detail::write_header(out, data, index, name_map, refs);
+      for (std::size_t idx = first; idx < last; ++idx) {
+        detail::write_net(out, net_text(index.m_nets[idx]));
+        info.m_weight += weights[idx];
+      }
+      if (!out) {
+        throw std::runtime_error(
+            fmt::format("Could not write {}", info.m_file.string()));
+      }
+    }));
+  }
+  // all the tasks are done before an error is rethrown, since they refer to
+  // the mapped file
+  for (auto &future : written) {
+    future.wait();
+  }
+  for (auto &future : written) {
+    future.get();
+  }
+  return shards;
+}
+
+#endif  // SPEF_SHARD_HPP
@@ -0,0 +1,476 @@
+#ifndef SPEF_STATS_HPP
+#define SPEF_STATS_HPP
+
+#include "spef_actions.hpp"
+#include "spef_index.hpp"
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tao/pegtl.hpp>
+#include <vector>
+
+// Statistics over all the nets of a SPEF file, computed in a single streaming
+// pass. The file is read in blocks, the complete nets of every block are
+// parsed in parallel, one at a time, and every task keeps its own statistics,
+// which are merged at the end. Only a block of the file and the nets being
+// parsed are in memory at any time.
+
+/// A histogram of counts, in powers of two: bucket 0 counts the zeros, and
+/// bucket k the values in [2^(k-1), 2^k)
+struct CountHistogram {
+  static constexpr std::size_t NUM_BUCKETS = 40;
+  std::array<std::uint64_t, NUM_BUCKETS> m_counts{};
+
+  void add(std::uint64_t value) {
+    std::size_t bucket = 0;
+    while (value != 0 && bucket + 1 < NUM_BUCKETS) {
+      value >>= 1U;
+      ++bucket;
+    }
+    ++m_counts[bucket];
+  }
+
+  void merge(CountHistogram const &other) {
+    for (std::size_t idx = 0; idx < NUM_BUCKETS; ++idx) {
+      m_counts[idx] += other.m_counts[idx];
+    }
+  }
+
+  /// The smallest value of the bucket
+  static std::uint64_t lower_bound(std::size_t bucket) {
+    return bucket == 0 ? 0 : std::uint64_t{1} << (bucket - 1);
+  }
+};
+
+/// A histogram of values, in decades from 1e-15 to 1e9: bucket 0 counts the
+/// zeros and negative values, bucket 1 the values below 1e-15, and the last
+/// bucket the values from 1e9 up
+struct ValueHistogram {
+  static constexpr int MIN_EXP = -15;
+  static constexpr int MAX_EXP = 9;
+  static constexpr std::size_t NUM_BUCKETS = MAX_EXP - MIN_EXP + 3;
+  std::array<std::uint64_t, NUM_BUCKETS> m_counts{};
+
+  void add(double value) {
+    if (!(value > 0)) {
+      ++m_counts[0];
+      return;
+    }
+    auto const exp = static_cast<int>(std::floor(std::log10(value)));
+    auto const bucket = std::clamp(exp, MIN_EXP - 1, MAX_EXP) - MIN_EXP + 2;
+    ++m_counts[static_cast<std::size_t>(bucket)];
+  }
+
+  void merge(ValueHistogram const &other) {
+    for (std::size_t idx = 0; idx < NUM_BUCKETS; ++idx) {
+      m_counts[idx] += other.m_counts[idx];
+    }
+  }
+
+  /// The decade of the smallest value of the bucket, for buckets after 1
+  static int lower_exp(std::size_t bucket) {
+    return static_cast<int>(bucket) + MIN_EXP - 2;
+  }
+};
+
+struct NetSize {
+  std::string m_name;
+  std::uint64_t m_elements;  // connections, caps and resistors
+  double m_total_cap;
+};
+
+struct SPEFStats {
+  static constexpr std::size_t NUM_LARGEST = 10;
+
+  std::uint64_t m_num_d_nets{};
+  std::uint64_t m_num_r_nets{};
+  std::uint64_t m_num_conns{};
+  std::uint64_t m_num_ground_caps{};
+  std::uint64_t m_num_coupling_caps{};
+  std::uint64_t m_num_resistances{};
+  double m_total_cap{};  // the sum of the total caps of the nets
+  double m_total_res{};
+  CountHistogram m_fanout;  // connections per D_NET
+  CountHistogram m_caps;    // ground and coupling caps per D_NET
+  CountHistogram m_res;     // resistors per D_NET
+  ValueHistogram m_net_cap;  // total cap per net
+  ValueHistogram m_net_res;  // total resistance per D_NET
+  std::vector<NetSize> m_largest;  // by elements, largest first
+
+  void add(DNet const &d_net) {
+    ++m_num_d_nets;
+    m_num_conns += d_net.m_conns.size();
+    m_num_ground_caps += d_net.m_ground_caps.size();
+    m_num_coupling_caps += d_net.m_coupling_caps.size();
+    m_num_resistances += d_net.m_resistances.size();
+
+    double res = 0;
+    for (auto const &resistance : d_net.m_resistances) {
+      res += resistance.m_res;
+    }
+    m_total_cap += d_net.m_total_cap;
+    m_total_res += res;
+
+    auto const num_caps =
+        d_net.m_ground_caps.size() + d_net.m_coupling_caps.size();
+    m_fanout.add(d_net.m_conns.size());
+    m_caps.add(num_caps);
+    m_res.add(d_net.m_resistances.size());
+    m_net_cap.add(d_net.m_total_cap);
+    m_net_res.add(res);
+
+    add_largest(
+        {d_net.m_name,
+         d_net.m_conns.size() + num_caps + d_net.m_resistances.size(),
+         d_net.m_total_cap});
+  }
+
+  void add(RNet const &r_net) {
+    ++m_num_r_nets;
+    m_total_cap += r_net.m_total_cap;
+    m_net_cap.add(r_net.m_total_cap);
+  }
+
+  void merge(SPEFStats &&other) {
+    m_num_d_nets += other.m_num_d_nets;
+    m_num_r_nets += other.m_num_r_nets;
+    m_num_conns += other.m_num_conns;
+    m_num_ground_caps += other.m_num_ground_caps;
+    m_num_coupling_caps += other.m_num_coupling_caps;
+    m_num_resistances += other.m_num_resistances;
+    m_total_cap += other.m_total_cap;
+    m_total_res += other.m_total_res;
+    m_fanout.merge(other.m_fanout);
+    m_caps.merge(other.m_caps);
+    m_res.merge(other.m_res);
+    m_net_cap.merge(other.m_net_cap);
+    m_net_res.merge(other.m_net_res);
+    for (auto &net : other.m_largest) {
+      add_largest(std::move(net));
+    }
+  }
+
+private:
+  void add_largest(NetSize &&net) {
+    // ties are broken by name, so the result doesn't depend on the order
+    auto const larger = [](NetSize const &lhs, NetSize const &rhs) {
+      return lhs.m_elements != rhs.m_elements ? lhs.m_elements > rhs.m_elements
+                                              : lhs.m_name < rhs.m_name;
+    };
+    if (m_largest.size() == NUM_LARGEST && !larger(net, m_largest.back())) {
+      return;
+    }
+    m_largest.insert(
+        std::upper_bound(m_largest.begin(), m_largest.end(), net, larger),
+        std::move(net));
+    if (m_largest.size() > NUM_LARGEST) {
+      m_largest.pop_back();
+    }
+  }
+};
+
+namespace detail {
+/// Parses the nets one at a time and adds them to the statistics
+inline SPEFStats net_stats(
+    std::vector<std::pair<std::string_view, NetType>> const &nets,
+    std::string const &source) {
+  SPEFStats stats;
+  for (auto [text, type] : nets) {
+    // the grammar expects whitespace after *END, which is missing if the net
+    // is at the very end of the file
+    std::string buffer;
+    if (text.back() != '\n') {
+      buffer.reserve(text.size() + 1);
+      buffer.append(text).push_back('\n');
+      text = buffer;
+    }
+    pegtl::memory_input input(text.data(), text.data() + text.size(), source);
+    SPEF spef;
+    SPEFHelper spef_h{};
+    if (type == NetType::Detailed) {
+      pegtl::parse<pegtl::must<spef_d_net>, spef_action>(input, spef, spef_h);
+      stats.add(spef.m_d_nets.back());
+    } else {
+      pegtl::parse<pegtl::must<spef_r_net>, spef_action>(input, spef, spef_h);
+      stats.add(spef.m_r_nets.back());
+    }
+  }
+  return stats;
+}
+}  // namespace detail
+
+/// Computes the statistics of the nets of the given SPEF file in one pass
+inline SPEFStats compute_stats(
+    std::filesystem::path const &spef_file,
+    BS::thread_pool &pool,
+    std::size_t block_size = 64 * 1024 * 1024) {
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file(
+      std::fopen(spef_file.c_str(), "rb"),
+      &std::fclose);
+  if (!file) {
+    throw std::runtime_error(
+        fmt::format("Could not open {}", spef_file.string()));
+  }
+  auto const source = spef_file.string();
+
+  SPEFStats stats;
+  std::vector<char> buffer(block_size);
+  std::size_t carry = 0;
+  bool at_eof = false;
+  while (!at_eof) {
+    if (carry == buffer.size()) {
+      // a single net doesn't fit in the buffer
+      buffer.resize(buffer.size() * 2);
+    }
+    auto const bytes_read = std::fread(
+        buffer.data() + carry,
+        sizeof(char),
+        buffer.size() - carry,
+        file.get());
+    if (bytes_read == 0 && std::ferror(file.get()) != 0) {
+      throw std::runtime_error(fmt::format("Could not read {}", source));
+    }
+    at_eof = bytes_read == 0;
+    auto const size = carry + bytes_read;
+
+    // only complete lines are scanned, and only complete nets are parsed
+    char const *const data = buffer.data();
+    char const *end = data + size;
+    while (!at_eof && end != data && end[-1] != '\n') {
+      --end;
+    }
+    std::vector<std::pair<std::string_view, NetType>> nets;
+    char const *net_begin = nullptr;
+    NetType type = NetType::Detailed;
+    for (auto const &[begin, line_end] :
+         detail::find_net_lines(data, end, data, end)) {
+      if (begin[1] == 'E') {
+        if (net_begin != nullptr) {
+          nets.emplace_back(
+              std::string_view(
+                  net_begin,
+                  static_cast<std::size_t>(line_end - net_begin)),
+              type);
+          net_begin = nullptr;
+        }
+      } else {
+        net_begin = begin;
+        type = begin[1] == 'D' ? NetType::Detailed : NetType::Reduced;
+      }
+    }
+    if (at_eof && net_begin != nullptr) {
+      throw std::runtime_error(fmt::format(
+          "A net at the end of {} is not terminated by *END",
+          source));
+    }
+
+    // one task per thread, with about the same number of nets each
+    std::vector<std::future<SPEFStats>> tasks;
+    std::size_t const num_tasks =
+        std::min<std::size_t>(pool.get_thread_count(), nets.size());
+    for (std::size_t task = 0; task < num_tasks; ++task) {
+      std::vector<std::pair<std::string_view, NetType>> task_nets(
+          nets.begin() + static_cast<std::ptrdiff_t>(
+                             nets.size() * task / num_tasks),
+          nets.begin() + static_cast<std::ptrdiff_t>(
+                             nets.size() * (task + 1) / num_tasks));
+      tasks.push_back(pool.submit(
+          [&source, task_nets = std::move(task_nets)] {
+            return detail::net_stats(task_nets, source);
+          }));
+    }
+    for (auto &task : tasks) {
+      stats.merge(task.get());
+    }
+
+    // keep the incomplete net or line for the next block. The header and
+    // anything between the nets are skipped.
+    char const *const parsed_end = net_begin == nullptr ? end : net_begin;
+    carry = static_cast<std::size_t>(data + size - parsed_end);
+    std::memmove(buffer.data(), parsed_end, carry);
+  }
+  return stats;
+}
+
+namespace detail {
+inline std::string json_string(std::string_view str) {
+  std::string escaped{'"'};
+  for (char const chr : str) {
+    if (chr == '"' || chr == '\\') {
+      escaped += '\\';
+    }
+    escaped += chr;
+  }
+  escaped += '"';
+  return escaped;
+}
+
+inline void write_json_counts(
+    std::ostream &os,
+    std::string_view key,
+    CountHistogram const &histogram) {
+  fmt::print(os, "  {}: [", json_string(key));
+  bool is_first = true;
+  for (std::size_t idx = 0; idx < CountHistogram::NUM_BUCKETS; ++idx) {
+    if (histogram.m_counts[idx] != 0) {
+      fmt::print(
+          os,
+          "{}{{\"min\": {}, \"count\": {}}}",
+          is_first ? "" : ", ",
+          CountHistogram::lower_bound(idx),
+          histogram.m_counts[idx]);
+      is_first = false;
+    }
+  }
+  fmt::print(os, "],\n");
+}
+
+inline void write_json_values(
+    std::ostream &os,
+    std::string_view key,
+    ValueHistogram const &histogram) {
+  fmt::print(os, "  {}: [", json_string(key));
+  bool is_first = true;
+  for (std::size_t idx = 0; idx < ValueHistogram::NUM_BUCKETS; ++idx) {
+    if (histogram.m_counts[idx] != 0) {
+      // the bucket of zeros has no decade
+      if (idx == 0) {
+        fmt::print(
+            os,
+            "{{\"min\": 0, \"count\": {}}}",
+            histogram.m_counts[0]);
+      } else {
+        fmt::print(
+            os,
+            "{}{{\"min\": 1e{}, \"count\": {}}}",
+            is_first ? "" : ", ",
+            idx == 1 ? ValueHistogram::MIN_EXP - 1
+                     : ValueHistogram::lower_exp(idx),
+            histogram.m_counts[idx]);
+      }
+      is_first = false;
+    }
+  }
+  fmt::print(os, "],\n");
+}
+}  // namespace detail
+
+inline void write_stats_json(std::ostream &os, SPEFStats const &stats) {
+  fmt::print(os, "{{\n");
+  fmt::print(os, "  \"d_nets\": {},\n", stats.m_num_d_nets);
+  fmt::print(os, "  \"r_nets\": {},\n", stats.m_num_r_nets);
+  fmt::print(os, "  \"connections\": {},\n", stats.m_num_conns);
+  fmt::print(os, "  \"ground_caps\": {},\n", stats.m_num_ground_caps);
+  fmt::print(os, "  \"coupling_caps\": {},\n", stats.m_num_coupling_caps);
+  fmt::print(os, "  \"resistances\": {},\n", stats.m_num_resistances);
+  fmt::print(os, "  \"total_cap\": {},\n", stats.m_total_cap);
+  fmt::print(os, "  \"total_res\": {},\n", stats.m_total_res);
+  detail::write_json_counts(os, "fanout", stats.m_fanout);
+  detail::write_json_counts(os, "caps_per_net", stats.m_caps);
+  detail::write_json_counts(os, "res_per_net", stats.m_res);
+  detail::write_json_values(os, "net_cap", stats.m_net_cap);
+  detail::write_json_values(os, "net_res", stats.m_net_res);
+  fmt::print(os, "  \"largest\": [");
+  for (std::size_t idx = 0; idx < stats.m_largest.size(); ++idx) {
+    auto const &net = stats.m_largest[idx];
+    fmt::print(
+        os,
+        "{}{{\"name\": {}, \"elements\": {}, \"total_cap\": {}}}",
+        idx == 0 ? "" : ", ",
+        detail::json_string(net.m_name),
+        net.m_elements,
+        net.m_total_cap);
+  }
+  fmt::print(os, "]\n}}\n");
+}
+
+inline void write_stats_text(std::ostream &os, SPEFStats const &stats) {
+  fmt::print(
+      os,
+      "{} nets: {} D_NETs, {} R_NETs\n",
+      stats.m_num_d_nets + stats.m_num_r_nets,
+      stats.m_num_d_nets,
+      stats.m_num_r_nets);
+  fmt::print(
+      os,
+      "{} connections, {} ground caps, {} coupling caps, {} resistors\n",
+      stats.m_num_conns,
+      stats.m_num_ground_caps,
+      stats.m_num_coupling_caps,
+      stats.m_num_resistances);
+  fmt::print(
+      os,
+      "total cap {}, total resistance {}\n",
+      stats.m_total_cap,
+      stats.m_total_res);
+
+  auto const write_counts = [&os](
+                                std::string_view title,
+                                CountHistogram const &histogram) {
+    fmt::print(os, "\n{}\n", title);
+    for (std::size_t idx = 0; idx < CountHistogram::NUM_BUCKETS; ++idx) {
+      if (histogram.m_counts[idx] != 0) {
+        fmt::print(
+            os,
+            "  >= {:>10} {:>12}\n",
+            CountHistogram::lower_bound(idx),
+            histogram.m_counts[idx]);
+      }
+    }
+  };
+  auto const write_values = [&os](
+                                std::string_view title,
+                                ValueHistogram const &histogram) {
+    fmt::print(os, "\n{}\n", title);
+    for (std::size_t idx = 0; idx < ValueHistogram::NUM_BUCKETS; ++idx) {
+      if (histogram.m_counts[idx] == 0) {
+        continue;
+      }
+      if (idx == 0) {
+        fmt::print(os, "  {:>13} {:>12}\n", "0", histogram.m_counts[idx]);
+      } else if (idx == 1) {
+        fmt::print(
+            os,
+            "  < {:>11} {:>12}\n",
+            fmt::format("1e{}", ValueHistogram::MIN_EXP),
+            histogram.m_counts[idx]);
+      } else {
+        fmt::print(
+            os,
+            "  >= {:>10} {:>12}\n",
+            fmt::format("1e{}", ValueHistogram::lower_exp(idx)),
+            histogram.m_counts[idx]);
+      }
+    }
+  };
+  write_counts("connections per D_NET", stats.m_fanout);
+  write_counts("caps per D_NET", stats.m_caps);
+  write_counts("resistors per D_NET", stats.m_res);
+  write_values("total cap per net", stats.m_net_cap);
+  write_values("total resistance per D_NET", stats.m_net_res);
+
+  fmt::print(os, "\nlargest D_NETs\n");
+  for (auto const &net : stats.m_largest) {
+    fmt::print(
+        os,
+        "  {} {} elements, total cap {}\n",
+        net.m_name,
+        net.m_elements,
+        net.m_total_cap);
+  }
+}
+
+#endif  // SPEF_STATS_HPP
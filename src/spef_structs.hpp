@@ -13,13 +13,13 @@ struct sep : pegtl::plus<pegtl::sor<pegtl::blank, pegtl::eol>> {};
 // numbers
 struct spef_sign : pegtl::one<'+', '-'> {};
 struct spef_integer : pegtl::seq<pegtl::opt<spef_sign>, pegtl::plus<pegtl::digit>> {};
-struct spef_decimal : pegtl::seq<pegtl::opt<spef_sign>, pegtl::plus<pegtl::digit>, pegtl::one<'.'>, pegtl::star<pegtl::digit>> {};
-struct spef_fraction : pegtl::seq<pegtl::opt<spef_sign>, pegtl::one<'.'>, pegtl::star<pegtl::digit>> {};
-struct spef_radix : pegtl::sor<spef_integer, spef_decimal, spef_fraction> {};
 struct spef_exp_char : pegtl::one<'E', 'e'> {};
-struct spef_exp : pegtl::seq<spef_radix, spef_exp_char, spef_integer> {};
-struct spef_float : pegtl::sor<spef_decimal, spef_fraction, spef_exp> {};
-struct spef_number : pegtl::sor<spef_float, spef_integer> {};
+struct spef_exponent : pegtl::seq<spef_exp_char, spef_integer> {};
+struct spef_fraction_part : pegtl::seq<pegtl::one<'.'>, pegtl::star<pegtl::digit>> {};
+// the numbers are factored on their common prefix, so that no part of them is matched twice: [sign] (digits [fraction] | fraction) [exponent], where a float
+// must have the fraction or the exponent, e.g. 1.5e-3, 1., .5 or 1e3
+struct spef_float : pegtl::seq<pegtl::opt<spef_sign>, pegtl::sor<pegtl::seq<pegtl::plus<pegtl::digit>, pegtl::sor<pegtl::seq<spef_fraction_part, pegtl::opt<spef_exponent>>, spef_exponent>>, pegtl::seq<spef_fraction_part, pegtl::opt<spef_exponent>>>> {};
+struct spef_number : pegtl::seq<pegtl::opt<spef_sign>, pegtl::sor<pegtl::seq<pegtl::plus<pegtl::digit>, pegtl::opt<spef_fraction_part>>, spef_fraction_part>, pegtl::opt<spef_exponent>> {};
 struct spef_pos_integer : pegtl::plus<pegtl::digit> {};  // must not consume trailing whitespace
 struct spef_pos_decimal : pegtl::seq<pegtl::plus<pegtl::digit>, pegtl::one<'.'>, pegtl::opt<pegtl::plus<pegtl::digit>>> {};
 struct spef_pos_fraction : pegtl::seq<pegtl::one<'.'>, pegtl::plus<pegtl::digit>> {};
@@ -37,7 +37,8 @@ struct spef_escaped_char_set : pegtl::sor<spef_special_char, pegtl::one<'"'>> {}
 struct spef_escaped_char : pegtl::seq<pegtl::one<'\\'>, spef_escaped_char_set> {};
 struct spef_prefix_bus_delim : pegtl::one<'[', '{', '(', '<', ':', '.'> {};
 struct spef_suffix_bus_delim : pegtl::one<']', '}', ')', '>'> {};
-struct spef_identifier_char : pegtl::sor<spef_escaped_char, pegtl::alpha, pegtl::digit, pegtl::one<'_'>, spef_pin_delim, spef_hier_delim, spef_prefix_bus_delim, spef_suffix_bus_delim> {};
+// the pin, hierarchy and bus delimiters are matched by a single rule, and the rare escaped characters last, as they can't start with the same character
+struct spef_identifier_char : pegtl::sor<pegtl::alnum, pegtl::one<'_', '.', '/', ':', '|', '[', '{', '(', '<', ']', '}', ')', '>'>, spef_escaped_char> {};
 struct spef_identifier : pegtl::plus<spef_identifier_char> {};
 struct spef_bit_identifier : pegtl::sor<spef_identifier, pegtl::seq<spef_identifier, spef_prefix_bus_delim, spef_pos_integer, pegtl::opt<spef_suffix_bus_delim>>> {};
 struct spef_partial_path : pegtl::seq<spef_identifier, spef_hier_delim> {};
@@ -88,9 +89,9 @@ struct spef_power_def : pegtl::plus<pegtl::sor<spef_power_net_def, spef_ground_n
 
 // conn_attr
 #ifdef STRICT
-struct spef_par_value : pegtl::sor<pegtl::seq<spef_float, sep>, pegtl::seq<spef_float, pegtl::one<':'>, spef_float, pegtl::one<':'>, spef_float, sep>> {};
+struct spef_par_value : pegtl::seq<spef_float, pegtl::opt<pegtl::one<':'>, spef_float, pegtl::one<':'>, spef_float>, sep> {};
 #else
-struct spef_par_value : pegtl::sor<pegtl::seq<spef_number, sep>, pegtl::seq<spef_number, pegtl::one<':'>, spef_number, pegtl::one<':'>, spef_number, sep>> {};
+struct spef_par_value : pegtl::seq<spef_number, pegtl::opt<pegtl::one<':'>, spef_number, pegtl::one<':'>, spef_number>, sep> {};
 #endif
 struct spef_coordinates : pegtl::seq<TAO_PEGTL_STRING("*C"), sep, pegtl::must<spef_number, sep, spef_number, sep>> {};
 struct spef_cap_load : pegtl::seq<TAO_PEGTL_STRING("*L"), sep, pegtl::must<spef_par_value>> {};
@@ -106,7 +107,8 @@ struct spef_inst_name : pegtl::sor<spef_index, spef_path> {};
 struct spef_physical_inst : pegtl::sor<spef_index, spef_physical_ref> {};
 struct spef_port : pegtl::sor<spef_index, spef_bit_identifier> {};
 struct spef_pport : pegtl::sor<spef_index, spef_name> {};
-struct spef_port_name : pegtl::seq<pegtl::opt<pegtl::seq<spef_inst_name, spef_pin_delim>>, spef_port> {};
+// an instance path matches all the delimiters, so only an *index instance can be followed by the pin delimiter
+struct spef_port_name : pegtl::seq<pegtl::opt<pegtl::seq<spef_index, spef_pin_delim>>, spef_port> {};
 struct spef_pport_name : pegtl::seq<pegtl::opt<pegtl::seq<spef_physical_inst, spef_pin_delim>>, spef_pport> {};
 struct spef_port_entry : pegtl::seq<spef_port_name, sep, spef_direction, sep, pegtl::star<spef_conn_attr>> {};
 struct spef_pport_entry : pegtl::seq<spef_pport_name, sep, spef_direction, sep, pegtl::star<spef_conn_attr>> {};
@@ -132,21 +134,22 @@ struct spef_crt_entry2 : pegtl::seq<spef_param_id, sep, TAO_PEGTL_STRING("CRT2")
 struct spef_nominal_temperature : spef_float {};
 struct spef_temperature_coeff_def : pegtl::seq<spef_crt_entry1, sep, spef_crt_entry2, sep, spef_nominal_temperature> {};
 struct spef_process_param_def : pegtl::seq<spef_param_id, sep, spef_param_name, sep, spef_param_type_for_cap, sep, spef_param_type_for_res, sep, spef_param_type_for_induct, sep, spef_var_coeff, sep, spef_normalization_factor> {};
-struct spef_variation_def : pegtl::seq<TAO_PEGTL_STRING("*VARIATION_PARAMETERS"), sep, pegtl::must<pegtl::sor<pegtl::seq<pegtl::star<spef_process_param_def, sep>, spef_temperature_coeff_def>, pegtl::plus<spef_process_param_def, sep>>>> {};
+// the parameters are matched only once, so that their actions aren't applied twice
+struct spef_variation_def : pegtl::seq<TAO_PEGTL_STRING("*VARIATION_PARAMETERS"), sep, pegtl::must<pegtl::star<spef_process_param_def, sep>, pegtl::opt<spef_temperature_coeff_def, sep>>> {};
 
 // conn_sec
 struct spef_pnode : pegtl::sor<spef_index, spef_bit_identifier> {};
 struct spef_pnode_ref : pegtl::seq<spef_physical_inst, spef_pin_delim, spef_pnode, sep> {};  // consumes whitespace
 struct spef_pin : pegtl::sor<spef_index, spef_bit_identifier> {};
 #ifdef STRICT
-struct spef_pin_name : pegtl::seq<spef_inst_name, spef_pin_delim, spef_pin, sep> {};  // consumes whitespace
+struct spef_pin_name : pegtl::seq<spef_index, spef_pin_delim, spef_pin, sep> {};  // consumes whitespace, see spef_port_name
 #else
-struct spef_pin_name : pegtl::seq<pegtl::opt<spef_inst_name, spef_pin_delim>, spef_pin, sep> {};  // consumes whitespace
+struct spef_pin_name : pegtl::seq<pegtl::opt<spef_index, spef_pin_delim>, spef_pin, sep> {};  // consumes whitespace, see spef_port_name
 #endif
 struct spef_external_connection : pegtl::seq<pegtl::sor<spef_port_name, spef_pport_name>, sep> {};  // consumes whitespace
 struct spef_internal_connection : pegtl::sor<spef_pin_name, spef_pnode_ref> {};  // consumes whitespace
 struct spef_internal_node_name : pegtl::seq<spef_net_ref, spef_pin_delim, spef_pos_integer, sep> {}; // consumes whitespace
-struct spef_internal_node_coord : pegtl::seq<TAO_PEGTL_STRING("*N"), sep, pegtl::must<spef_internal_node_name, spef_coordinates, sep>> {};
+struct spef_internal_node_coord : pegtl::seq<TAO_PEGTL_STRING("*N"), sep, pegtl::must<spef_internal_node_name, spef_coordinates>> {};  // consumes whitespace
 struct spef_internal_connection_def : pegtl::seq<TAO_PEGTL_STRING("*I"), sep, pegtl::must<spef_internal_connection, spef_direction, sep, pegtl::star<spef_conn_attr>>> {};
 struct spef_external_connection_def : pegtl::seq<TAO_PEGTL_STRING("*P"), sep, pegtl::must<spef_external_connection, spef_direction, sep, pegtl::star<spef_conn_attr>>> {};
 struct spef_conn_def : pegtl::sor<spef_external_connection_def, spef_internal_connection_def> {};
@@ -159,9 +162,10 @@ struct spef_node_name : pegtl::sor<spef_external_connection, spef_internal_conne
 struct spef_node_name2 : pegtl::sor<spef_node_name, pegtl::seq<spef_pnet_ref, spef_pin_delim, spef_pos_integer, sep>, pegtl::seq<spef_net_ref2, spef_pin_delim, spef_pos_integer, sep>> {};  // consumes whitespace
 struct spef_sensitivity_coeff : spef_float {};  // must not consume trailing whitespace
 struct spef_sensitivity : pegtl::seq<TAO_PEGTL_STRING("*SC"), sep, pegtl::must<pegtl::plus<spef_param_id, pegtl::one<':'>, spef_sensitivity_coeff, sep>>> {};  // consumes whitespace
-struct spef_cap_elem_ground : pegtl::seq<spef_cap_id, spef_node_name, spef_par_value, pegtl::opt<spef_sensitivity>> {};
-struct spef_cap_elem_coupling : pegtl::seq<spef_cap_id, spef_node_name, spef_node_name2, spef_par_value, pegtl::opt<spef_sensitivity>> {};
-struct spef_cap_elem : pegtl::sor<spef_cap_elem_ground, spef_cap_elem_coupling> {};
+// the ground and the coupling caps share the id and the first node, which are matched once
+struct spef_cap_ground_value : pegtl::seq<spef_par_value, pegtl::opt<spef_sensitivity>> {};
+struct spef_cap_coupling_value : pegtl::seq<spef_node_name2, spef_par_value, pegtl::opt<spef_sensitivity>> {};
+struct spef_cap_elem : pegtl::seq<spef_cap_id, spef_node_name, pegtl::sor<spef_cap_ground_value, spef_cap_coupling_value>> {};
 struct spef_cap_sec : pegtl::seq<TAO_PEGTL_STRING("*CAP"), sep, pegtl::must<pegtl::plus<spef_cap_elem>>> {};
 
 // res_sec
@@ -178,10 +182,10 @@ struct spef_induc_sec : pegtl::seq<TAO_PEGTL_STRING("*INDUC"), sep, pegtl::must<
 struct spef_real_component : spef_number {};
 struct spef_imaginary_component : spef_number {};
 struct spef_cnumber : pegtl::seq<pegtl::one<'('>, pegtl::opt<sep>, spef_real_component, sep, spef_imaginary_component, pegtl::opt<sep>, pegtl::one<')'>> {};
-struct spef_complex_par_value : pegtl::seq<pegtl::sor<spef_cnumber, spef_number, pegtl::seq<spef_cnumber, pegtl::one<':'>, spef_cnumber, pegtl::one<':'>, spef_cnumber>, pegtl::seq<spef_number, pegtl::one<':'>, spef_number, pegtl::one<':'>, spef_number>>, sep> {};
+struct spef_complex_par_value : pegtl::sor<pegtl::seq<spef_cnumber, sep>, pegtl::seq<spef_number, sep>, pegtl::seq<spef_cnumber, pegtl::one<':'>, spef_cnumber, pegtl::one<':'>, spef_cnumber, sep>, pegtl::seq<spef_number, pegtl::one<':'>, spef_number, pegtl::one<':'>, spef_number, sep>> {};  // consumes whitespace
 struct spef_pole : spef_complex_par_value {};
 struct spef_pole_desc : pegtl::seq<TAO_PEGTL_STRING("*Q"), sep, pegtl::must<spef_pos_integer, sep, pegtl::plus<spef_pole>>> {};
-struct spef_residue : pegtl::seq<spef_complex_par_value, sep> {};
+struct spef_residue : spef_complex_par_value {};
 struct spef_residue_desc : pegtl::seq<TAO_PEGTL_STRING("*K"), sep, pegtl::must<spef_pos_integer, sep, pegtl::plus<spef_residue>>> {};
 struct spef_pole_residue_desc : pegtl::seq<spef_pole_desc, spef_residue_desc> {};
 struct spef_rc_desc : pegtl::seq<TAO_PEGTL_STRING("*RC"), sep, pegtl::must<spef_pin_name, spef_par_value, pegtl::opt<spef_pole_residue_desc>>> {};
@@ -196,7 +200,7 @@ struct spef_d_pnet : pegtl::one<'.'> {};
 // r_net (reduced net)
 struct spef_driver_pin : pegtl::seq<TAO_PEGTL_STRING("*DRIVER"), sep, pegtl::must<spef_pin_name>> {};  // consumes whitespace
 struct spef_driver_cell : pegtl::seq<TAO_PEGTL_STRING("*CELL"), sep, pegtl::must<spef_cell_type, sep>> {};
-struct spef_pi_model : pegtl::seq<TAO_PEGTL_STRING("*C2_R1_C1"), sep, pegtl::must<spef_par_value, sep, spef_par_value, sep, spef_par_value, sep>> {};
+struct spef_pi_model : pegtl::seq<TAO_PEGTL_STRING("*C2_R1_C1"), sep, pegtl::must<spef_par_value, spef_par_value, spef_par_value>> {};  // consumes whitespace
 struct spef_driver_reduc : pegtl::seq<spef_driver_pin, spef_driver_cell, spef_pi_model, spef_load_desc> {};
 struct spef_r_net_begin : TAO_PEGTL_STRING("*R_NET") {};
 struct spef_r_net_end : TAO_PEGTL_STRING("*END") {};
@@ -212,23 +216,61 @@ struct spef_nets : pegtl::sor<spef_d_net, spef_r_net, spef_d_pnet, spef_r_pnet>
 struct spef_internal_def : pegtl::plus<spef_nets> {};
 
 struct spef_grammar : pegtl::seq<spef_header_def, pegtl::opt<spef_name_map>, pegtl::opt<spef_power_def>, pegtl::opt<spef_external_def>, pegtl::opt<spef_define_def>, pegtl::opt<spef_variation_def>, spef_internal_def> {};
+
+// lazy loading: everything before the first net, and the first line of a d_net
+struct spef_preamble : pegtl::seq<spef_header_def, pegtl::opt<spef_name_map>, pegtl::opt<spef_power_def>, pegtl::opt<spef_external_def>, pegtl::opt<spef_define_def>, pegtl::opt<spef_variation_def>> {};
+struct spef_d_net_header : pegtl::seq<spef_d_net_begin, sep, pegtl::must<spef_net_ref, sep, spef_total_cap, pegtl::opt<spef_routing_conf>>> {};
 // clang-format on
 
 // ACTION STRUCTS
 
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <unordered_map>
-
+#include <utility>
+
+// With SPEF_FLOAT_VALUES, capacitances and resistances are stored as float
+// instead of double, which halves the memory of the values of the nets. A float
+// has 24 significant bits, so every value is rounded to a relative error of at
+// most 2^-24 (about 6e-8), i.e. about 7 significant digits, which is more than
+// the 3 to 6 digits written by extractors. Its range (1e-38 to 3e38) covers
+// values both in file units and in SI units (e.g. 1e-15 F). Sums over many
+// values, such as the total cap of a net, accumulate the rounding errors.
+#ifdef SPEF_FLOAT_VALUES
+using cap_t = float;
+using res_t = float;
+#else
 using cap_t = double;
 using res_t = double;
+#endif
 using coord_t = double;
 using thresh_t = double;
 
+enum struct UnitType {
+  None,
+  Second,  // only after normalize_units
+  Nanosecond,
+  Picosecond,
+  Farad,  // only after normalize_units
+  Picofarad,
+  Femtofarad,
+  Ohm,
+  Kiloohm,
+  Henry,
+  Millihenry,
+  Microhenry
+};
+
 struct scaled_value {
   double value{0};
-  std::string unit{};
+  UnitType unit{UnitType::None};
 
   [[nodiscard]] explicit constexpr operator bool() const {
-    return value != 0 || !unit.empty();
+    return value != 0 || unit != UnitType::None;
   }
 };
 
@@ -336,6 +378,271 @@ struct PhysicalPort {
   std::vector<std::unique_ptr<ConnAttr>> m_conn_attrs;
 };
 
+/// A read-only view of contiguous values, like the std::span of C++20
+template<typename T>
+class ValueSpan {
+private:
+  T const *m_data = nullptr;
+  std::size_t m_size = 0;
+
+public:
+  ValueSpan() = default;
+  ValueSpan(T const *data, std::size_t size) : m_data(data), m_size(size) {}
+  ValueSpan(std::vector<T> const &values)
+      : m_data(values.data()),
+        m_size(values.size()) {}
+
+  [[nodiscard]] std::size_t size() const { return m_size; }
+  [[nodiscard]] bool empty() const { return m_size == 0; }
+  [[nodiscard]] T const &operator[](std::size_t idx) const {
+    return m_data[idx];
+  }
+  [[nodiscard]] T const *begin() const { return m_data; }
+  [[nodiscard]] T const *end() const { return m_data + m_size; }
+};
+
+/// The *SC sensitivities of the caps or the resistors of a net to the process
+/// parameters, in coordinate form: element m_elements[k] has the sensitivity
+/// m_coeffs[k] to the parameter with id m_params[k]. The elements are indices
+/// in the vector of the caps or resistors, in increasing order.
+struct SensitivitiesView {
+  ValueSpan<std::uint32_t> m_elements;
+  ValueSpan<std::uint32_t> m_params;
+  ValueSpan<double> m_coeffs;
+
+  [[nodiscard]] std::size_t size() const { return m_elements.size(); }
+  [[nodiscard]] bool empty() const { return m_elements.empty(); }
+};
+
+/// The sensitivities of a net while it is parsed
+struct Sensitivities {
+  std::vector<std::uint32_t> m_elements;
+  std::vector<std::uint32_t> m_params;
+  std::vector<double> m_coeffs;
+
+  [[nodiscard]] std::size_t size() const { return m_elements.size(); }
+  [[nodiscard]] bool empty() const { return m_elements.empty(); }
+
+  [[nodiscard]] SensitivitiesView view() const {
+    return {m_elements, m_params, m_coeffs};
+  }
+
+  void clear() {
+    m_elements.clear();
+    m_params.clear();
+    m_coeffs.clear();
+  }
+};
+
+enum struct Corner : std::uint8_t { Min, Typ, Max };
+
+constexpr std::size_t NUM_CORNERS = 3;
+
+/// The values of the caps or the resistors of a net at the corners of their
+/// min:typ:max par_values, corner-major: one contiguous array per corner,
+/// indexed like the elements. It is empty if all the values of the net are
+/// single values, which are the same at every corner.
+template<typename T>
+class CornerValuesView {
+private:
+  std::array<T const *, NUM_CORNERS> m_values{};
+  std::size_t m_size{};
+
+public:
+  CornerValuesView() = default;
+  CornerValuesView(std::array<T const *, NUM_CORNERS> values, std::size_t size)
+      : m_values(values),
+        m_size(size) {}
+
+  [[nodiscard]] std::size_t size() const { return m_size; }
+  [[nodiscard]] bool empty() const { return m_size == 0; }
+
+  [[nodiscard]] ValueSpan<T> operator[](Corner corner) const {
+    return {m_values[static_cast<std::size_t>(corner)], m_size};
+  }
+};
+
+/// The corner values of a net while it is parsed, or of an R_NET
+template<typename T>
+struct CornerValues {
+  std::array<std::vector<T>, NUM_CORNERS> m_values;
+
+  [[nodiscard]] std::size_t size() const { return m_values[0].size(); }
+  [[nodiscard]] bool empty() const { return m_values[0].empty(); }
+
+  [[nodiscard]] ValueSpan<T> operator[](Corner corner) const {
+    return m_values[static_cast<std::size_t>(corner)];
+  }
+
+  [[nodiscard]] CornerValuesView<T> view() const {
+    return {{m_values[0].data(), m_values[1].data(), m_values[2].data()},
+            size()};
+  }
+
+  void push_back(T min, T typ, T max) {
+    m_values[0].push_back(min);
+    m_values[1].push_back(typ);
+    m_values[2].push_back(max);
+  }
+
+  void clear() {
+    for (auto &values : m_values) {
+      values.clear();
+    }
+  }
+
+  void scale(double factor) {
+    for (auto &values : m_values) {
+      for (auto &value : values) {
+        value *= factor;
+      }
+    }
+  }
+};
+
+/// The ranges of the D_NETs of a SPEF in columns of values that are shared by
+/// all the nets, in compressed sparse row form: the values of net n are
+/// [m_offsets[n], m_offsets[n + 1]). The offsets end at the last net with
+/// values, so the nets after it, and all the nets if no net has values, cost
+/// no memory.
+struct NetRanges {
+  std::vector<std::size_t> m_offsets;
+
+  /// The number of nets up to the last one with values
+  [[nodiscard]] std::size_t num_nets() const {
+    return m_offsets.empty() ? 0 : m_offsets.size() - 1;
+  }
+
+  /// Returns the first value and the number of values of the net
+  [[nodiscard]] std::pair<std::size_t, std::size_t>
+  range(std::size_t net) const {
+    if (net >= num_nets()) {
+      return {0, 0};
+    }
+    return {m_offsets[net], m_offsets[net + 1] - m_offsets[net]};
+  }
+
+  /// Ends the values of the net, which must come after the nets already added,
+  /// at end
+  void add(std::size_t net, std::size_t end) {
+    if (m_offsets.empty()) {
+      m_offsets.push_back(0);
+    }
+    m_offsets.resize(net + 1, m_offsets.back());
+    m_offsets.push_back(end);
+  }
+
+  /// Drops the nets from num_nets on, and returns the end of the values that
+  /// are kept
+  std::size_t truncate(std::size_t num_nets) {
+    if (num_nets < this->num_nets()) {
+      m_offsets.resize(num_nets + 1);
+    }
+    return m_offsets.empty() ? 0 : m_offsets.back();
+  }
+};
+
+/// The corner values of the caps or the resistors of all the D_NETs of a SPEF,
+/// in one array per corner
+template<typename T>
+struct CornerColumns {
+  NetRanges m_ranges;
+  std::array<std::vector<T>, NUM_CORNERS> m_values;
+
+  [[nodiscard]] CornerValuesView<T> net(std::size_t net) const {
+    auto const [first, size] = m_ranges.range(net);
+    return {
+        {m_values[0].data() + first,
+         m_values[1].data() + first,
+         m_values[2].data() + first},
+        size};
+  }
+
+  void append(std::size_t net, CornerValuesView<T> corners) {
+    if (corners.empty()) {
+      return;
+    }
+    for (std::size_t corner = 0; corner < NUM_CORNERS; ++corner) {
+      auto const values = corners[static_cast<Corner>(corner)];
+      m_values[corner].insert(
+          m_values[corner].end(),
+          values.begin(),
+          values.end());
+    }
+    m_ranges.add(net, m_values[0].size());
+  }
+
+  void truncate(std::size_t num_nets) {
+    auto const end = m_ranges.truncate(num_nets);
+    for (auto &values : m_values) {
+      values.resize(end);
+    }
+  }
+
+  void scale(double factor) {
+    for (auto &values : m_values) {
+      for (auto &value : values) {
+        value *= factor;
+      }
+    }
+  }
+};
+
+/// The sensitivities of the caps or the resistors of all the D_NETs of a SPEF
+struct SensitivityColumns {
+  NetRanges m_ranges;
+  std::vector<std::uint32_t> m_elements;
+  std::vector<std::uint32_t> m_params;
+  std::vector<double> m_coeffs;
+
+  [[nodiscard]] SensitivitiesView net(std::size_t net) const {
+    auto const [first, size] = m_ranges.range(net);
+    return {
+        {m_elements.data() + first, size},
+        {m_params.data() + first, size},
+        {m_coeffs.data() + first, size}};
+  }
+
+  void append(std::size_t net, SensitivitiesView sens) {
+    if (sens.empty()) {
+      return;
+    }
+    m_elements.insert(
+        m_elements.end(),
+        sens.m_elements.begin(),
+        sens.m_elements.end());
+    m_params.insert(m_params.end(), sens.m_params.begin(), sens.m_params.end());
+    m_coeffs.insert(m_coeffs.end(), sens.m_coeffs.begin(), sens.m_coeffs.end());
+    m_ranges.add(net, m_elements.size());
+  }
+
+  void truncate(std::size_t num_nets) {
+    auto const end = m_ranges.truncate(num_nets);
+    m_elements.resize(end);
+    m_params.resize(end);
+    m_coeffs.resize(end);
+  }
+};
+
+/// A process parameter of *VARIATION_PARAMETERS
+struct VariationParameter {
+  std::uint32_t m_id;
+  std::string m_name;  // with its quotes
+  char m_cap_type;     // N, D or X
+  char m_res_type;
+  char m_induct_type;
+  double m_var_coeff;
+  double m_normalization;
+};
+
+/// The parameters that are the first and second order temperature
+/// coefficients of the resistances
+struct TemperatureCoeffs {
+  std::uint32_t m_crt1;
+  std::uint32_t m_crt2;
+  double m_nominal_temp;
+};
+
 struct DNet {
   struct Connection;
   struct InternalNode;
@@ -351,6 +658,8 @@ struct DNet {
   std::vector<GroundCapacitance> m_ground_caps;
   std::vector<CouplingCapacitance> m_coupling_caps;
   std::vector<Resistance> m_resistances;
+  // the values of the elements are their typ values, and their corners and
+  // sensitivities are in SPEF::m_d_net_variations
 };
 
 struct DNet::Connection {
@@ -383,10 +692,166 @@ struct DNet::Resistance {
   res_t m_res;
 };
 
+/// The sensitivities and the corner values of the elements of a D_NET, and
+/// the corners of its total cap, which has one value if it is a min:typ:max
+/// triplet
+struct DNetVariationsView {
+  SensitivitiesView m_ground_cap_sens;
+  SensitivitiesView m_coupling_cap_sens;
+  SensitivitiesView m_res_sens;
+  CornerValuesView<cap_t> m_ground_cap_corners;
+  CornerValuesView<cap_t> m_coupling_cap_corners;
+  CornerValuesView<res_t> m_res_corners;
+  CornerValuesView<cap_t> m_total_cap_corners;
+};
+
+/// The sensitivities and the corner values of a D_NET while it is parsed
+struct DNetVariations {
+  Sensitivities m_ground_cap_sens;
+  Sensitivities m_coupling_cap_sens;
+  Sensitivities m_res_sens;
+  CornerValues<cap_t> m_ground_cap_corners;
+  CornerValues<cap_t> m_coupling_cap_corners;
+  CornerValues<res_t> m_res_corners;
+  CornerValues<cap_t> m_total_cap_corners;
+
+  void clear() {
+    m_ground_cap_sens.clear();
+    m_coupling_cap_sens.clear();
+    m_res_sens.clear();
+    m_ground_cap_corners.clear();
+    m_coupling_cap_corners.clear();
+    m_res_corners.clear();
+    m_total_cap_corners.clear();
+  }
+
+  [[nodiscard]] DNetVariationsView view() const {
+    return {
+        m_ground_cap_sens.view(),
+        m_coupling_cap_sens.view(),
+        m_res_sens.view(),
+        m_ground_cap_corners.view(),
+        m_coupling_cap_corners.view(),
+        m_res_corners.view(),
+        m_total_cap_corners.view()};
+  }
+};
+
+/// The sensitivities and the corner values of the elements of all the D_NETs
+/// of a SPEF, numbered as in SPEF::m_d_nets. They are kept in columns shared
+/// by the nets rather than in every DNet, as most nets have none, and the
+/// few that have them are appended when they are parsed.
+struct DNetVariationColumns {
+  SensitivityColumns m_ground_cap_sens;
+  SensitivityColumns m_coupling_cap_sens;
+  SensitivityColumns m_res_sens;
+  CornerColumns<cap_t> m_ground_cap_corners;
+  CornerColumns<cap_t> m_coupling_cap_corners;
+  CornerColumns<res_t> m_res_corners;
+  CornerColumns<cap_t> m_total_cap_corners;
+
+  [[nodiscard]] DNetVariationsView net(std::size_t net) const {
+    return {
+        m_ground_cap_sens.net(net),
+        m_coupling_cap_sens.net(net),
+        m_res_sens.net(net),
+        m_ground_cap_corners.net(net),
+        m_coupling_cap_corners.net(net),
+        m_res_corners.net(net),
+        m_total_cap_corners.net(net)};
+  }
+
+  /// The number of nets up to the last one with sensitivities or corners
+  [[nodiscard]] std::size_t num_nets() const {
+    return std::max(
+        {m_ground_cap_sens.m_ranges.num_nets(),
+         m_coupling_cap_sens.m_ranges.num_nets(),
+         m_res_sens.m_ranges.num_nets(),
+         m_ground_cap_corners.m_ranges.num_nets(),
+         m_coupling_cap_corners.m_ranges.num_nets(),
+         m_res_corners.m_ranges.num_nets(),
+         m_total_cap_corners.m_ranges.num_nets()});
+  }
+
+  /// Appends the variations of the net, which must come after the nets
+  /// already appended
+  void append(std::size_t net, DNetVariationsView const &variations) {
+    m_ground_cap_sens.append(net, variations.m_ground_cap_sens);
+    m_coupling_cap_sens.append(net, variations.m_coupling_cap_sens);
+    m_res_sens.append(net, variations.m_res_sens);
+    m_ground_cap_corners.append(net, variations.m_ground_cap_corners);
+    m_coupling_cap_corners.append(net, variations.m_coupling_cap_corners);
+    m_res_corners.append(net, variations.m_res_corners);
+    m_total_cap_corners.append(net, variations.m_total_cap_corners);
+  }
+
+  /// Appends the variations of the nets of other, whose nets are numbered
+  /// from first_net
+  void append(std::size_t first_net, DNetVariationColumns const &other) {
+    for (std::size_t net = 0; net < other.num_nets(); ++net) {
+      append(first_net + net, other.net(net));
+    }
+  }
+
+  /// Drops the variations of the nets from num_nets on
+  void truncate(std::size_t num_nets) {
+    m_ground_cap_sens.truncate(num_nets);
+    m_coupling_cap_sens.truncate(num_nets);
+    m_res_sens.truncate(num_nets);
+    m_ground_cap_corners.truncate(num_nets);
+    m_coupling_cap_corners.truncate(num_nets);
+    m_res_corners.truncate(num_nets);
+    m_total_cap_corners.truncate(num_nets);
+  }
+};
+
+/// A D_NET that is parsed on its own, with its variations
+struct SingleDNet {
+  DNet m_d_net;
+  DNetVariationColumns m_variations;  // of the net only
+
+  [[nodiscard]] DNetVariationsView variations() const {
+    return m_variations.net(0);
+  }
+};
+
 struct RNet {
+  // the C2-R1-C1 pi model seen by the driver, with C2 at the driver side
+  struct PiModel {
+    cap_t m_c2;
+    res_t m_r1;
+    cap_t m_c1;
+  };
+  struct Load;
+
   std::string m_name;
   cap_t m_total_cap;
   unsigned int m_routing_conf;
+  std::string m_driver;       // driver pin, empty if the net has no reduction
+  std::string m_driver_cell;  // cell type of the driver
+  PiModel m_pi_model;
+  std::vector<Load> m_loads;
+  // the *Q poles and *K residues of all the loads, in the order of the loads
+  std::vector<std::complex<double>> m_poles;     // in 1 / T_UNIT
+  std::vector<std::complex<double>> m_residues;  // in 1 / T_UNIT
+  // the values above are their typ values. The total cap and the pi model at
+  // the corners are set if one of their values is a min:typ:max triplet, and
+  // the corners of the *RC values, the poles and the residues are like those
+  // of a DNet.
+  std::optional<std::array<cap_t, NUM_CORNERS>> m_total_cap_corners;
+  std::optional<std::array<PiModel, NUM_CORNERS>> m_pi_model_corners;
+  CornerValues<double> m_rc_corners;  // indexed like m_loads
+  CornerValues<std::complex<double>> m_pole_corners;
+  CornerValues<std::complex<double>> m_residue_corners;
+};
+
+struct RNet::Load {
+  std::string m_pin;
+  double m_rc;  // Elmore delay from the driver, in T_UNIT
+  // the poles and residues of the load are
+  // [m_first_pole, m_first_pole + m_num_poles) of RNet::m_poles and m_residues
+  std::uint32_t m_first_pole{};
+  std::uint32_t m_num_poles{};
 };
 
 struct SPEF {
@@ -417,10 +882,18 @@ struct SPEF {
   std::vector<Port> m_ports;
   std::vector<PhysicalPort> m_physcial_ports;
   std::unordered_map<std::string, std::string> m_name_map;
+  std::vector<VariationParameter> m_variation_params;
+  std::optional<TemperatureCoeffs> m_temperature_coeffs;
   std::vector<DNet> m_d_nets;
+  DNetVariationColumns m_d_net_variations;  // of m_d_nets
   std::vector<RNet> m_r_nets;
 };
 
+/// Moves the only D_NET of the SPEF out, with its variations
+inline SingleDNet take_single_d_net(SPEF &spef) {
+  return {std::move(spef.m_d_nets.back()), std::move(spef.m_d_net_variations)};
+}
+
 // temporary data structure to be filled during parsing, and parts of it can be
 // then moved to the SPEF structure
 struct SPEFHelper {
@@ -429,7 +902,10 @@ struct SPEFHelper {
   bool reading_d_net;
   bool reading_r_net;
   DNet m_current_d_net;
+  DNetVariations m_current_variations;  // of m_current_d_net
   RNet m_current_r_net;
   std::vector<std::unique_ptr<ConnAttr>> attributes;
+  // called with every D_NET at its *END, before it is added to the SPEF
+  std::function<void(SPEF const &, DNet &)> m_d_net_end;
 };
 #endif  // SPEF_STRUCTS_HPP
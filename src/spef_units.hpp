@@ -0,0 +1,168 @@
+#ifndef SPEF_UNITS_HPP
+#define SPEF_UNITS_HPP
+
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+/// Returns the multiplier that converts the given unit to seconds, Farad, Ohm
+/// or Henry
+inline double unit_multiplier(UnitType unit) {
+  switch (unit) {
+  case UnitType::Second:
+  case UnitType::Farad:
+  case UnitType::Ohm:
+  case UnitType::Henry:
+    return 1;
+  case UnitType::Nanosecond:
+    return 1e-9;
+  case UnitType::Picosecond:
+  case UnitType::Picofarad:
+    return 1e-12;
+  case UnitType::Femtofarad:
+    return 1e-15;
+  case UnitType::Kiloohm:
+    return 1e3;
+  case UnitType::Millihenry:
+    return 1e-3;
+  case UnitType::Microhenry:
+    return 1e-6;
+  case UnitType::None:
+    break;
+  }
+  throw std::runtime_error("Unknown unit");
+}
+
+/// Returns the factor that converts values in the given scale to SI units, or
+/// 1 if the scale is missing
+inline double si_factor(scaled_value const &scale) {
+  return scale ? scale.value * unit_multiplier(scale.unit) : 1;
+}
+
+namespace detail {
+inline void scale_conn_attrs(
+    std::vector<std::unique_ptr<ConnAttr>> &conn_attrs,
+    double cap_factor,
+    double time_factor) {
+  for (auto &conn_attr : conn_attrs) {
+    if (conn_attr->m_type == ConnAttrType::CapLoad) {
+      for (auto &cap :
+           static_cast<CapLoadAttr *>(conn_attr.get())->m_cap.m_caps) {
+        cap *= cap_factor;
+      }
+    } else if (conn_attr->m_type == ConnAttrType::Slews) {
+      // the slews are times, despite their type
+      auto &slews = *static_cast<SlewsAttr *>(conn_attr.get());
+      for (auto &slew : slews.m_cap1.m_caps) {
+        slew *= time_factor;
+      }
+      for (auto &slew : slews.m_cap2.m_caps) {
+        slew *= time_factor;
+      }
+    }
+  }
+}
+}  // namespace detail
+
+/// Converts all the capacitances, resistances and times of the SPEF to
+/// Farad, Ohm and seconds, and sets its units to match. The nets are converted
+/// in parallel. Coordinates are left as they are, since SPEF has no unit for
+/// them, and values with a missing unit are left as they are.
+///
+/// SPEF has no keywords for seconds and Farad, so a normalized SPEF is written
+/// back with the units 1e9 NS and 1e12 PF.
+inline void normalize_units(SPEF &spef, BS::thread_pool &pool) {
+  double const cap_factor = si_factor(spef.m_cap_scale);
+  double const res_factor = si_factor(spef.m_res_scale);
+  double const time_factor = si_factor(spef.m_time_scale);
+
+  for (auto &port : spef.m_ports) {
+    detail::scale_conn_attrs(port.m_conn_attrs, cap_factor, time_factor);
+  }
+  for (auto &pport : spef.m_physcial_ports) {
+    detail::scale_conn_attrs(pport.m_conn_attrs, cap_factor, time_factor);
+  }
+
+  pool.parallelize_loop(
+          spef.m_d_nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            for (std::size_t idx = first; idx < last; ++idx) {
+              DNet &d_net = spef.m_d_nets[idx];
+              d_net.m_total_cap *= cap_factor;
+              for (auto &conn : d_net.m_conns) {
+                detail::scale_conn_attrs(
+                    conn.m_conn_attrs,
+                    cap_factor,
+                    time_factor);
+              }
+              for (auto &ground_cap : d_net.m_ground_caps) {
+                ground_cap.m_cap *= cap_factor;
+              }
+              for (auto &coupling_cap : d_net.m_coupling_caps) {
+                coupling_cap.m_cap *= cap_factor;
+              }
+              for (auto &res : d_net.m_resistances) {
+                res.m_res *= res_factor;
+              }
+            }
+          })
+      .wait();
+  spef.m_d_net_variations.m_ground_cap_corners.scale(cap_factor);
+  spef.m_d_net_variations.m_coupling_cap_corners.scale(cap_factor);
+  spef.m_d_net_variations.m_res_corners.scale(res_factor);
+  spef.m_d_net_variations.m_total_cap_corners.scale(cap_factor);
+
+  for (auto &r_net : spef.m_r_nets) {
+    r_net.m_total_cap *= cap_factor;
+    r_net.m_pi_model.m_c2 *= cap_factor;
+    r_net.m_pi_model.m_r1 *= res_factor;
+    r_net.m_pi_model.m_c1 *= cap_factor;
+    for (auto &load : r_net.m_loads) {
+      load.m_rc *= time_factor;
+    }
+    // the poles and the residues are in 1 / T_UNIT
+    for (auto &pole : r_net.m_poles) {
+      pole /= time_factor;
+    }
+    for (auto &residue : r_net.m_residues) {
+      residue /= time_factor;
+    }
+    if (r_net.m_total_cap_corners) {
+      for (auto &cap : *r_net.m_total_cap_corners) {
+        cap *= cap_factor;
+      }
+    }
+    if (r_net.m_pi_model_corners) {
+      for (auto &pi_model : *r_net.m_pi_model_corners) {
+        pi_model.m_c2 *= cap_factor;
+        pi_model.m_r1 *= res_factor;
+        pi_model.m_c1 *= cap_factor;
+      }
+    }
+    r_net.m_rc_corners.scale(time_factor);
+    for (auto *corners : {&r_net.m_pole_corners, &r_net.m_residue_corners}) {
+      for (auto &values : corners->m_values) {
+        for (auto &value : values) {
+          value /= time_factor;
+        }
+      }
+    }
+  }
+
+  if (spef.m_time_scale) {
+    spef.m_time_scale = scaled_value{1, UnitType::Second};
+  }
+  if (spef.m_cap_scale) {
+    spef.m_cap_scale = scaled_value{1, UnitType::Farad};
+  }
+  if (spef.m_res_scale) {
+    spef.m_res_scale = scaled_value{1, UnitType::Ohm};
+  }
+  if (spef.m_induct_scale) {
+    spef.m_induct_scale = scaled_value{1, UnitType::Henry};
+  }
+}
+
+#endif  // SPEF_UNITS_HPP
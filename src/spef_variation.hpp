@@ -0,0 +1,284 @@
+#ifndef SPEF_VARIATION_HPP
+#define SPEF_VARIATION_HPP
+
+#include "spef_structs.hpp"
+#include <BS_thread_pool.hpp>
+#include <cmath>
+#include <cstdint>
+#include <fmt/core.h>
+#include <initializer_list>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Evaluation of the caps and resistances of the nets under process variation,
+// from their *SC sensitivities. An element with nominal value v and the
+// sensitivities c_k to the parameters p_k takes the value
+//
+//   v * (1 + sum_k c_k * p_k / n_k)
+//
+// where p_k is the deviation of the parameter from its nominal value and n_k
+// its normalization factor in *VARIATION_PARAMETERS. The temperature
+// coefficients aren't applied.
+//
+// The engine evaluates a batch of samples at once. The samples are the inner
+// dimension of all the arrays, so the loops over them are contiguous and are
+// vectorized by the compiler.
+
+/// The deviations of the process parameters for a batch of samples. The value
+/// of the parameter in row r for sample s is m_values[r * m_num_samples + s].
+class ParameterSamples {
+public:
+  static constexpr std::uint32_t NO_ROW = static_cast<std::uint32_t>(-1);
+
+private:
+  std::size_t m_num_samples;
+  std::size_t m_num_params{};
+  std::vector<std::uint32_t> m_rows;  // indexed by parameter id
+  std::vector<double> m_norms;        // indexed by row
+  std::vector<double> m_values;
+
+  void add_row(std::uint32_t id, double normalization) {
+    if (id >= m_rows.size()) {
+      m_rows.resize(id + 1, NO_ROW);
+    }
+    m_rows[id] = static_cast<std::uint32_t>(m_norms.size());
+    m_norms.push_back(normalization != 0 ? normalization : 1);
+  }
+
+public:
+  /// Zero deviations of the process parameters of the SPEF, for num_samples
+  /// samples. The temperature coefficients have rows too, which stay zero.
+  ParameterSamples(SPEF const &spef, std::size_t num_samples)
+      : m_num_samples(num_samples),
+        m_num_params(spef.m_variation_params.size()) {
+    for (auto const &param : spef.m_variation_params) {
+      add_row(param.m_id, param.m_normalization);
+    }
+    if (spef.m_temperature_coeffs) {
+      add_row(spef.m_temperature_coeffs->m_crt1, 1);
+      add_row(spef.m_temperature_coeffs->m_crt2, 1);
+    }
+    m_values.resize(m_norms.size() * num_samples);
+  }
+
+  [[nodiscard]] std::size_t num_samples() const { return m_num_samples; }
+
+  /// The number of process parameters, without the temperature coefficients
+  [[nodiscard]] std::size_t num_params() const { return m_num_params; }
+
+  /// Returns the row of the parameter with the given id, or NO_ROW
+  [[nodiscard]] std::uint32_t row(std::uint32_t id) const {
+    return id < m_rows.size() ? m_rows[id] : NO_ROW;
+  }
+
+  [[nodiscard]] double normalization(std::uint32_t row) const {
+    return m_norms[row];
+  }
+
+  /// The deviations of the parameter in the row, one per sample
+  [[nodiscard]] double *values(std::uint32_t row) {
+    return m_values.data() + row * m_num_samples;
+  }
+
+  [[nodiscard]] double const *values(std::uint32_t row) const {
+    return m_values.data() + row * m_num_samples;
+  }
+};
+
+/// Draws num_samples samples of the process parameters of the SPEF. Every
+/// parameter is independent and normally distributed around its nominal value,
+/// with its variation coefficient as the standard deviation. The samples
+/// depend only on the seed.
+inline ParameterSamples draw_parameter_samples(
+    SPEF const &spef,
+    std::size_t num_samples,
+    std::uint64_t seed = 1) {
+  ParameterSamples samples(spef, num_samples);
+  std::mt19937_64 gen(seed);
+  for (auto const &param : spef.m_variation_params) {
+    std::normal_distribution<double> dist(0, param.m_var_coeff);
+    auto *const values = samples.values(samples.row(param.m_id));
+    for (std::size_t s = 0; s < num_samples; ++s) {
+      values[s] = dist(gen);
+    }
+  }
+  return samples;
+}
+
+/// Throws if an *SC sensitivity of a D_NET refers to a process parameter that
+/// isn't in *VARIATION_PARAMETERS, which the grammar can't check
+inline void check_sensitivity_params(SPEF const &spef) {
+  ParameterSamples const defined(spef, 0);
+  auto const &columns = spef.m_d_net_variations;
+  for (std::size_t idx = 0; idx < columns.num_nets(); ++idx) {
+    auto const variations = columns.net(idx);
+    for (auto const *sens :
+         {&variations.m_ground_cap_sens,
+          &variations.m_coupling_cap_sens,
+          &variations.m_res_sens}) {
+      for (auto const param : sens->m_params) {
+        if (defined.row(param) == ParameterSamples::NO_ROW) {
+          throw std::runtime_error(fmt::format(
+              "D_NET {} has a sensitivity to the undefined process "
+              "parameter {}",
+              spef.m_d_nets[idx].m_name,
+              param));
+        }
+      }
+    }
+  }
+}
+
+/// Evaluates the elements with the given nominal values and sensitivities for
+/// every sample. The value of element e for sample s is written to
+/// values[e * samples.num_samples() + s].
+template<typename T>
+void evaluate_samples(
+    std::vector<T> const &nominal,
+    SensitivitiesView const &sens,
+    ParameterSamples const &samples,
+    std::vector<double> &values) {
+  auto const num_samples = samples.num_samples();
+  values.assign(nominal.size() * num_samples, 1.0);
+  for (std::size_t k = 0; k < sens.size(); ++k) {
+    auto const row = samples.row(sens.m_params[k]);
+    if (row == ParameterSamples::NO_ROW) {
+      throw std::runtime_error(fmt::format(
+          "Sensitivity to the undefined process parameter {}",
+          sens.m_params[k]));
+    }
+    double const coeff = sens.m_coeffs[k] / samples.normalization(row);
+    double const *const src = samples.values(row);
+    double *const dst = values.data() + sens.m_elements[k] * num_samples;
+    for (std::size_t s = 0; s < num_samples; ++s) {
+      dst[s] += coeff * src[s];
+    }
+  }
+  for (std::size_t e = 0; e < nominal.size(); ++e) {
+    double const value = nominal[e];
+    double *const dst = values.data() + e * num_samples;
+    for (std::size_t s = 0; s < num_samples; ++s) {
+      dst[s] *= value;
+    }
+  }
+}
+
+/// The total cap and the total resistance of a net over the samples
+struct NetVariation {
+  double m_nominal_cap{};
+  double m_mean_cap{};
+  double m_sigma_cap{};
+  double m_nominal_res{};
+  double m_mean_res{};
+  double m_sigma_res{};
+};
+
+namespace detail {
+/// Adds up the values of the elements of every sample into totals, and
+/// returns the nominal total
+template<typename T>
+double add_totals(
+    std::vector<T> const &nominal,
+    std::vector<double> const &values,
+    std::vector<double> &totals) {
+  auto const num_samples = totals.size();
+  double total = 0;
+  for (std::size_t e = 0; e < nominal.size(); ++e) {
+    total += nominal[e];
+    double const *const src = values.data() + e * num_samples;
+    for (std::size_t s = 0; s < num_samples; ++s) {
+      totals[s] += src[s];
+    }
+  }
+  return total;
+}
+
+/// Returns the mean and the standard deviation of the values
+inline std::pair<double, double> mean_sigma(std::vector<double> const &values) {
+  if (values.empty()) {
+    return {0, 0};
+  }
+  double sum = 0;
+  for (auto const value : values) {
+    sum += value;
+  }
+  double const mean = sum / static_cast<double>(values.size());
+  double sum_sq = 0;
+  for (auto const value : values) {
+    sum_sq += (value - mean) * (value - mean);
+  }
+  return {mean, std::sqrt(sum_sq / static_cast<double>(values.size()))};
+}
+
+/// The variation of a net, using the given buffers as scratch space
+inline NetVariation net_variation(
+    DNet const &d_net,
+    DNetVariationsView const &variations,
+    ParameterSamples const &samples,
+    std::vector<double> &nominal,
+    std::vector<double> &values,
+    std::vector<double> &totals) {
+  NetVariation var;
+
+  totals.assign(samples.num_samples(), 0.0);
+  nominal.clear();
+  for (auto const &ground_cap : d_net.m_ground_caps) {
+    nominal.push_back(ground_cap.m_cap);
+  }
+  evaluate_samples(nominal, variations.m_ground_cap_sens, samples, values);
+  var.m_nominal_cap = add_totals(nominal, values, totals);
+  nominal.clear();
+  for (auto const &coupling_cap : d_net.m_coupling_caps) {
+    nominal.push_back(coupling_cap.m_cap);
+  }
+  evaluate_samples(nominal, variations.m_coupling_cap_sens, samples, values);
+  var.m_nominal_cap += add_totals(nominal, values, totals);
+  std::tie(var.m_mean_cap, var.m_sigma_cap) = mean_sigma(totals);
+
+  totals.assign(samples.num_samples(), 0.0);
+  nominal.clear();
+  for (auto const &res : d_net.m_resistances) {
+    nominal.push_back(res.m_res);
+  }
+  evaluate_samples(nominal, variations.m_res_sens, samples, values);
+  var.m_nominal_res = add_totals(nominal, values, totals);
+  std::tie(var.m_mean_res, var.m_sigma_res) = mean_sigma(totals);
+
+  return var;
+}
+}  // namespace detail
+
+/// Evaluates every D_NET of the SPEF for all the samples in parallel, and
+/// returns the nominal value, the mean and the standard deviation of the
+/// total cap and the total resistance of every net, in the order of
+/// SPEF::m_d_nets
+inline std::vector<NetVariation> sweep_variation(
+    SPEF const &spef,
+    ParameterSamples const &samples,
+    BS::thread_pool &pool) {
+  std::vector<NetVariation> variations(spef.m_d_nets.size());
+  pool.parallelize_loop(
+          spef.m_d_nets.size(),
+          [&](std::size_t const first, std::size_t const last) {
+            // the buffers are reused by all the nets of the block
+            std::vector<double> nominal;
+            std::vector<double> values;
+            std::vector<double> totals;
+            for (std::size_t idx = first; idx < last; ++idx) {
+              variations[idx] = detail::net_variation(
+                  spef.m_d_nets[idx],
+                  spef.m_d_net_variations.net(idx),
+                  samples,
+                  nominal,
+                  values,
+                  totals);
+            }
+          })
+      .get();
+  return variations;
+}
+
+#endif  // SPEF_VARIATION_HPP
@@ -1,10 +1,13 @@
 #ifndef SPEF_WRITE_HPP
 #define SPEF_WRITE_HPP
 
+#include <algorithm>
 #include <iostream>
 
 #include <fmt/ostream.h>
 
+#include "spef_name_map.hpp"
+#include "spef_node_name.hpp"
 #include "spef_structs.hpp"
 
 std::string_view get_connection_type_sv(ConnType type) {
@@ -30,6 +33,95 @@ std::string_view get_direction_type_sv(DirType type) {
   throw std::runtime_error("Unknown direction type");
 };
 
+std::string_view get_unit_type_sv(UnitType type) {
+  switch (type) {
+  case UnitType::Second:
+    return "S";
+  case UnitType::Nanosecond:
+    return "NS";
+  case UnitType::Picosecond:
+    return "PS";
+  case UnitType::Farad:
+    return "F";
+  case UnitType::Picofarad:
+    return "PF";
+  case UnitType::Femtofarad:
+    return "FF";
+  case UnitType::Ohm:
+    return "OHM";
+  case UnitType::Kiloohm:
+    return "KOHM";
+  case UnitType::Henry:
+    return "HENRY";
+  case UnitType::Millihenry:
+    return "MH";
+  case UnitType::Microhenry:
+    return "UH";
+  case UnitType::None:
+    break;
+  }
+  throw std::runtime_error("Unknown unit type");
+};
+
+/// Writes a unit definition. SPEF has no keywords for seconds and Farad, which
+/// are written in NS and PF instead.
+void write_scale(
+    std::ostream &os,
+    std::string_view keyword,
+    scaled_value scale) {
+  if (!scale) {
+    return;
+  }
+  if (scale.unit == UnitType::Second) {
+    scale = {scale.value * 1e9, UnitType::Nanosecond};
+  } else if (scale.unit == UnitType::Farad) {
+    scale = {scale.value * 1e12, UnitType::Picofarad};
+  }
+  fmt::println(
+      os,
+      "{} {} {}",
+      keyword,
+      scale.value,
+      get_unit_type_sv(scale.unit));
+}
+
+/// Writes the value of the element, or its min:typ:max triplet if the net has
+/// corners
+template<typename T>
+void write_par_value(
+    std::ostream &os,
+    T value,
+    CornerValuesView<T> const &corners,
+    std::size_t idx) {
+  if (corners.empty()) {
+    fmt::print(os, " {}", value);
+    return;
+  }
+  fmt::print(
+      os,
+      " {}:{}:{}",
+      corners[Corner::Min][idx],
+      corners[Corner::Typ][idx],
+      corners[Corner::Max][idx]);
+}
+
+/// Writes the *SC sensitivities of the element, which start at pos, and
+/// advances pos past them
+void write_sensitivities(
+    std::ostream &os,
+    SensitivitiesView const &sens,
+    std::uint32_t element,
+    std::size_t &pos) {
+  if (pos == sens.size() || sens.m_elements[pos] != element) {
+    return;
+  }
+  fmt::print(os, " *SC");
+  // the coefficients must be written with a decimal point
+  for (; pos < sens.size() && sens.m_elements[pos] == element; ++pos) {
+    fmt::print(os, " {}:{:#}", sens.m_params[pos], sens.m_coeffs[pos]);
+  }
+}
+
 std::ostream &operator<<(std::ostream &os, Capacitances const &caps) {
   bool is_first = true;
   for (cap_t cap : caps.m_caps) {
@@ -93,8 +185,18 @@ std::ostream &operator<<(std::ostream &os, ConnAttr const *conn_attr) {
   return os;
 }
 
-std::ostream &operator<<(std::ostream &os, DNet const &d_net) {
-  fmt::println(os, "\n*D_NET {} {}", d_net.m_name, d_net.m_total_cap);
+/// Writes the D_NET, with the sensitivities and the corners of its elements,
+/// with the delimiters of Splitter. The parser keeps the full names of the
+/// internal nodes, like net:3, while generated nets may only have the index of
+/// the node, which is then prefixed with the net name.
+template<typename Splitter>
+std::ostream &write_d_net(
+    std::ostream &os,
+    DNet const &d_net,
+    DNetVariationsView const &variations) {
+  fmt::print(os, "\n*D_NET {}", d_net.m_name);
+  write_par_value(os, d_net.m_total_cap, variations.m_total_cap_corners, 0);
+  fmt::println(os, "");
   if (d_net.m_routing_conf != 0) {
     fmt::println(os, "*V {}", d_net.m_routing_conf);
   }
@@ -112,47 +214,181 @@ std::ostream &operator<<(std::ostream &os, DNet const &d_net) {
     fmt::println(os, "");
   }
   for (auto const &node : d_net.m_nodes) {
-    // TODO: change ':' with spef pin delimiter
+    if (Splitter::split(node.m_name).has_pin()) {
+      fmt::print(os, "*N {}", node.m_name);
+    } else {
+      fmt::print(
+          os,
+          "*N {}{}{}",
+          d_net.m_name,
+          Splitter::pin_delim,
+          node.m_name);
+    }
     fmt::println(
         os,
-        "*N {}:{} {} {}",
-        d_net.m_name,
-        node.m_name,
+        " *C {} {}",
         node.m_coords->m_coord.x,
         node.m_coords->m_coord.y);
   }
   if (!d_net.m_ground_caps.empty() || !d_net.m_coupling_caps.empty()) {
     // TODO: add connection attributes
     std::size_t cap_idx = 1;
+    std::size_t sens_pos = 0;
     fmt::println(os, "*CAP");
-    for (auto const &ground_cap : d_net.m_ground_caps) {
-      fmt::println(
+    for (std::uint32_t idx = 0; idx < d_net.m_ground_caps.size(); ++idx) {
+      auto const &ground_cap = d_net.m_ground_caps[idx];
+      fmt::print(
           os,
-          "{} {} {}",
+          "{} {}",
           cap_idx++,
-          ground_cap.m_node,
-          ground_cap.m_cap);
+          ground_cap.m_node);
+      write_par_value(
+          os,
+          ground_cap.m_cap,
+          variations.m_ground_cap_corners,
+          idx);
+      write_sensitivities(os, variations.m_ground_cap_sens, idx, sens_pos);
+      fmt::println(os, "");
     }
-    for (auto const &coupling_cap : d_net.m_coupling_caps) {
-      fmt::println(
+    sens_pos = 0;
+    for (std::uint32_t idx = 0; idx < d_net.m_coupling_caps.size(); ++idx) {
+      auto const &coupling_cap = d_net.m_coupling_caps[idx];
+      fmt::print(
           os,
-          "{} {} {} {}",
+          "{} {} {}",
           cap_idx++,
           coupling_cap.m_node1,
-          coupling_cap.m_node2,
-          coupling_cap.m_cap);
+          coupling_cap.m_node2);
+      write_par_value(
+          os,
+          coupling_cap.m_cap,
+          variations.m_coupling_cap_corners,
+          idx);
+      write_sensitivities(
+          os,
+          variations.m_coupling_cap_sens,
+          idx,
+          sens_pos);
+      fmt::println(os, "");
     }
   }
   if (!d_net.m_resistances.empty()) {
+    std::size_t sens_pos = 0;
     fmt::println(os, "*RES");
-    for (auto const &res : d_net.m_resistances) {
-      fmt::println(
+    for (std::uint32_t idx = 0; idx < d_net.m_resistances.size(); ++idx) {
+      auto const &res = d_net.m_resistances[idx];
+      fmt::print(
           os,
-          "{} {} {} {}",
+          "{} {} {}",
           res.m_id,
           res.m_node1,
-          res.m_node2,
-          res.m_res);
+          res.m_node2);
+      write_par_value(os, res.m_res, variations.m_res_corners, idx);
+      write_sensitivities(os, variations.m_res_sens, idx, sens_pos);
+      fmt::println(os, "");
+    }
+  }
+  fmt::println(os, "*END");
+  return os;
+}
+
+/// Writes the D_NET with the default delimiters
+std::ostream &operator<<(std::ostream &os, SingleDNet const &d_net) {
+  return write_d_net<DefaultNodeNameSplitter>(
+      os,
+      d_net.m_d_net,
+      d_net.variations());
+}
+
+/// Writes a pole or a residue, as a real number, or as a complex number
+/// (re im) if it has an imaginary part
+void write_complex_value(std::ostream &os, std::complex<double> value) {
+  if (value.imag() == 0) {
+    fmt::print(os, "{}", value.real());
+  } else {
+    fmt::print(os, "({} {})", value.real(), value.imag());
+  }
+}
+
+/// Writes the poles or the residues [first, first + num) of a load, or their
+/// min:typ:max triplets if the net has corners
+void write_complex_values(
+    std::ostream &os,
+    std::vector<std::complex<double>> const &values,
+    CornerValues<std::complex<double>> const &corners,
+    std::size_t first,
+    std::size_t num) {
+  for (std::size_t idx = first; idx < first + num; ++idx) {
+    os << ' ';
+    if (corners.empty()) {
+      write_complex_value(os, values[idx]);
+      continue;
+    }
+    write_complex_value(os, corners[Corner::Min][idx]);
+    os << ':';
+    write_complex_value(os, corners[Corner::Typ][idx]);
+    os << ':';
+    write_complex_value(os, corners[Corner::Max][idx]);
+  }
+}
+
+std::ostream &operator<<(std::ostream &os, RNet const &r_net) {
+  if (r_net.m_total_cap_corners) {
+    auto const &[min, typ, max] = *r_net.m_total_cap_corners;
+    fmt::println(os, "\n*R_NET {} {}:{}:{}", r_net.m_name, min, typ, max);
+  } else {
+    fmt::println(os, "\n*R_NET {} {}", r_net.m_name, r_net.m_total_cap);
+  }
+  if (r_net.m_routing_conf != 0) {
+    fmt::println(os, "*V {}", r_net.m_routing_conf);
+  }
+  if (!r_net.m_driver.empty()) {
+    fmt::println(os, "*DRIVER {}", r_net.m_driver);
+    fmt::println(os, "*CELL {}", r_net.m_driver_cell);
+    if (r_net.m_pi_model_corners) {
+      auto const &[min, typ, max] = *r_net.m_pi_model_corners;
+      fmt::println(
+          os,
+          "*C2_R1_C1 {}:{}:{} {}:{}:{} {}:{}:{}",
+          min.m_c2,
+          typ.m_c2,
+          max.m_c2,
+          min.m_r1,
+          typ.m_r1,
+          max.m_r1,
+          min.m_c1,
+          typ.m_c1,
+          max.m_c1);
+    } else {
+      fmt::println(
+          os,
+          "*C2_R1_C1 {} {} {}",
+          r_net.m_pi_model.m_c2,
+          r_net.m_pi_model.m_r1,
+          r_net.m_pi_model.m_c1);
+    }
+    fmt::println(os, "*LOADS");
+    for (std::size_t idx = 0; idx < r_net.m_loads.size(); ++idx) {
+      auto const &load = r_net.m_loads[idx];
+      fmt::print(os, "*RC {}", load.m_pin);
+      write_par_value(os, load.m_rc, r_net.m_rc_corners.view(), idx);
+      if (load.m_num_poles != 0) {
+        fmt::print(os, "\n*Q {}", load.m_num_poles);
+        write_complex_values(
+            os,
+            r_net.m_poles,
+            r_net.m_pole_corners,
+            load.m_first_pole,
+            load.m_num_poles);
+        fmt::print(os, "\n*K {}", load.m_num_poles);
+        write_complex_values(
+            os,
+            r_net.m_residues,
+            r_net.m_residue_corners,
+            load.m_first_pole,
+            load.m_num_poles);
+      }
+      fmt::println(os, "");
     }
   }
   fmt::println(os, "*END");
@@ -207,33 +443,26 @@ std::ostream &operator<<(std::ostream &os, SPEF const &spef) {
       fmt::println(os, "*BUS_DELIMITER {}", spef.m_prefix_bus_delim);
     }
   }
-  if (spef.m_time_scale) {
-    fmt::println(
-        os,
-        "*T_UNIT {} {}",
-        spef.m_time_scale.value,
-        spef.m_time_scale.unit);
-  }
-  if (spef.m_cap_scale) {
-    fmt::println(
-        os,
-        "*C_UNIT {} {}",
-        spef.m_cap_scale.value,
-        spef.m_cap_scale.unit);
-  }
-  if (spef.m_res_scale) {
-    fmt::println(
-        os,
-        "*R_UNIT {} {}",
-        spef.m_res_scale.value,
-        spef.m_res_scale.unit);
-  }
-  if (spef.m_induct_scale) {
-    fmt::println(
-        os,
-        "*L_UNIT {} {}",
-        spef.m_induct_scale.value,
-        spef.m_induct_scale.unit);
+  write_scale(os, "*T_UNIT", spef.m_time_scale);
+  write_scale(os, "*C_UNIT", spef.m_cap_scale);
+  write_scale(os, "*R_UNIT", spef.m_res_scale);
+  write_scale(os, "*L_UNIT", spef.m_induct_scale);
+
+  if (!spef.m_name_map.empty()) {
+    fmt::println(os, "\n*NAME_MAP");
+    // write the entries in the order of their indices, and not in the order of
+    // the unordered map
+    std::vector<std::pair<std::string const, std::string> const *> entries;
+    entries.reserve(spef.m_name_map.size());
+    for (auto const &entry : spef.m_name_map) {
+      entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](auto lhs, auto rhs) {
+      return index_number(lhs->first) < index_number(rhs->first);
+    });
+    for (auto const *entry : entries) {
+      fmt::println(os, "{} {}", entry->first, entry->second);
+    }
   }
 
   if (!spef.m_power_nets.empty()) {
@@ -270,18 +499,44 @@ std::ostream &operator<<(std::ostream &os, SPEF const &spef) {
     }
   }
 
-  if (!spef.m_name_map.empty()) {
-    fmt::println(os, "\n*NAME_MAP");
-    // TODO: The order depends on the unordered map
-    for (auto const &[index, name] : spef.m_name_map) {
-      fmt::println(os, "{} {}", index, name);
+  if (!spef.m_variation_params.empty() || spef.m_temperature_coeffs) {
+    fmt::println(os, "*VARIATION_PARAMETERS");
+    for (auto const &param : spef.m_variation_params) {
+      fmt::println(
+          os,
+          "{} {} {} {} {} {:#} {:#}",
+          param.m_id,
+          param.m_name,
+          param.m_cap_type,
+          param.m_res_type,
+          param.m_induct_type,
+          param.m_var_coeff,
+          param.m_normalization);
+    }
+    if (spef.m_temperature_coeffs) {
+      fmt::println(
+          os,
+          "{} CRT1 {} CRT2 {:#}",
+          spef.m_temperature_coeffs->m_crt1,
+          spef.m_temperature_coeffs->m_crt2,
+          spef.m_temperature_coeffs->m_nominal_temp);
     }
   }
 
   // first we write the D_NETs and then the R_NETs
   if (!spef.m_d_nets.empty()) {
-    for (DNet const &d_net : spef.m_d_nets) {
-      os << d_net;
+    with_node_name_splitter(spef, [&](auto splitter) {
+      for (std::size_t idx = 0; idx < spef.m_d_nets.size(); ++idx) {
+        write_d_net<decltype(splitter)>(
+            os,
+            spef.m_d_nets[idx],
+            spef.m_d_net_variations.net(idx));
+      }
+    });
+  }
+  if (!spef.m_r_nets.empty()) {
+    for (RNet const &r_net : spef.m_r_nets) {
+      os << r_net;
     }
   }
 